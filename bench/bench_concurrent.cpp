@@ -0,0 +1,96 @@
+#include "../btree.h"
+#include "../btree_sharded.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//runs body(thread, ops) on every thread, then finish(), and prints the total throughput
+template <typename Body, typename Finish>
+void measure(const std::string &name, int threads_num, int ops, Body body, Finish finish) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threads_num; ++t) {
+        threads.push_back(std::thread(body, t, ops));
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    finish();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    std::cout << name << " " << threads_num << " threads: "
+              << (uint64_t)(threads_num * ops / seconds) << " ops/s" << std::endl;
+}
+
+template <typename Body>
+void measure(const std::string &name, int threads_num, int ops, Body body) {
+    measure(name, threads_num, ops, body, []() { });
+}
+
+int main() {
+    const int order = 64;
+    const int keys_num = 1000000;
+    const int ops = 50000;
+    const char *filename = "bench_concurrent.dat";
+    {
+        std::vector<int> keys;
+        for (int i = 0; i < keys_num; ++i) {
+            keys.push_back(2 * i);
+        }
+        BTree tree(filename, order);
+        tree.putMany(keys);
+    }
+    BTree tree(filename);
+    for (int threads_num = 1; threads_num <= 32; threads_num *= 2) {
+        measure("contains", threads_num, ops, [&tree](int t, int ops) {
+            unsigned seed = t;
+            for (int i = 0; i < ops; ++i) {
+                tree.contains(2 * (rand_r(&seed) % keys_num));
+            }
+        });
+    }
+    //odd keys never collide with the loaded ones, every thread owns its residue
+    for (int threads_num = 1; threads_num <= 32; threads_num *= 2) {
+        measure("put/remove", threads_num, ops, [&tree, threads_num](int t, int ops) {
+            for (int i = 0; i < ops / 2; ++i) {
+                tree.put(2 * (i * threads_num + t) + 1);
+            }
+            for (int i = 0; i < ops / 2; ++i) {
+                tree.remove(2 * (i * threads_num + t) + 1);
+            }
+        });
+    }
+    for (int threads_num = 1; threads_num <= 32; threads_num *= 2) {
+        measure("mixed 90/10", threads_num, ops, [&tree, threads_num](int t, int ops) {
+            unsigned seed = t;
+            int next = 0;
+            for (int i = 0; i < ops; ++i) {
+                if (i % 10 == 0) {
+                    tree.put(2 * (next++ * threads_num + t) + 1);
+                }
+                else {
+                    tree.contains(2 * (rand_r(&seed) % keys_num));
+                }
+            }
+            for (int i = 0; i < next; ++i) {
+                tree.remove(2 * (i * threads_num + t) + 1);
+            }
+        });
+    }
+    //fresh keys from 8 threads, every shard applies its queue on its own writer
+    for (int shards = 1; shards <= 8; shards *= 2) {
+        ShardedBTree sharded("bench_concurrent_sharded.dat", order, shards);
+        measure("sharded put, " + std::to_string(shards) + " shards,", 8, ops, [&sharded](int t, int ops) {
+            for (int i = 0; i < ops; ++i) {
+                sharded.put(i * 8 + t);
+            }
+        }, [&sharded]() {
+            sharded.flush();
+        });
+    }
+    return 0;
+}
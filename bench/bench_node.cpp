@@ -0,0 +1,119 @@
+#include "../btree.h"
+#include "../btree_node.h"
+#include "../btree_node_view.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+//counts every heap allocation made by the process
+static uint64_t allocations = 0;
+
+void *operator new(size_t size) {
+    ++allocations;
+    void *p = malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+template <typename F>
+void measure(const char *name, int ops, F f) {
+    uint64_t allocs = allocations;
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    std::cout << name << ": " << ns / ops << " ns/op, "
+              << (double)(allocations - allocs) / ops << " allocs/op" << std::endl;
+}
+
+int main() {
+    const int order = 100;
+    const int ops = 100000;
+    BTreeNode node(order, 4096, false);
+    for (int i = 0; i < order; ++i) {
+        node.addChild(i * 16, 4096 * (i + 2));
+    }
+    node.setKeysNum(order);
+    std::vector<uint8_t> page(BTreeNode::maxNodeSerializationSize(order));
+    node.serialize(page.data());
+    std::vector<int> probes(ops);
+    for (int &probe: probes) {
+        probe = rand() % (order * 16);
+    }
+
+    uint64_t sink = 0;
+    measure("node deserialize", ops, [&]() {
+        for (int i = 0; i < ops; ++i) {
+            BTreeNode copy = BTreeNode::deserialize(page.data(), page.size());
+            sink += copy.keysNum();
+        }
+    });
+    //same entries bit-packed into a leaf page
+    BTreeNode packed(order, 4096, true);
+    packed.setPacked(page.size());
+    for (int i = 0; i < order; ++i) {
+        packed.put(i * 16, 0);
+    }
+    std::vector<uint8_t> packed_page(page.size());
+    packed.serialize(packed_page.data());
+    measure("packed leaf view", ops, [&]() {
+        for (int i = 0; i < ops; ++i) {
+            BTreeNodeView view(packed_page.data(), packed_page.size());
+            sink += view.keysNum();
+        }
+    });
+    measure("node next", ops, [&]() {
+        for (int probe: probes) {
+            sink += node.next(probe);
+        }
+    });
+    measure("node contains", ops, [&]() {
+        for (int probe: probes) {
+            sink += node.contains(probe);
+        }
+    });
+
+    BTree tree("bench_node.dat", order);
+    for (int i = 0; i < ops; ++i) {
+        tree.put(i);
+    }
+    measure("tree contains", ops, [&]() {
+        for (int probe: probes) {
+            sink += tree.contains(probe % ops);
+        }
+    });
+
+    BTreeOptions options;
+    options.use_mmap = true;
+    BTree mapped("bench_node_mmap.dat", order, options);
+    for (int i = 0; i < ops; ++i) {
+        mapped.put(i);
+    }
+    measure("mapped tree contains", ops, [&]() {
+        for (int probe: probes) {
+            sink += mapped.contains(probe % ops);
+        }
+    });
+
+    BTreeOptions packed_options;
+    packed_options.leaf_order = 8 * order;
+    BTree packed_tree("bench_node_packed.dat", order, packed_options);
+    for (int i = 0; i < ops; ++i) {
+        packed_tree.put(i);
+    }
+    measure("packed tree contains", ops, [&]() {
+        for (int probe: probes) {
+            sink += packed_tree.contains(probe % ops);
+        }
+    });
+    std::cout << "height " << tree.height() << ", packed height " << packed_tree.height() << std::endl;
+    return sink == 0;
+}
@@ -0,0 +1,46 @@
+#include "../btree_search.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+//intra-node key search for every supported mode across node orders
+int main() {
+    const int orders[] = {8, 16, 32, 64, 100, 128, 256, 512, 1000, 2000};
+    const int probes_num = 1 << 20;
+    std::vector<int> probes(probes_num);
+    uint64_t sink = 0;
+    std::cout << "order";
+    for (int mode = BTreeSearch::SCALAR; mode <= BTreeSearch::AVX2; ++mode) {
+        if (BTreeSearch::isSupported((BTreeSearch::Mode)mode))
+            std::cout << "\t" << BTreeSearch::modeName((BTreeSearch::Mode)mode) << " ns/op";
+    }
+    std::cout << std::endl;
+    for (int order: orders) {
+        std::vector<int> keys(order);
+        for (int &key: keys) {
+            key = rand();
+        }
+        std::sort(keys.begin(), keys.end());
+        for (int &probe: probes) {
+            probe = rand();
+        }
+        std::cout << order;
+        for (int mode = BTreeSearch::SCALAR; mode <= BTreeSearch::AVX2; ++mode) {
+            if (!BTreeSearch::isSupported((BTreeSearch::Mode)mode))
+                continue;
+            BTreeSearch::setMode((BTreeSearch::Mode)mode);
+            auto start = std::chrono::steady_clock::now();
+            for (int probe: probes) {
+                sink += BTreeSearch::upperBound(keys.data(), order, probe);
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << "\t" << std::chrono::duration<double, std::nano>(elapsed).count() / probes_num;
+        }
+        std::cout << std::endl;
+    }
+    BTreeSearch::setMode(BTreeSearch::defaultMode());
+    return sink == 0;
+}
@@ -0,0 +1,408 @@
+#include "../btree.h"
+#include "../btree_builder.h"
+#include "../btree_memory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+//Parameterized throughput and latency cases over a freshly built tree.
+//  bench_suite [--sizes=10000,1000000] [--orders=4,64,2000]
+//              [--keys=seq,random,zipf] [--workloads=point,multiget,scan,mixed,put,remove]
+//              [--cache=warm,cold,memory] [--ops=10000] [--dirty-limit=bytes] [--json[=file]]
+//The tree holds the even keys 0, 2, ..., 2 * (size - 1); puts add odd keys.
+//Cold cases drop the file from the page cache and start with an empty pool,
+//warm cases first run a read pass over the keys the case touches.
+//Memory cases keep the tree in a BTreeMemory arena instead of a file.
+//Page writes are counted at write-back, which waits for the dirty limit.
+//Multiget looks keys up in batches, its ops and page counts are per key
+//and its latencies per batch.
+
+namespace {
+
+const char *FILENAME = "bench_suite.dat";
+const int SCAN_LENGTH = 100;
+const size_t MULTIGET_BATCH = 128;
+
+struct Config {
+    std::vector<uint64_t> sizes;
+    std::vector<int> orders;
+    std::vector<std::string> keys;
+    std::vector<std::string> workloads;
+    std::vector<std::string> caches;
+    size_t ops;
+    size_t dirty_limit;
+    bool json;
+    std::string json_file;
+};
+
+struct Result {
+    uint64_t size;
+    int order;
+    std::string keys;
+    std::string workload;
+    std::string cache;
+    int height;
+    size_t ops;
+    double ops_per_sec;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    double page_reads;
+    double page_writes;
+};
+
+std::vector<std::string> split(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+//scrambled zipfian ranks as in YCSB, theta 0.99
+class Zipf {
+public:
+    explicit Zipf(uint64_t n): _n(n), _theta(0.99) {
+        _zeta_n = zeta(n);
+        _alpha = 1.0 / (1.0 - _theta);
+        _eta = (1.0 - std::pow(2.0 / n, 1.0 - _theta)) / (1.0 - zeta(2) / _zeta_n);
+    }
+    uint64_t next(std::mt19937_64 &rng) {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        double uz = u * _zeta_n;
+        uint64_t rank;
+        if (uz < 1.0)
+            rank = 0;
+        else if (uz < 1.0 + std::pow(0.5, _theta))
+            rank = 1;
+        else
+            rank = std::min(_n - 1, (uint64_t)(_n * std::pow(_eta * u - _eta + 1.0, _alpha)));
+        //hot keys spread over the key space instead of sitting in one leaf
+        return scramble(rank) % _n;
+    }
+private:
+    double zeta(uint64_t n) const {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) {
+            sum += 1.0 / std::pow((double)i, _theta);
+        }
+        return sum;
+    }
+    static uint64_t scramble(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return x;
+    }
+    uint64_t _n;
+    double _theta;
+    double _zeta_n;
+    double _alpha;
+    double _eta;
+};
+
+//key indexes in [0, n) in the order the distribution visits them
+std::vector<uint64_t> indexes(const std::string &keys, uint64_t n, size_t count, bool distinct) {
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> result;
+    std::unordered_set<uint64_t> seen;
+    std::unique_ptr<Zipf> zipf(keys == "zipf" ? new Zipf(n) : nullptr);
+    if (distinct)
+        count = std::min<uint64_t>(count, n / 2);
+    while (result.size() < count) {
+        uint64_t idx;
+        if (keys == "seq")
+            idx = result.size() % n;
+        else if (keys == "random")
+            idx = std::uniform_int_distribution<uint64_t>(0, n - 1)(rng);
+        else if (keys == "zipf")
+            idx = zipf->next(rng);
+        else
+            throw std::logic_error("Unknown key distribution " + keys);
+        if (distinct && !seen.insert(idx).second)
+            continue;
+        result.push_back(idx);
+    }
+    return result;
+}
+
+void build(uint64_t size, int order) {
+    BTreeBuilder builder(FILENAME, order, 0.7);
+    for (uint64_t i = 0; i < size; ++i) {
+        builder.add((int)(2 * i));
+    }
+}
+
+void dropCache() {
+    int fd = open(FILENAME, O_RDONLY);
+    if (fd == -1) {
+        throw std::logic_error("Could not open " + std::string(FILENAME));
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+uint64_t percentile(std::vector<uint64_t> &latencies, double p) {
+    if (latencies.empty()) return 0;
+    size_t idx = std::min(latencies.size() - 1, (size_t)(p * latencies.size()));
+    std::nth_element(latencies.begin(), latencies.begin() + idx, latencies.end());
+    return latencies[idx];
+}
+
+//times every call of op(i) for i in [0, ops)
+template <typename Op>
+void measure(BTree &tree, size_t ops, Result &result, Op op) {
+    std::vector<uint64_t> latencies(ops);
+    uint64_t reads = tree.pagesRead();
+    uint64_t writes = tree.pagesWritten();
+    auto start = std::chrono::steady_clock::now();
+    auto last = start;
+    for (size_t i = 0; i < ops; ++i) {
+        op(i);
+        auto now = std::chrono::steady_clock::now();
+        latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+        last = now;
+    }
+    double seconds = std::chrono::duration<double>(last - start).count();
+    result.ops = ops;
+    result.ops_per_sec = ops / seconds;
+    result.p50_ns = percentile(latencies, 0.5);
+    result.p99_ns = percentile(latencies, 0.99);
+    result.page_reads = (double)(tree.pagesRead() - reads) / ops;
+    result.page_writes = (double)(tree.pagesWritten() - writes) / ops;
+}
+
+Result runCase(const Config &config, uint64_t size, int order, const std::string &keys,
+               const std::string &workload, const std::string &cache) {
+    Result result = Result();
+    result.size = size;
+    result.order = order;
+    result.keys = keys;
+    result.workload = workload;
+    result.cache = cache;
+    bool mutates = workload == "put" || workload == "remove";
+    std::vector<uint64_t> idx = indexes(keys, size, config.ops, mutates);
+
+    std::unique_ptr<BTree> opened;
+    if (cache == "memory") {
+        opened.reset(new BTree(std::unique_ptr<BTreeStorage>(new BTreeMemory(order))));
+        std::vector<int> even;
+        for (uint64_t i = 0; i < size; ++i) {
+            even.push_back((int)(2 * i));
+        }
+        opened->putMany(even);
+    }
+    else {
+        build(size, order);
+        if (cache == "cold")
+            dropCache();
+        else if (cache != "warm")
+            throw std::logic_error("Unknown cache state " + cache);
+        BTreeOptions options;
+        options.dirty_limit = config.dirty_limit;
+        opened.reset(new BTree(FILENAME, options));
+    }
+    BTree &tree = *opened;
+    result.height = tree.height();
+    if (cache == "warm") {
+        for (uint64_t i: idx) {
+            tree.contains((int)(2 * i));
+        }
+    }
+
+    if (workload == "point") {
+        measure(tree, idx.size(), result, [&](size_t i) {
+            tree.contains((int)(2 * idx[i]));
+        });
+    }
+    else if (workload == "multiget") {
+        size_t batches = (idx.size() + MULTIGET_BATCH - 1) / MULTIGET_BATCH;
+        std::vector<int> batch;
+        std::vector<uint64_t> values;
+        measure(tree, batches, result, [&](size_t i) {
+            batch.clear();
+            for (size_t j = i * MULTIGET_BATCH; j < std::min(idx.size(), (i + 1) * MULTIGET_BATCH); ++j) {
+                batch.push_back((int)(2 * idx[j]));
+            }
+            tree.getMany(batch, values);
+        });
+        double keys_per_batch = (double)idx.size() / batches;
+        result.ops = idx.size();
+        result.ops_per_sec *= keys_per_batch;
+        result.page_reads /= keys_per_batch;
+        result.page_writes /= keys_per_batch;
+    }
+    else if (workload == "scan") {
+        measure(tree, idx.size(), result, [&](size_t i) {
+            BTree::iterator it = tree.lower_bound((int)(2 * idx[i]));
+            for (int n = 0; n < SCAN_LENGTH && it != tree.end(); ++n) {
+                ++it;
+            }
+        });
+    }
+    else if (workload == "mixed") {
+        //90% lookups, 5% puts of new odd keys, 5% removes of those keys
+        std::vector<int> added;
+        size_t removed = 0;
+        std::unordered_set<uint64_t> used;
+        measure(tree, idx.size(), result, [&](size_t i) {
+            if (i % 20 == 0) {
+                if (used.insert(idx[i]).second) {
+                    tree.put((int)(2 * idx[i] + 1));
+                    added.push_back((int)(2 * idx[i] + 1));
+                }
+            }
+            else if (i % 20 == 10) {
+                if (removed < added.size())
+                    tree.remove(added[removed++]);
+            }
+            else {
+                tree.contains((int)(2 * idx[i]));
+            }
+        });
+    }
+    else if (workload == "put") {
+        measure(tree, idx.size(), result, [&](size_t i) {
+            tree.put((int)(2 * idx[i] + 1));
+        });
+    }
+    else if (workload == "remove") {
+        measure(tree, idx.size(), result, [&](size_t i) {
+            tree.remove((int)(2 * idx[i]));
+        });
+    }
+    else {
+        throw std::logic_error("Unknown workload " + workload);
+    }
+    return result;
+}
+
+void printJson(std::ostream &out, const std::vector<Result> &results) {
+    out << "[" << std::endl;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        out << "  {\"size\": " << r.size << ", \"order\": " << r.order
+            << ", \"keys\": \"" << r.keys << "\", \"workload\": \"" << r.workload
+            << "\", \"cache\": \"" << r.cache << "\", \"height\": " << r.height
+            << ", \"ops\": " << r.ops << ", \"ops_per_sec\": " << (uint64_t)r.ops_per_sec
+            << ", \"p50_ns\": " << r.p50_ns << ", \"p99_ns\": " << r.p99_ns
+            << ", \"page_reads_per_op\": " << r.page_reads
+            << ", \"page_writes_per_op\": " << r.page_writes << "}"
+            << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+void printRow(const Result &r) {
+    std::cout << std::setw(10) << r.size << std::setw(6) << r.order << std::setw(8) << r.keys
+              << std::setw(10) << r.workload << std::setw(8) << r.cache
+              << std::setw(12) << (uint64_t)r.ops_per_sec << std::setw(10) << r.p50_ns
+              << std::setw(10) << r.p99_ns << std::fixed << std::setprecision(3)
+              << std::setw(9) << r.page_reads << std::setw(9) << r.page_writes << std::endl;
+}
+
+Config parse(int argc, char **argv) {
+    Config config;
+    config.sizes = {10000, 1000000};
+    config.orders = {4, 64, 2000};
+    config.keys = {"seq", "random", "zipf"};
+    config.workloads = {"point", "multiget", "scan", "mixed", "put", "remove"};
+    config.caches = {"warm", "cold"};
+    config.ops = 10000;
+    config.dirty_limit = BTreeOptions::DEFAULT_DIRTY_LIMIT;
+    config.json = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (name == "--sizes") {
+            config.sizes.clear();
+            for (const std::string &item: split(value)) {
+                config.sizes.push_back(std::stoull(item));
+            }
+        }
+        else if (name == "--orders") {
+            config.orders.clear();
+            for (const std::string &item: split(value)) {
+                config.orders.push_back(std::stoi(item));
+            }
+        }
+        else if (name == "--keys") {
+            config.keys = split(value);
+        }
+        else if (name == "--workloads") {
+            config.workloads = split(value);
+        }
+        else if (name == "--cache") {
+            config.caches = split(value);
+        }
+        else if (name == "--ops") {
+            config.ops = std::stoull(value);
+        }
+        else if (name == "--dirty-limit") {
+            config.dirty_limit = std::stoull(value);
+        }
+        else if (name == "--json") {
+            config.json = true;
+            config.json_file = value;
+        }
+        else {
+            throw std::logic_error("Unknown option " + arg);
+        }
+    }
+    return config;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Config config = parse(argc, argv);
+    std::vector<Result> results;
+    if (!config.json || !config.json_file.empty()) {
+        std::cout << std::setw(10) << "size" << std::setw(6) << "order" << std::setw(8) << "keys"
+                  << std::setw(10) << "workload" << std::setw(8) << "cache" << std::setw(12) << "ops/s"
+                  << std::setw(10) << "p50 ns" << std::setw(10) << "p99 ns"
+                  << std::setw(9) << "reads" << std::setw(9) << "writes" << std::endl;
+    }
+    for (uint64_t size: config.sizes) {
+        for (int order: config.orders) {
+            for (const std::string &keys: config.keys) {
+                for (const std::string &workload: config.workloads) {
+                    for (const std::string &cache: config.caches) {
+                        results.push_back(runCase(config, size, order, keys, workload, cache));
+                        if (!config.json || !config.json_file.empty())
+                            printRow(results.back());
+                    }
+                }
+            }
+        }
+    }
+    if (config.json) {
+        if (config.json_file.empty()) {
+            printJson(std::cout, results);
+        }
+        else {
+            std::ofstream out(config.json_file);
+            printJson(out, results);
+        }
+    }
+    unlink(FILENAME);
+    return 0;
+}
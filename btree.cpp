@@ -1,126 +1,560 @@
 #include "btree.h"
+#include <algorithm>
 #include <iostream>
+#include <memory>
 
-BTree::BTree(const std::string &filename, int order):
-    _filename(filename),
-    _order(order),
-    _height(0),
-    _size(0),
-    _vfs(filename, order) 
+#include <string.h>
+
+//Holds the tree writer lock in the mode an operation needs.
+template <typename Key>
+class BasicBTree<Key>::Guard {
+public:
+    enum Mode {
+        READ,           //no lock unless the storage writes in place
+        LEAF,           //shared between single leaf writers
+        STRUCTURE       //alone, releases the latched nodes on exit
+    };
+    Guard(const BasicBTree *tree, Mode mode):
+        _tree(const_cast<BasicBTree *>(tree)),
+        _exclusive(mode == STRUCTURE || (mode == LEAF && tree->_vfs->writesInPlace())),
+        _shared(!_exclusive && (mode == LEAF || tree->_vfs->writesInPlace())),
+        _mode(mode) {
+        if (_exclusive)
+            _tree->_writers.lock();
+        else if (_shared)
+            _tree->_writers.lock_shared();
+    }
+    ~Guard() {
+        if (_mode == STRUCTURE)
+            _tree->unlatchAll();
+        if (_exclusive)
+            _tree->_writers.unlock();
+        else if (_shared)
+            _tree->_writers.unlock_shared();
+    }
+private:
+    BasicBTree *_tree;
+    bool _exclusive;
+    bool _shared;
+    Mode _mode;
+};
+
+template <typename Key>
+BasicBTree<Key>::BasicBTree(const std::string &filename, int order, const BTreeOptions &options):
+    BasicBTree(std::unique_ptr<Storage>(new BasicBTreeFS<Key>(filename, order, options)))
 {
-    BTreeNode root = _vfs.allocNode(true);
-    _root_ref = root.ref();
-    _vfs.setRootRef(_root_ref);
-    _vfs.saveNode(root);
+    _filename = filename;
 }
 
-BTree::BTree(const std::string &filename):
-    _filename(filename),
-    _vfs(filename),
-    _root_ref(_vfs.rootRef())
+template <typename Key>
+BasicBTree<Key>::BasicBTree(const std::string &filename, const BTreeOptions &options):
+    BasicBTree(std::unique_ptr<Storage>(new BasicBTreeFS<Key>(filename, options)))
 {
-    _size = _vfs.treeSize();
-    _height = _vfs.treeHeight();
-    _order = _vfs.order();
-}
-
-void BTree::put(int key) {
-    BTreeNode root = _vfs.openNode(_root_ref);
-    insert(root, key);
-    _vfs.setTreeSize(++_size);
-
-    //split root if needs
-    if (root.isFull()) {
-        BTreeNode node = split(root);
-        BTreeNode new_root = _vfs.allocNode(false);
-        new_root.put(node);
-        new_root.setSentinel(root.ref());
-        _vfs.setTreeHeight(++_height);
-        _vfs.saveNode(new_root);
-        _root_ref = new_root.ref();
-        _vfs.setRootRef(_root_ref);
+    _filename = filename;
+}
+
+template <typename Key>
+BasicBTree<Key>::BasicBTree(std::unique_ptr<Storage> storage):
+    _vfs(std::move(storage)),
+    _root_ref(_vfs->rootRef()),
+    _latches(_vfs->pageSize()),
+    _bloom(_latches, _vfs->bloomBitsPerKey())
+{
+    //order 0 took the largest order of the page size
+    _order = _vfs->order();
+    _size = _vfs->treeSize();
+    _height = _vfs->treeHeight();
+    if (_root_ref == 0) {
+        Node root = _vfs->allocNode(true);
+        _root_ref = root.ref();
+        _vfs->setRootRef(_root_ref);
+        _vfs->saveNode(root);
+        _vfs->commit();
+    }
+}
+
+template <typename Key>
+void BasicBTree<Key>::put(Key key, uint64_t value) {
+    BTreeStats::Timer timer(_vfs->stats(), BTreeStats::PUT);
+    uint64_t lsn;
+    if (!putInLeaf(key, value, lsn)) {
+        Guard guard(this, Guard::STRUCTURE);
+        Node root = openForWrite(_root_ref);
+        insert(root, key, value);
+        ++_size;
+        _vfs->addTreeSize(1);
+
+        //split root if needs
+        if (root.isFull())
+            growRoot(split(root));
+        //logged before the latches go, so the log follows the latch order
+        lsn = _vfs->prepare();
+    }
+    //the log fsync is shared with concurrent writers
+    _vfs->commit(lsn);
+}
+
+template <typename Key>
+bool BasicBTree<Key>::putInLeaf(Key key, uint64_t value, uint64_t &lsn) {
+    Guard guard(this, Guard::LEAF);
+    while (true) {
+        uint64_t version;
+        NodeView leaf = findLeaf(key, version);
+        if (leaf.contains(key)) {
+            throw std::logic_error("Key already exists");
+        }
+        //the leaf would split
+        if (leaf.keysNum() >= leaf.order())
+            return false;
+        if (!_latches.tryLock(leaf.ref(), version))
+            continue;
+        try {
+            //before the key is in the leaf, so no probe misses it
+            _bloom.add(leaf.ref(), version, BTreeKey<Key>::hash(key));
+            Node node = _vfs->openNode(leaf.ref());
+            node.put(key, value);
+            //a packed leaf may outgrow its page first
+            if (node.isFull()) {
+                _latches.unlock(leaf.ref());
+                return false;
+            }
+            _vfs->saveNode(node);
+            ++_size;
+            _vfs->addTreeSize(1);
+            lsn = _vfs->prepare();
+        }
+        catch (...) {
+            _latches.unlock(leaf.ref());
+            throw;
+        }
+        _latches.unlock(leaf.ref());
+        return true;
     }
 }
 
-void BTree::insert(BTreeNode &node, int key) {
+template <typename Key>
+void BasicBTree<Key>::insert(Node &node, Key key, uint64_t value) {
+    //a full node is saved by the split its parent makes
     if (node.isLeaf()) {
-        node.put(key);
-        _vfs.saveNode(node);
+        node.put(key, value);
+        if (!node.isFull())
+            _vfs->saveNode(node);
     }
     else {
-        BTreeNode next = _vfs.openNode(node.next(key));
-        insert(next, key);
+        Node next = openForWrite(node.next(key));
+        insert(next, key, value);
         if (next.isFull()) {
-            BTreeNode new_node = split(next);
-            node.put(new_node);
-            _vfs.saveNode(node);
+            splitInto(node, next);
+            if (!node.isFull())
+                _vfs->saveNode(node);
         }
     }
 }
 
-BTreeNode BTree::split(BTreeNode &node) {
-    BTreeNode new_node = _vfs.allocNode(node.isLeaf());
-    std::map<int, uint64_t> keys = node.keys();
-    int keys_moved = 0;
-    for (auto it = keys.rbegin(); keys_moved != _order / 2; ++it, ++keys_moved) {
-        node.removeKey(it->first);
-        new_node.addChild(it->first, it->second);
-        new_node.setKeysNum(keys_moved + 1);
+template <typename Key>
+std::vector<BasicBTreeNode<Key> > BasicBTree<Key>::split(Node &node) {
+    std::vector<Node> splits;
+    if (!node.isFull()) {
+        _vfs->saveNode(node);
+        return splits;
+    }
+    //spread keys evenly, every part gets more than order / 2 keys
+    int total = node.keysNum();
+    int parts = (total + node.order() - 1) / node.order();
+    //a packed leaf takes more parts until each one fits its page
+    while (!partsFit(node, parts))
+        ++parts;
+    for (int part = parts - 1; part > 0; --part) {
+        splits.push_back(allocForWrite(node.isLeaf()));
+    }
+    uint64_t right = node.rightSibling();
+    for (int part = parts - 1; part > 0; --part) {
+        Node &new_node = splits[part - 1];
+        node.moveTail(new_node, partEnd(total, part + 1, parts) - partEnd(total, part, parts));
+        new_node.setRightSibling(right);
+        new_node.setLeftSibling(part > 1 ? splits[part - 2].ref() : node.ref());
+        right = new_node.ref();
+    }
+    if (node.rightSibling() != 0)
+        relinkLeft(node.rightSibling(), splits.back().ref());
+    node.setRightSibling(splits.front().ref());
+    _vfs->stats().add(BTreeStats::SPLITS, splits.size());
+    _vfs->saveNode(node);
+    for (const Node &new_node: splits) {
+        _vfs->saveNode(new_node);
+    }
+    return splits;
+}
+
+template <typename Key>
+void BasicBTree<Key>::splitInto(Node &parent, Node &node) {
+    for (const Node &new_node: split(node)) {
+        parent.put(new_node);
     }
-    _vfs.saveNode(node);
-    _vfs.saveNode(new_node);
-    return new_node;
 }
 
-void BTree::merge(BTreeNode &left, const BTreeNode &right) {
-    for (auto key: right.keys()) {
-        left.addChild(key.first, key.second);
+template <typename Key>
+int BasicBTree<Key>::partEnd(int total, int part, int parts) {
+    //64 bit products, a large batch overflows int
+    return (int64_t)total * part / parts;
+}
+
+template <typename Key>
+bool BasicBTree<Key>::partsFit(const Node &node, int parts) {
+    if (!node.isPacked())
+        return true;
+    int total = node.keysNum();
+    //any three entries fit a page, so this stops before parts get smaller
+    for (int part = 0; part < parts; ++part) {
+        int from = partEnd(total, part, parts);
+        int to = partEnd(total, part + 1, parts);
+        if (node.packedSize(from, to) > node.packedPageSize())
+            return false;
+    }
+    return true;
+}
+
+template <typename Key>
+void BasicBTree<Key>::growRoot(std::vector<Node> splits) {
+    //grow new roots until the top level fits in one node
+    while (!splits.empty()) {
+        Node new_root = allocForWrite(false);
+        new_root.setSentinel(_root_ref);
+        for (const Node &node: splits) {
+            new_root.put(node);
+        }
+        _vfs->setTreeHeight(++_height);
+        _vfs->stats().add(BTreeStats::HEIGHT_GROWS);
+        splits = split(new_root);
+        _root_ref = new_root.ref();
+        _vfs->setRootRef(_root_ref);
+    }
+}
+
+template <typename Key>
+void BasicBTree<Key>::merge(Node &left, const Node &right) {
+    for (int i = 0; i < right.keysNum(); ++i) {
+        left.addChild(right.key(i), right.child(i));
         left.setKeysNum(left.keysNum() + 1);
     }
+    //right node is dropped, unlink it from the level
+    left.setRightSibling(right.rightSibling());
+    if (right.rightSibling() != 0)
+        relinkLeft(right.rightSibling(), left.ref());
+    _vfs->freeNode(right.ref());
+    _vfs->stats().add(BTreeStats::MERGES);
 }
 
-bool BTree::contains(int key) const {
-    BTreeNode root = _vfs.openNode(_root_ref); 
-    return contains(root, key);
+template <typename Key>
+void BasicBTree<Key>::relinkLeft(uint64_t ref, uint64_t left) {
+    Node node = openForWrite(ref);
+    node.setLeftSibling(left);
+    _vfs->saveNode(node);
 }
 
-bool BTree::contains(const BTreeNode &node, int key) const {
-    if (node.isLeaf())
-        return node.contains(key);
+template <typename Key>
+bool BasicBTree<Key>::contains(Key key) const {
+    uint64_t value;
+    return get(key, value);
+}
 
-    return contains(_vfs.openNode(node.next(key)), key);
+template <typename Key>
+bool BasicBTree<Key>::get(Key key, uint64_t &value) const {
+    BTreeStats::Timer timer(_vfs->stats(), BTreeStats::GET);
+    Guard guard(this, Guard::READ);
+    NodeView leaf;
+    uint64_t version;
+    bool passed;
+    if (!lookupLeaf(key, leaf, version, passed))
+        return false;
+    int slot = leaf.lowerBound(key);
+    if (slot == leaf.keysNum() || leaf.key(slot) != key) {
+        if (passed)
+            _vfs->stats().add(BTreeStats::BLOOM_FALSE_POSITIVES);
+        return false;
+    }
+    value = leaf.child(slot);
+    return true;
+}
+
+template <typename Key>
+std::vector<typename BasicBTree<Key>::BatchKey> BasicBTree<Key>::sortBatch(const std::vector<Key> &keys) const {
+    std::vector<BatchKey> batch(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        batch[i].key = keys[i];
+        batch[i].idx = i;
+    }
+    std::sort(batch.begin(), batch.end(), [](const BatchKey &a, const BatchKey &b) {
+        return a.key < b.key || (a.key == b.key && a.idx < b.idx);
+    });
+    return batch;
+}
+
+template <typename Key>
+std::vector<bool> BasicBTree<Key>::containsMany(const std::vector<Key> &keys) const {
+    BTreeStats::Timer timer(_vfs->stats(), BTreeStats::BATCH);
+    return lookupMany(keys, nullptr);
 }
 
-void BTree::remove(int key) {
-    BTreeNode root = _vfs.openNode(_root_ref);
-    remove(root, key);
-    _vfs.setTreeSize(--_size);
+template <typename Key>
+std::vector<bool> BasicBTree<Key>::getMany(const std::vector<Key> &keys, std::vector<uint64_t> &values) const {
+    BTreeStats::Timer timer(_vfs->stats(), BTreeStats::BATCH);
+    values.assign(keys.size(), 0);
+    return lookupMany(keys, values.data());
+}
 
-    //root is empty
-    if (root.keysNum() == 0 && _size != 0) {
-        _root_ref = root.sentinel();
-        _vfs.setRootRef(_root_ref);
-        _vfs.setTreeSize(--_height);
+template <typename Key>
+std::vector<bool> BasicBTree<Key>::lookupMany(const std::vector<Key> &keys, uint64_t *values) const {
+    std::vector<bool> result(keys.size(), false);
+    if (keys.empty()) return result;
+    //lookups on the same path stay next to each other
+    std::vector<BatchKey> batch = sortBatch(keys);
+    struct Lookup {
+        const BatchKey *key;
+        uint64_t ref;               //0 until the lookup starts at the root
+        uint64_t parent;
+        uint64_t parent_version;
+        int level;                  //height of the page at ref
+        bool stale;                 //the leaf at ref has no current filter
+    };
+    std::vector<Lookup> lookups;
+    for (const BatchKey &key: batch) {
+        lookups.push_back(Lookup{&key, 0, 0, 0, 0, false});
     }
+    Guard guard(this, Guard::READ);
+    std::vector<uint64_t> refs;
+    std::vector<uint64_t> versions;
+    std::vector<bool> read;
+    while (!lookups.empty()) {
+        uint64_t root_ref = _root_ref;
+        int height = _height;
+        refs.clear();
+        for (Lookup &lookup: lookups) {
+            if (lookup.ref == 0) {
+                lookup.ref = root_ref;
+                lookup.parent = 0;
+                lookup.level = height;
+                lookup.stale = false;
+            }
+            refs.push_back(lookup.ref);
+        }
+        //every page of the level once
+        std::sort(refs.begin(), refs.end());
+        refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+        versions.resize(refs.size());
+        for (size_t i = 0; i < refs.size(); ++i) {
+            versions[i] = _latches.readLock(refs[i]);
+        }
+        std::vector<NodeView> nodes = _vfs->viewNodes(refs, read);
+        size_t kept = 0;
+        for (Lookup &lookup: lookups) {
+            size_t i = std::lower_bound(refs.begin(), refs.end(), lookup.ref) - refs.begin();
+            //the link to the page was still current when its version was taken
+            bool linked = lookup.parent != 0 ? _latches.validate(lookup.parent, lookup.parent_version) :
+                lookup.ref == _root_ref;
+            if (!linked || !_latches.validate(refs[i], versions[i])) {
+                //a change on the path restarts only this lookup
+                lookup.ref = 0;
+                lookups[kept++] = lookup;
+                continue;
+            }
+            if (!read[i]) {
+                throw std::logic_error("Could not read page");
+            }
+            const NodeView &node = nodes[i];
+            Key key = lookup.key->key;
+            if (node.isLeaf()) {
+                int slot = node.lowerBound(key);
+                if (slot < node.keysNum() && node.key(slot) == key) {
+                    result[lookup.key->idx] = true;
+                    if (values != nullptr)
+                        values[lookup.key->idx] = node.child(slot);
+                }
+                if (lookup.stale && _bloom.probe(node.ref(), BTreeKey<Key>::hash(key)) == BTreeBloom::STALE)
+                    _bloom.build(node, versions[i]);
+                continue;
+            }
+            uint64_t next = node.next(key);
+            if (lookup.level == 1 && _bloom.enabled()) {
+                BTreeBloom::Probe probe = _bloom.probe(next, BTreeKey<Key>::hash(key));
+                //the parent was validated above, again after the probe
+                if (probe == BTreeBloom::EXCLUDED && _latches.validate(refs[i], versions[i])) {
+                    _vfs->stats().add(BTreeStats::BLOOM_SKIPS);
+                    continue;
+                }
+                lookup.stale = probe == BTreeBloom::STALE;
+            }
+            lookup.parent = lookup.ref;
+            lookup.parent_version = versions[i];
+            lookup.ref = next;
+            --lookup.level;
+            lookups[kept++] = lookup;
+        }
+        lookups.resize(kept);
+    }
+    return result;
+}
+
+template <typename Key>
+std::vector<bool> BasicBTree<Key>::putMany(const std::vector<Key> &keys) {
+    return putMany(keys, std::vector<uint64_t>(keys.size(), 0));
+}
+
+template <typename Key>
+std::vector<bool> BasicBTree<Key>::putMany(const std::vector<Key> &keys, const std::vector<uint64_t> &values) {
+    if (keys.size() != values.size()) {
+        throw std::logic_error("Number of keys and values differ");
+    }
+    BTreeStats::Timer timer(_vfs->stats(), BTreeStats::BATCH);
+    std::vector<bool> result(keys.size(), false);
+    if (keys.empty()) return result;
+    std::vector<BatchKey> batch = sortBatch(keys);
+    //repeated keys of the batch are reported as present
+    batch.erase(std::unique(batch.begin(), batch.end(), [](const BatchKey &a, const BatchKey &b) {
+        return a.key == b.key;
+    }), batch.end());
+
+    uint64_t lsn;
+    {
+        Guard guard(this, Guard::STRUCTURE);
+        Node root = openForWrite(_root_ref);
+        std::vector<Node> splits = insertMany(root, batch.data(), batch.data() + batch.size(),
+                                                   values.data(), result);
+        int64_t inserted_num = 0;
+        for (bool inserted: result) {
+            inserted_num += inserted;
+        }
+        _size += inserted_num;
+        _vfs->addTreeSize(inserted_num);
+        growRoot(std::move(splits));
+        //the whole batch shares one log record
+        lsn = _vfs->prepare();
+    }
+    _vfs->commit(lsn);
+    return result;
+}
+
+template <typename Key>
+std::vector<BasicBTreeNode<Key> > BasicBTree<Key>::insertMany(Node &node, const BatchKey *begin, const BatchKey *end,
+                                         const uint64_t *values, std::vector<bool> &result) {
+    std::vector<Key> new_keys;
+    std::vector<uint64_t> new_children;
+    if (node.isLeaf()) {
+        for (const BatchKey *it = begin; it != end; ++it) {
+            if (!node.contains(it->key)) {
+                new_keys.push_back(it->key);
+                new_children.push_back(values[it->idx]);
+                result[it->idx] = true;
+            }
+        }
+    }
+    else {
+        while (begin != end) {
+            uint64_t child_ref = node.next(begin->key);
+            const BatchKey *group_end = begin + 1;
+            while (group_end != end && node.next(group_end->key) == child_ref)
+                ++group_end;
+            Node child = openForWrite(child_ref);
+            for (const Node &split_node: insertMany(child, begin, group_end, values, result)) {
+                new_keys.push_back(split_node.minKey());
+                new_children.push_back(split_node.ref());
+            }
+            begin = group_end;
+        }
+    }
+    if (new_keys.empty())
+        return std::vector<Node>();
+    node.addChildren(new_keys.data(), new_children.data(), new_keys.size());
+    return split(node);
+}
+
+template <typename Key>
+void BasicBTree<Key>::remove(Key key) {
+    BTreeStats::Timer timer(_vfs->stats(), BTreeStats::REMOVE);
+    uint64_t lsn;
+    if (!removeFromLeaf(key, lsn)) {
+        Guard guard(this, Guard::STRUCTURE);
+        Node root = openForWrite(_root_ref);
+        remove(root, key);
+        --_size;
+        _vfs->addTreeSize(-1);
+
+        //a packed root leaf may grow when its blocks shift
+        if (root.isFull()) {
+            growRoot(split(root));
+        }
+        //root is empty
+        else if (root.keysNum() == 0 && _size != 0) {
+            _root_ref = root.sentinel();
+            _vfs->setRootRef(_root_ref);
+            _vfs->setTreeHeight(--_height);
+            _vfs->stats().add(BTreeStats::HEIGHT_SHRINKS);
+            _vfs->freeNode(root.ref());
+        }
+        lsn = _vfs->prepare();
+    }
+    _vfs->commit(lsn);
 }
 
-void BTree::remove(BTreeNode &node, int key) {
+template <typename Key>
+bool BasicBTree<Key>::removeFromLeaf(Key key, uint64_t &lsn) {
+    Guard guard(this, Guard::LEAF);
+    while (true) {
+        uint64_t version;
+        NodeView leaf = findLeaf(key, version);
+        if (!leaf.contains(key)) {
+            throw std::logic_error("Invalid key");
+        }
+        //separators above hold the min key, a small leaf needs balancing
+        if (key == leaf.minKey() || (leaf.keysNum() <= leaf.order() / 2 && leaf.ref() != _root_ref))
+            return false;
+        if (!_latches.tryLock(leaf.ref(), version))
+            continue;
+        try {
+            _bloom.remove(leaf.ref(), version);
+            Node node = _vfs->openNode(leaf.ref());
+            node.removeKey(key);
+            //later blocks of a packed leaf shift and may pack worse
+            if (node.isFull()) {
+                _latches.unlock(leaf.ref());
+                return false;
+            }
+            _vfs->saveNode(node);
+            --_size;
+            _vfs->addTreeSize(-1);
+            lsn = _vfs->prepare();
+        }
+        catch (...) {
+            _latches.unlock(leaf.ref());
+            throw;
+        }
+        _latches.unlock(leaf.ref());
+        return true;
+    }
+}
+
+template <typename Key>
+void BasicBTree<Key>::remove(Node &node, Key key) {
     if (node.isLeaf()) {
-        //remove key from leaf
-        node.removeKey(key);        
-        _vfs.saveNode(node);
+        //remove key from leaf, a packed one may grow and is split by the parent
+        node.removeKey(key);
+        if (!node.isFull())
+            _vfs->saveNode(node);
     }
     else {
-        BTreeNode next = _vfs.openNode(node.next(key));
+        Node next = openForWrite(node.next(key));
         remove(next, key);
         //change key for next if we are removing min element
         if (node.contains(key)) {
             node.removeKey(key);
             node.put(next);
-            _vfs.saveNode(node);
+        }
+        if (next.isFull()) {
+            splitInto(node, next);
         }
         //now we need to balance children
-        if (next.keysNum() < _order / 2) {
+        else if (next.keysNum() < next.order() / 2) {
+            _vfs->stats().add(BTreeStats::REBALANCES);
             if (next.ref() == node.sentinel()) {
                 //balancing sentinel
                 balanceSentinel(node);
@@ -135,217 +569,648 @@ void BTree::remove(BTreeNode &node, int key) {
                 //right neighbour exists
             }
         }
+        if (!node.isFull())
+            _vfs->saveNode(node);
     }
 }
 
-void BTree::balanceSentinel(BTreeNode &node) {
-    BTreeNode sent = _vfs.openNode(node.sentinel());
-    BTreeNode merge_node = _vfs.openNode(node.keys().begin()->second);
+template <typename Key>
+void BasicBTree<Key>::balanceSentinel(Node &node) {
+    Node sent = openForWrite(node.sentinel());
+    Node merge_node = openForWrite(node.child(0));
     merge(sent, merge_node);
-    if (sent.isFull()) {
-        BTreeNode new_node = split(sent);
-        //node.setSentinel(new_sent.ref());
-        node.removeKey(merge_node.minKey());
-        node.put(new_node);
-        _vfs.saveNode(new_node);
-    }
-    else {
-        node.removeKey(merge_node.minKey());
-    }
-    _vfs.saveNode(node);
-    _vfs.saveNode(sent);
+    node.removeKey(merge_node.minKey());
+    splitInto(node, sent);
 }
 
-void BTree::balanceWithLeftNode(BTreeNode &node, BTreeNode &next) {
+template <typename Key>
+void BasicBTree<Key>::balanceWithLeftNode(Node &node, Node &next) {
     if (next.minKey() == node.minKey()) {
         //node on the left is sentinel
         balanceSentinel(node);
     }
     else {        
-        //BTreeNode left_node = _vfs.openNode((--node.keys().find(next.minKey()))->second);
-        BTreeNode left_node = _vfs.openNode(node.prevChild(next.minKey()));
+        Node left_node = openForWrite(node.prevChild(next.minKey()));
         merge(left_node, next);
-        if (left_node.isFull()) {
-            BTreeNode new_node = split(left_node);
-            node.removeKey(next.minKey());
-            node.put(new_node);
-            _vfs.saveNode(new_node);
-        }
-        else {
-            node.removeKey(next.minKey());
-        }
-        _vfs.saveNode(node);
-        _vfs.saveNode(left_node);
+        node.removeKey(next.minKey());
+        splitInto(node, left_node);
     }
 
 }
 
-void BTree::balanceWithRightNode(BTreeNode &node, BTreeNode &next) {
-    //BTreeNode right_node = _vfs.openNode((++node.keys().find(next.minKey()))->second);
-    BTreeNode right_node = _vfs.openNode(node.nextChild(next.minKey()));
+template <typename Key>
+void BasicBTree<Key>::balanceWithRightNode(Node &node, Node &next) {
+    Node right_node = openForWrite(node.nextChild(next.minKey()));
     merge(next, right_node);
-    if (next.isFull()) {
-        BTreeNode new_node = split(next);
-        node.removeKey(right_node.minKey());
-        node.put(new_node);
-        _vfs.saveNode(new_node);
-    }
-    else {
-        node.removeKey(right_node.minKey());
-    }
-    _vfs.saveNode(node);
-    _vfs.saveNode(next);
+    node.removeKey(right_node.minKey());
+    splitInto(node, next);
 }
 
-uint64_t BTree::size() const {
+template <typename Key>
+uint64_t BasicBTree<Key>::size() const {
     return _size;
 }
 
-int BTree::height() const {
+template <typename Key>
+int BasicBTree<Key>::height() const {
     return _height;
 }
 
-BTree::iterator BTree::begin() const {
-    if (_size == 0) return iterator(this, 0, true);
-    return iterator(this, minKey(), false);
+template <typename Key>
+int BasicBTree<Key>::order() const {
+    return _order;
 }
 
-BTree::iterator BTree::end() const {
-    return iterator(this, 0, true);
+template <typename Key>
+BasicBTreeSnapshot<Key> BasicBTree<Key>::snapshot() const {
+    //no operation is half done while writers are shut out
+    Guard guard(this, Guard::STRUCTURE);
+    return BasicBTreeSnapshot<Key>(_vfs.get(), _vfs->takeSnapshot(), _root_ref, _height, _size);
 }
 
-void BTree::print() const {
-    BTreeNode root = _vfs.openNode(_root_ref);
+template <typename Key>
+uint64_t BasicBTree<Key>::vacuum() {
+    Guard guard(this, Guard::STRUCTURE);
+    return _vfs->vacuum();
+}
+
+template <typename Key>
+BasicBTreeNode<Key> BasicBTree<Key>::openForWrite(uint64_t ref) {
+    latch(ref);
+    return _vfs->openNode(ref);
+}
+
+template <typename Key>
+BasicBTreeNode<Key> BasicBTree<Key>::allocForWrite(bool is_leaf) {
+    Node node = _vfs->allocNode(is_leaf);
+    //a reused page may still be reached through a stale link
+    latch(node.ref());
+    return node;
+}
+
+template <typename Key>
+void BasicBTree<Key>::latch(uint64_t ref) {
+    //balancing may open a node of the path a second time
+    if (std::find(_latched.begin(), _latched.end(), ref) != _latched.end())
+        return;
+    _latches.lock(ref);
+    _latched.push_back(ref);
+}
+
+template <typename Key>
+void BasicBTree<Key>::unlatchAll() {
+    for (uint64_t ref: _latched) {
+        _latches.unlock(ref);
+    }
+    _latched.clear();
+}
+
+template <typename Key>
+void BasicBTree<Key>::checkpoint() {
+    _vfs->checkpoint();
+}
+
+template <typename Key>
+uint64_t BasicBTree<Key>::cacheHits() const {
+    return _vfs->cacheHits();
+}
+
+template <typename Key>
+uint64_t BasicBTree<Key>::cacheMisses() const {
+    return _vfs->cacheMisses();
+}
+
+template <typename Key>
+uint64_t BasicBTree<Key>::logSyncs() const {
+    return _vfs->logSyncs();
+}
+
+template <typename Key>
+uint64_t BasicBTree<Key>::pagesRead() const {
+    return _vfs->pagesRead();
+}
+
+template <typename Key>
+uint64_t BasicBTree<Key>::pagesWritten() const {
+    return _vfs->pagesWritten();
+}
+
+template <typename Key>
+BTreeStats &BasicBTree<Key>::stats() const {
+    return _vfs->stats();
+}
+
+template <typename Key>
+typename BasicBTree<Key>::iterator BasicBTree<Key>::begin() const {
+    if (_size == 0) return iterator(this);
+    Guard guard(this, Guard::READ);
+    uint64_t version;
+    NodeView leaf = firstLeaf(version);
+    iterator it(this, std::move(leaf), version, 0);
+    it.skipForward();
+    return it;
+}
+
+template <typename Key>
+typename BasicBTree<Key>::iterator BasicBTree<Key>::end() const {
+    return iterator(this);
+}
+
+template <typename Key>
+typename BasicBTree<Key>::reverse_iterator BasicBTree<Key>::rbegin() const {
+    return reverse_iterator(end());
+}
+
+template <typename Key>
+typename BasicBTree<Key>::reverse_iterator BasicBTree<Key>::rend() const {
+    return reverse_iterator(begin());
+}
+
+template <typename Key>
+typename BasicBTree<Key>::iterator BasicBTree<Key>::lower_bound(Key key) const {
+    Guard guard(this, Guard::READ);
+    uint64_t version;
+    NodeView leaf = findLeaf(key, version);
+    int slot = leaf.lowerBound(key);
+    iterator it(this, std::move(leaf), version, slot);
+    it.skipForward();
+    return it;
+}
+
+template <typename Key>
+typename BasicBTree<Key>::iterator BasicBTree<Key>::upper_bound(Key key) const {
+    Guard guard(this, Guard::READ);
+    uint64_t version;
+    NodeView leaf = findLeaf(key, version);
+    int slot = leaf.upperBound(key);
+    iterator it(this, std::move(leaf), version, slot);
+    it.skipForward();
+    return it;
+}
+
+template <typename Key>
+void BasicBTree<Key>::scan(Key lo, Key hi, const ScanCallback &callback) const {
+    if (lo > hi) return;
+    BTreeStats::Timer timer(_vfs->stats(), BTreeStats::SCAN);
+    Guard guard(this, Guard::READ);
+    ReadAhead read_ahead(hi);
+    uint64_t version;
+    NodeView leaf = findLeaf(lo, version);
+    int from = leaf.lowerBound(lo);
+    while (true) {
+        int to = leaf.upperBound(hi);
+        if (from < to && !callback(leaf.keys() + from, to - from))
+            return;
+        if (to < leaf.keysNum() || leaf.rightSibling() == 0)
+            return;
+        NodeView next;
+        uint64_t next_version;
+        bool sequential = readNode(leaf.rightSibling(), leaf.ref(), version, next, next_version);
+        if (sequential) {
+            leaf = std::move(next);
+            version = next_version;
+            from = 0;
+        }
+        else {
+            //the leaf changed after it was passed on, go on after its last key
+            Key last = leaf.maxKey();
+            leaf = findLeaf(last, version);
+            from = leaf.upperBound(last);
+        }
+        read_ahead.advance(*this, leaf, sequential);
+    }
+}
+
+template <typename Key>
+size_t BasicBTree<Key>::scan(Key lo, Key hi, Key *out, size_t max) const {
+    size_t copied = 0;
+    if (max == 0) return 0;
+    scan(lo, hi, [&](const Key *keys, int n) {
+        size_t batch = std::min((size_t)n, max - copied);
+        memcpy(out + copied, keys, batch * sizeof(Key));
+        copied += batch;
+        return copied < max;
+    });
+    return copied;
+}
+
+template <typename Key>
+void BasicBTree<Key>::print() const {
+    NodeView root = _vfs->viewNode(_root_ref);
     print(root, 0);
 }
 
-void BTree::print(const BTreeNode &node, int level) const {
+template <typename Key>
+void BasicBTree<Key>::print(const NodeView &node, int level) const {
     std::cout << level << ": ";
-    for (auto key: node.keys()) {
-       std::cout << key.first << ",";
+    for (int i = 0; i < node.keysNum(); ++i) {
+       std::cout << node.key(i) << ",";
     }
     std::cout << std::endl;
+    //leaf children are values
+    if (node.isLeaf())
+        return;
     if (node.sentinel() != 0) {
-        BTreeNode sent = _vfs.openNode(node.sentinel());
+        NodeView sent = _vfs->viewNode(node.sentinel());
         print(sent, level + 1);
     }
-    for (auto key: node.keys()) {
-        if (key.second != 0) {
-            BTreeNode next = _vfs.openNode(key.second);
+    for (int i = 0; i < node.keysNum(); ++i) {
+        if (node.child(i) != 0) {
+            NodeView next = _vfs->viewNode(node.child(i));
             print(next, level + 1);
         }
     }
 }
 
-int BTree::findNext(int key) const {
-    BTreeNode root = _vfs.openNode(_root_ref);
-    return findNext(root, key);
+template <typename Key>
+bool BasicBTree<Key>::readNode(uint64_t ref, uint64_t parent, uint64_t parent_version,
+                     NodeView &node, uint64_t &version) const {
+    version = _latches.readLock(ref);
+    //the link to ref was still current when its version was taken
+    if (parent != 0 && !_latches.validate(parent, parent_version))
+        return false;
+    try {
+        NodeView view = _vfs->viewNode(ref);
+        if (!_latches.validate(ref, version))
+            return false;
+        node = std::move(view);
+        return true;
+    }
+    catch (const std::logic_error &) {
+        //a stale link may point to a freed or vacuumed page
+        if (parent != 0 ? !_latches.validate(parent, parent_version) : ref != _root_ref)
+            return false;
+        throw;
+    }
 }
 
-int BTree::findNext(const BTreeNode &node, int key) const {
-    if (node.isLeaf()) {
-        if (!node.contains(key) || key == node.maxKey()) {
-            return key;
+template <typename Key>
+template <typename Next>
+BasicBTreeNodeView<Key> BasicBTree<Key>::descend(Next next, uint64_t &version) const {
+    while (true) {
+        uint64_t ref = _root_ref;
+        NodeView node;
+        if (!readNode(ref, 0, 0, node, version) || ref != _root_ref)
+            continue;
+        bool valid = true;
+        while (valid && !node.isLeaf()) {
+            NodeView child;
+            uint64_t child_version;
+            valid = readNode(next(node), node.ref(), version, child, child_version);
+            if (valid) {
+                node = std::move(child);
+                version = child_version;
+            }
         }
-        auto it = node.keys().find(key);
-        return (++it)->first;
+        if (valid)
+            return node;
     }
-    else {
-        BTreeNode next = _vfs.openNode(node.next(key));
-        int found = findNext(next, key);
-        if (found != key) return found;
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTree<Key>::firstLeaf(uint64_t &version) const {
+    return descend([](const NodeView &node) {
+        return node.sentinel() != 0 ? node.sentinel() : node.child(0);
+    }, version);
+}
 
-        if (next.ref() == node.sentinel())
-            return node.minKey();
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTree<Key>::findLeaf(Key key, uint64_t &version) const {
+    return descend([key](const NodeView &node) {
+        return node.next(key);
+    }, version);
+}
 
-        auto it = node.keys().find(next.minKey());
-        if (it->first == node.maxKey()) return key;
-        return (++it)->first;    
+template <typename Key>
+bool BasicBTree<Key>::lookupLeaf(Key key, NodeView &leaf, uint64_t &version, bool &passed) const {
+    if (!_bloom.enabled()) {
+        passed = false;
+        leaf = findLeaf(key, version);
+        return true;
+    }
+    while (true) {
+        uint64_t ref = _root_ref;
+        int height = _height;
+        NodeView node;
+        if (!readNode(ref, 0, 0, node, version) || ref != _root_ref)
+            continue;
+        bool valid = true;
+        bool probed = false;
+        BTreeBloom::Probe probe = BTreeBloom::STALE;
+        //a height changed meanwhile only costs a probe of an inner node
+        for (int level = height; valid && !node.isLeaf(); --level) {
+            uint64_t next = node.next(key);
+            if (level == 1) {
+                probed = true;
+                probe = _bloom.probe(next, BTreeKey<Key>::hash(key));
+                //the filter was current while the link to the leaf was
+                if (probe == BTreeBloom::EXCLUDED) {
+                    if (!_latches.validate(node.ref(), version))
+                        break;
+                    _vfs->stats().add(BTreeStats::BLOOM_SKIPS);
+                    return false;
+                }
+            }
+            NodeView child;
+            uint64_t child_version;
+            valid = readNode(next, node.ref(), version, child, child_version);
+            if (valid) {
+                node = std::move(child);
+                version = child_version;
+            }
+        }
+        if (!valid || !node.isLeaf())
+            continue;
+        if (probed && probe == BTreeBloom::STALE)
+            _bloom.build(node, version);
+        passed = probed && probe == BTreeBloom::POSSIBLE;
+        leaf = std::move(node);
+        return true;
     }
 }
 
-int BTree::minKey() const {
-    if (_size == 0) {
-        throw std::logic_error("BTree is empty");
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTree<Key>::lastLeaf(uint64_t &version) const {
+    return descend([](const NodeView &node) {
+        return node.keysNum() > 0 ? node.child(node.keysNum() - 1) : node.sentinel();
+    }, version);
+}
+
+template <typename Key>
+std::vector<uint64_t> BasicBTree<Key>::leavesAfter(Key key, Key hi, size_t skip, size_t n) const {
+    std::vector<uint64_t> refs;
+    NodeView node;
+    while (true) {
+        int height = _height;
+        if (height == 0)
+            return refs;
+        uint64_t ref = _root_ref;
+        uint64_t version;
+        if (!readNode(ref, 0, 0, node, version) || ref != _root_ref)
+            continue;
+        //down to the parent of the leaf
+        bool valid = true;
+        for (int level = height; valid && level > 1 && !node.isLeaf(); --level) {
+            NodeView child;
+            uint64_t child_version;
+            valid = readNode(node.next(key), node.ref(), version, child, child_version);
+            if (valid) {
+                node = std::move(child);
+                version = child_version;
+            }
+        }
+        if (!valid)
+            continue;
+        if (node.isLeaf())
+            return refs;
+        break;
     }
-    BTreeNode root = _vfs.openNode(_root_ref);
-    return minKey(root);
+    //children right of the leaf, then those of the parents further right
+    int slot = node.upperBound(key);
+    while (refs.size() < n) {
+        for (; slot < node.keysNum() && refs.size() < n; ++slot) {
+            if (node.key(slot) > hi)
+                return refs;
+            if (skip > 0)
+                --skip;
+            else
+                refs.push_back(node.child(slot));
+        }
+        if (refs.size() == n || node.rightSibling() == 0)
+            break;
+        NodeView right;
+        uint64_t version;
+        if (!readNode(node.rightSibling(), 0, 0, right, version))
+            break;
+        node = std::move(right);
+        slot = 0;
+        //the sentinel is the first child
+        if (node.sentinel() != 0) {
+            if (skip > 0)
+                --skip;
+            else
+                refs.push_back(node.sentinel());
+        }
+    }
+    return refs;
 }
 
-int BTree::minKey(const BTreeNode &node) const {
-    if (node.isLeaf())
-        return node.minKey();
-    if (node.sentinel() != 0)
-        return minKey(_vfs.openNode(node.sentinel()));
-    uint64_t next = node.keys().begin()->second;
-    return minKey(_vfs.openNode(next));
+template <typename Key>
+const int BasicBTree<Key>::ReadAhead::TRIGGER_HOPS;
+template <typename Key>
+const size_t BasicBTree<Key>::ReadAhead::MIN_WINDOW;
+
+template <typename Key>
+BasicBTree<Key>::ReadAhead::ReadAhead(Key hi):
+    _hi(hi),
+    _hops(0),
+    _window(0),
+    _ahead(0),
+    _pages_read(0) { }
+
+template <typename Key>
+void BasicBTree<Key>::ReadAhead::advance(const BasicBTree &tree, const NodeView &leaf, bool sequential) {
+    size_t max_window = tree._vfs->readAhead();
+    //faults of a mapped tree are not counted, so it is taken as reading the file
+    uint64_t pages_read = tree._vfs->pagesRead();
+    bool missed = pages_read != _pages_read || tree._vfs->writesInPlace();
+    _pages_read = pages_read;
+    if (!sequential || max_window == 0) {
+        //the scan jumped, what was prefetched is not where it goes
+        _hops = 0;
+        _window = 0;
+        _ahead = 0;
+        return;
+    }
+    ++_hops;
+    if (_ahead > 0)
+        --_ahead;
+    if (_hops < TRIGGER_HOPS || (_window == 0 && !missed) || _ahead > _window / 2 ||
+        leaf.keysNum() == 0)
+        return;
+    _window = std::min(std::max(2 * _window, MIN_WINDOW), max_window);
+    std::vector<uint64_t> refs = tree.leavesAfter(leaf.minKey(), _hi, _ahead, _window - _ahead);
+    tree._vfs->prefetch(refs);
+    _ahead += refs.size();
+    //reads of the prefetch are not the scan's
+    _pages_read = tree._vfs->pagesRead();
 }
 
-bool BTree::checkValid() const {
+template <typename Key>
+bool BasicBTree<Key>::checkValid() const {
     if (_root_ref == 0)
         return _size == 0;
-    BTreeNode root = _vfs.openNode(_root_ref);
+    NodeView root = _vfs->viewNode(_root_ref);
     return checkValid(root, _height);
 }
 
-bool BTree::checkValid(const BTreeNode &node, int height) const {
-    if (_root_ref != node.ref() && node.keysNum() < _order / 2) return false;
+template <typename Key>
+bool BasicBTree<Key>::checkValid(const NodeView &node, int height) const {
+    //a packed leaf split by size may hold fewer keys, but never less than two
+    int min_keys = node.isPacked() ? 2 : node.order() / 2;
+    if (_root_ref != node.ref() && node.keysNum() < min_keys) return false;
     if (node.isFull()) return false;
     if (node.isLeaf()) {
         if (height != 0) return false;
     }
     else {
         if (node.sentinel() != 0) {
-            BTreeNode sent = _vfs.openNode(node.sentinel());
+            NodeView sent = _vfs->viewNode(node.sentinel());
             if (!checkValid(sent, height - 1)) return false;
             if (sent.maxKey() >= node.minKey()) return false;
         }
-        std::map<int, uint64_t> keys = node.keys();
-        for (auto it = keys.begin(); it != keys.end(); ++it) {
-            BTreeNode child = _vfs.openNode(it->second);
+        for (int i = 0; i < node.keysNum(); ++i) {
+            NodeView child = _vfs->viewNode(node.child(i));
             if (!checkValid(child, height - 1)) return false;
-            if (it->first != child.minKey()) return false;
-            auto it1 = it;
-            if (++it1 != keys.end()) {
-                if (child.maxKey() >= it1->first) return false;
+            if (node.key(i) != child.minKey()) return false;
+            if (i + 1 < node.keysNum()) {
+                if (child.maxKey() >= node.key(i + 1)) return false;
             }
         }
     }
     return true;
 }
 
-BTree::~BTree() { }
+template <typename Key>
+BasicBTree<Key>::~BasicBTree() { }
+
+template <typename Key>
+BasicBTree<Key>::iterator::iterator(const BasicBTree *tree):
+    _tree(tree),
+    _leaf(),
+    _version(0),
+    _slot(0) { }
 
-BTree::iterator::iterator(const BTree *tree, int key, bool is_end):
+template <typename Key>
+BasicBTree<Key>::iterator::iterator(const BasicBTree *tree, NodeView &&leaf, uint64_t version, int slot):
     _tree(tree),
-    _key(key),
-    _is_end(is_end) { }
+    _leaf(),
+    _version(0),
+    _slot(slot) {
+    setLeaf(std::move(leaf), version);
+}
+
+template <typename Key>
+void BasicBTree<Key>::iterator::setLeaf(NodeView &&leaf, uint64_t version) {
+    //a mapped or in-memory page changes in place under the iterator once the tree lock is gone
+    if (_tree->_vfs->writesInPlace())
+        leaf = _tree->_vfs->copyNode(leaf.ref());
+    _leaf = std::make_shared<NodeView>(std::move(leaf));
+    _version = version;
+}
+
+template <typename Key>
+void BasicBTree<Key>::iterator::skipForward() {
+    while (_slot == _leaf->keysNum()) {
+        if (_leaf->rightSibling() == 0) {
+            _leaf.reset();
+            return;
+        }
+        NodeView next;
+        uint64_t version;
+        bool sequential = _tree->readNode(_leaf->rightSibling(), _leaf->ref(), _version, next, version);
+        if (sequential) {
+            _slot = 0;
+        }
+        else {
+            //the leaf changed since it was read, go on after its last key
+            Key last = _leaf->maxKey();
+            next = _tree->findLeaf(last, version);
+            _slot = next.upperBound(last);
+        }
+        _read_ahead.advance(*_tree, next, sequential);
+        setLeaf(std::move(next), version);
+    }
+}
 
-BTree::iterator & BTree::iterator::operator++() {
-    if (_is_end) {
+template <typename Key>
+void BasicBTree<Key>::iterator::skipBackward() {
+    while (_slot < 0) {
+        if (_leaf->leftSibling() == 0) {
+            throw std::logic_error("Invalid iterator operation: decrement begin() iterator");
+        }
+        NodeView prev;
+        uint64_t version;
+        if (_tree->readNode(_leaf->leftSibling(), _leaf->ref(), _version, prev, version)) {
+            _slot = prev.keysNum() - 1;
+        }
+        else {
+            //the leaf changed since it was read, go on before its first key
+            Key first = _leaf->minKey();
+            prev = _tree->findLeaf(first, version);
+            _slot = prev.lowerBound(first) - 1;
+        }
+        setLeaf(std::move(prev), version);
+    }
+}
+
+template <typename Key>
+typename BasicBTree<Key>::iterator & BasicBTree<Key>::iterator::operator++() {
+    if (!_leaf) {
         throw std::logic_error("Invalid iterator operation: increment end() iterator");
     }
-    int found = _tree->findNext(_key);
-    if (found == _key) 
-        _is_end = true;
-    else 
-        _key = found;
+    Guard guard(_tree, Guard::READ);
+    ++_slot;
+    skipForward();
     return *this;
 }
 
-bool operator==(const BTree::iterator &a, const BTree::iterator &b) {
-    if (a._is_end == b._is_end) return true;
-    return a._key == b._key;
+template <typename Key>
+typename BasicBTree<Key>::iterator BasicBTree<Key>::iterator::operator++(int) {
+    iterator it = *this;
+    ++*this;
+    return it;
 }
 
-bool operator!=(const BTree::iterator &a, const BTree::iterator &b) {
-    return !(a == b);
+template <typename Key>
+typename BasicBTree<Key>::iterator & BasicBTree<Key>::iterator::operator--() {
+    Guard guard(_tree, Guard::READ);
+    if (!_leaf) {
+        if (_tree->_size == 0) {
+            throw std::logic_error("Invalid iterator operation: decrement begin() iterator");
+        }
+        uint64_t version;
+        NodeView leaf = _tree->lastLeaf(version);
+        setLeaf(std::move(leaf), version);
+        _slot = _leaf->keysNum();
+    }
+    --_slot;
+    skipBackward();
+    return *this;
+}
+
+template <typename Key>
+typename BasicBTree<Key>::iterator BasicBTree<Key>::iterator::operator--(int) {
+    iterator it = *this;
+    --*this;
+    return it;
+}
+
+template <typename Key>
+bool BasicBTree<Key>::iterator::operator==(const iterator &that) const {
+    if (!_leaf || !that._leaf) return !_leaf && !that._leaf;
+    return _leaf->ref() == that._leaf->ref() && _slot == that._slot;
+}
+
+template <typename Key>
+bool BasicBTree<Key>::iterator::operator!=(const iterator &that) const {
+    return !(*this == that);
+}
+
+template <typename Key>
+Key BasicBTree<Key>::iterator::operator*() const {
+    if (!_leaf) {
+        throw std::logic_error("Invalid iterator operation: dereferencing end() iterator");
+    }
+    return _leaf->key(_slot);
 }
 
-int BTree::iterator::operator*() const {
-    if (_is_end) {
+template <typename Key>
+uint64_t BasicBTree<Key>::iterator::value() const {
+    if (!_leaf) {
         throw std::logic_error("Invalid iterator operation: dereferencing end() iterator");
     }
-    return _key;
+    return _leaf->child(_slot);
 }
 
+BTREE_INSTANTIATE(BasicBTree);
@@ -1,59 +1,210 @@
 #pragma once
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <vector>
+#include "btree_bloom.h"
 #include "btree_fs.h"
+#include "btree_key.h"
+#include "btree_latch.h"
 #include "btree_node.h"
+#include "btree_snapshot.h"
+#include "btree_storage.h"
 
-class BTree {
+//Operations may run from many threads. Readers never take locks:
+//they copy pages and validate page versions, restarting on a change.
+//Writers that touch a single leaf only latch that leaf, structure
+//modifications (splits, merges, batches) run one at a time.
+//A tree whose storage writes pages in place (mapped file, memory)
+//serializes writers against readers instead.
+//Keys are of one of the types of BTreeKey; BTree keeps int keys.
+template <typename Key>
+class BasicBTree {
 public:
-    BTree(const std::string &filename, int order);
-    BTree(const std::string &filename);
-    void put(int key);
-    void remove(int key);
-    bool contains(int key) const;
+    typedef BasicBTreeNode<Key> Node;
+    typedef BasicBTreeNodeView<Key> NodeView;
+    typedef BasicBTreeStorage<Key> Storage;
+    //order 0 with options.page_size set takes the largest order that fits a page
+    BasicBTree(const std::string &filename, int order, const BTreeOptions &options = BTreeOptions());
+    explicit BasicBTree(const std::string &filename, const BTreeOptions &options = BTreeOptions());
+    //tree kept by any backend, an empty storage gets a root leaf
+    explicit BasicBTree(std::unique_ptr<Storage> storage);
+    //every key carries an 8 byte value stored in its leaf
+    void put(Key key, uint64_t value = 0);
+    void remove(Key key);
+    bool contains(Key key) const;
+    bool get(Key key, uint64_t &value) const;
+    //batch operations walk the tree once for all keys and
+    //return per-key results in input order
+    //true if the key was inserted, false if it was already present
+    std::vector<bool> putMany(const std::vector<Key> &keys);
+    std::vector<bool> putMany(const std::vector<Key> &keys, const std::vector<uint64_t> &values);
+    std::vector<bool> containsMany(const std::vector<Key> &keys) const;
+    //true if the key was found, values[i] gets the value of keys[i] or 0
+    std::vector<bool> getMany(const std::vector<Key> &keys, std::vector<uint64_t> &values) const;
     uint64_t size() const;
     int height() const;
+    int order() const;
+    //returns trailing free pages to the filesystem
+    uint64_t vacuum();
+    //moves logged operations into the tree file, no-op without a log
+    void checkpoint();
+    //consistent read-only view of the current tree, not supported by
+    //storage writing in place
+    BasicBTreeSnapshot<Key> snapshot() const;
+    uint64_t cacheHits() const;
+    uint64_t cacheMisses() const;
+    //log fsyncs issued so far, shared by concurrent writers with GROUP durability
+    uint64_t logSyncs() const;
+    //pages read from and written to the tree file so far
+    uint64_t pagesRead() const;
+    uint64_t pagesWritten() const;
+    //I/O, cache and structure counters and operation latencies,
+    //snapshot() and reset() them at any time
+    BTreeStats &stats() const;
     class iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
     iterator begin() const;
     iterator end() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    //first key not less / greater than key
+    iterator lower_bound(Key key) const;
+    iterator upper_bound(Key key) const;
+    //keys in [lo, hi] are passed leaf by leaf, return false to stop the scan
+    typedef std::function<bool (const Key *keys, int n)> ScanCallback;
+    void scan(Key lo, Key hi, const ScanCallback &callback) const;
+    //copies at most max keys in [lo, hi] to out, returns number of keys copied
+    size_t scan(Key lo, Key hi, Key *out, size_t max) const;
     //debug fucntions
     bool checkValid() const;
     void print() const;
-    ~BTree();
+    ~BasicBTree();
 private:
     friend class iterator;
-    void insert(BTreeNode &node, int key);
-    BTreeNode split(BTreeNode &);
-    void merge(BTreeNode &, const BTreeNode &);
-    void remove(BTreeNode &node, int key);
-    bool contains(const BTreeNode &node, int key) const;
-    int findNext(int key) const;
-    int findNext(const BTreeNode &node, int key) const;
-    int minKey() const;
-    int minKey(const BTreeNode &node) const;
-    void print(const BTreeNode &node, int level) const;
-    void balanceSentinel(BTreeNode &node);
-    void balanceWithLeftNode(BTreeNode &node, BTreeNode &right);
-    void balanceWithRightNode(BTreeNode &node, BTreeNode &next);
-    bool checkValid(const BTreeNode &node, int height) const;
+    class ReadAhead;
+    void insert(Node &node, Key key, uint64_t value);
+    //saves node, first moving keys to new right siblings if it is full
+    std::vector<Node> split(Node &node);
+    void splitInto(Node &parent, Node &node);
+    static int partEnd(int total, int part, int parts);
+    static bool partsFit(const Node &node, int parts);
+    void growRoot(std::vector<Node> splits);
+    struct BatchKey {
+        Key key;
+        size_t idx;
+    };
+    std::vector<BatchKey> sortBatch(const std::vector<Key> &keys) const;
+    std::vector<Node> insertMany(Node &node, const BatchKey *begin, const BatchKey *end,
+                                      const uint64_t *values, std::vector<bool> &result);
+    //lookups of a batch go down side by side, the pages of a level are
+    //read together so that a cold tree has many reads in flight
+    std::vector<bool> lookupMany(const std::vector<Key> &keys, uint64_t *values) const;
+    void merge(Node &, const Node &);
+    void relinkLeft(uint64_t ref, uint64_t left);
+    void remove(Node &node, Key key);
+    class Guard;
+    //optimistic read of the node at ref reached from parent at parent_version,
+    //false means the path changed and the caller has to restart
+    bool readNode(uint64_t ref, uint64_t parent, uint64_t parent_version,
+                  NodeView &node, uint64_t &version) const;
+    template <typename Next>
+    NodeView descend(Next next, uint64_t &version) const;
+    NodeView firstLeaf(uint64_t &version) const;
+    NodeView lastLeaf(uint64_t &version) const;
+    NodeView findLeaf(Key key, uint64_t &version) const;
+    //findLeaf asking the filter of the leaf before reading it, false if the
+    //filter rules key out; passed tells that a current filter let key through
+    bool lookupLeaf(Key key, NodeView &leaf, uint64_t &version, bool &passed) const;
+    //refs of up to n leaves right of the leaf holding key and not past hi, after
+    //skipping skip of them; only a hint, writers may change the leaves meanwhile
+    std::vector<uint64_t> leavesAfter(Key key, Key hi, size_t skip, size_t n) const;
+    //writers that stay within one leaf, false if the structure has to change
+    bool putInLeaf(Key key, uint64_t value, uint64_t &lsn);
+    bool removeFromLeaf(Key key, uint64_t &lsn);
+    //structure modifications latch every node they open or allocate
+    Node openForWrite(uint64_t ref);
+    Node allocForWrite(bool is_leaf);
+    void latch(uint64_t ref);
+    void unlatchAll();
+    void print(const NodeView &node, int level) const;
+    void balanceSentinel(Node &node);
+    void balanceWithLeftNode(Node &node, Node &right);
+    void balanceWithRightNode(Node &node, Node &next);
+    bool checkValid(const NodeView &node, int height) const;
     std::string _filename;
     int _order;
-    int _height;
-    uint64_t _size;    
-    BTreeFS _vfs;
-    uint64_t _root_ref;
+    std::atomic<int> _height;
+    std::atomic<uint64_t> _size;
+    std::unique_ptr<Storage> _vfs;
+    std::atomic<uint64_t> _root_ref;
+    mutable BTreeLatches _latches;
+    //leaf filters, lookups build them
+    mutable BTreeBloom _bloom;
+    mutable BTreeSharedMutex _writers;
+    //pages latched by the running structure modification
+    std::vector<uint64_t> _latched;
 };
 
-class BTree::iterator {
-    friend class BTree;
+//Follows a scan walking the leaf level to the right. Once a few hops in
+//a row went to the file, it prefetches the leaves ahead and doubles the
+//window each time the scan reaches the second half of what was prefetched.
+//Scans over cached leaves never start it.
+template <typename Key>
+class BasicBTree<Key>::ReadAhead {
+public:
+    //leaves past hi are not prefetched
+    explicit ReadAhead(Key hi = BTreeKey<Key>::max());
+    //the scan moved on to leaf, sequential if it came by the sibling link
+    void advance(const BasicBTree &tree, const NodeView &leaf, bool sequential);
 private:
-    iterator(const BTree *tree, int key, bool is_end);
+    static const int TRIGGER_HOPS = 2;
+    static const size_t MIN_WINDOW = 4;
+    Key _hi;
+    int _hops;
+    size_t _window;
+    size_t _ahead;          //prefetched leaves the scan has not reached yet
+    uint64_t _pages_read;   //file reads of the tree at the last hop
+};
+
+//Cursor over the leaf level: holds a copy of the current leaf and follows
+//sibling links, so a full scan reads every leaf exactly once.
+//If the leaf changed before the next hop, the cursor seeks again past the
+//last key it returned; keys keep increasing under concurrent writers.
+//Iterators of a tree writing in place hold a copy of their leaf as well.
+template <typename Key>
+class BasicBTree<Key>::iterator {
+    friend class BasicBTree;
+private:
+    explicit iterator(const BasicBTree *tree);
+    iterator(const BasicBTree *tree, NodeView &&leaf, uint64_t version, int slot);
 public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef Key value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Key *pointer;
+    typedef Key reference;
     iterator& operator++();
-    friend bool operator==(const iterator &, const iterator &);
-    friend bool operator!=(const iterator &, const iterator &);
-    int operator*() const;
+    iterator operator++(int);
+    iterator& operator--();
+    iterator operator--(int);
+    bool operator==(const iterator &that) const;
+    bool operator!=(const iterator &that) const;
+    Key operator*() const;
+    uint64_t value() const;
 private:
-    const BTree *_tree;
-    int _key;
-    bool _is_end;
+    void skipForward();
+    void skipBackward();
+    void setLeaf(NodeView &&leaf, uint64_t version);
+    const BasicBTree *_tree;
+    //shared so that copies (e.g. inside reverse_iterator) stay cheap
+    std::shared_ptr<const NodeView> _leaf;
+    uint64_t _version;
+    int _slot;
+    ReadAhead _read_ahead;
 };
+
+typedef BasicBTree<int> BTree;
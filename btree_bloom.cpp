@@ -0,0 +1,156 @@
+#include "btree_bloom.h"
+#include "btree_search.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BTREE_BLOOM_X86
+#endif
+
+namespace {
+
+const unsigned BLOCK_WORDS = BTreeBloom::BLOCK_BITS / 64;
+
+//odd multipliers picking the bit of each word, as in split block filters
+const uint32_t SALTS[BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+//high half of the hash picks the block, low half the bits
+const uint64_t *block(const uint64_t *words, uint32_t blocks, uint64_t hash) {
+    return words + ((hash >> 32) * blocks >> 32) * BLOCK_WORDS;
+}
+
+void insert(uint64_t *words, uint32_t blocks, uint64_t hash) {
+    uint64_t *target = const_cast<uint64_t *>(block(words, blocks, hash));
+    for (unsigned i = 0; i < BLOCK_WORDS; ++i) {
+        target[i] |= 1ULL << (((uint32_t)hash * SALTS[i]) >> 26);
+    }
+}
+
+bool containsScalar(const uint64_t *block, uint32_t hash) {
+    for (unsigned i = 0; i < BLOCK_WORDS; ++i) {
+        if (!(block[i] & (1ULL << ((hash * SALTS[i]) >> 26))))
+            return false;
+    }
+    return true;
+}
+
+#ifdef BTREE_BLOOM_X86
+__attribute__((target("avx2")))
+bool containsAvx2(const uint64_t *block, uint32_t hash) {
+    const __m256i salts = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(SALTS));
+    __m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(hash), salts), 26);
+    __m256i one = _mm256_set1_epi64x(1);
+    __m256i low = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(shifts)));
+    __m256i high = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(shifts, 1)));
+    //blocks are cache line aligned
+    __m256i first = _mm256_load_si256(reinterpret_cast<const __m256i *>(block));
+    __m256i second = _mm256_load_si256(reinterpret_cast<const __m256i *>(block + 4));
+    return _mm256_testc_si256(first, low) && _mm256_testc_si256(second, high);
+}
+#endif
+
+//probes follow the search mode
+bool contains(const uint64_t *block, uint32_t hash) {
+#ifdef BTREE_BLOOM_X86
+    if (BTreeSearch::mode() == BTreeSearch::AVX2)
+        return containsAvx2(block, hash);
+#endif
+    return containsScalar(block, hash);
+}
+
+}
+
+const unsigned BTreeBloom::BLOCK_BITS;
+const int BTreeBloom::STRIPE_BITS;
+
+BTreeBloom::BTreeBloom(const BTreeLatches &latches, unsigned bits_per_key):
+    _latches(latches),
+    _bits_per_key(bits_per_key),
+    _stripes(new Stripe[1 << STRIPE_BITS]) { }
+
+bool BTreeBloom::enabled() const {
+    return _bits_per_key != 0;
+}
+
+BTreeBloom::Stripe &BTreeBloom::stripe(uint64_t ref) const {
+    return _stripes[(ref * 0x9e3779b97f4a7c15ULL) >> (64 - STRIPE_BITS)];
+}
+
+BTreeBloom::Probe BTreeBloom::probe(uint64_t ref, uint64_t hash) const {
+    Stripe &s = stripe(ref);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.filters.find(ref);
+    if (it == s.filters.end() || !_latches.validate(ref, it->second.version))
+        return STALE;
+    const Filter &filter = it->second;
+    return contains(block(filter.words.get(), filter.blocks, hash), (uint32_t)hash) ? POSSIBLE : EXCLUDED;
+}
+
+template <typename Key>
+void BTreeBloom::build(const BasicBTreeNodeView<Key> &leaf, uint64_t version) {
+    Filter filter;
+    filter.version = version;
+    filter.capacity = std::max(leaf.order(), leaf.keysNum());
+    filter.blocks = std::max<uint64_t>(1, ((uint64_t)filter.capacity * _bits_per_key + BLOCK_BITS - 1) / BLOCK_BITS);
+    filter.removed = 0;
+    void *words;
+    size_t bytes = (size_t)filter.blocks * BLOCK_BITS / 8;
+    if (posix_memalign(&words, 64, bytes) != 0) {
+        throw std::logic_error("Could not allocate filter");
+    }
+    filter.words.reset(static_cast<uint64_t *>(words));
+    std::fill(filter.words.get(), filter.words.get() + bytes / 8, 0);
+    for (int i = 0; i < leaf.keysNum(); ++i) {
+        insert(filter.words.get(), filter.blocks, BTreeKey<Key>::hash(leaf.key(i)));
+    }
+    Stripe &s = stripe(leaf.ref());
+    std::lock_guard<std::mutex> lock(s.mutex);
+    //writers latch before they add, so a leaf still at version lacks no key
+    if (_latches.validate(leaf.ref(), version))
+        s.filters[leaf.ref()] = std::move(filter);
+}
+
+void BTreeBloom::add(uint64_t ref, uint64_t version, uint64_t hash) {
+    if (!enabled())
+        return;
+    Stripe &s = stripe(ref);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.filters.find(ref);
+    if (it == s.filters.end())
+        return;
+    Filter &filter = it->second;
+    if (filter.version != version) {
+        s.filters.erase(it);
+        return;
+    }
+    insert(filter.words.get(), filter.blocks, hash);
+    //current again once the writer unlatches, probes meanwhile see a mismatch
+    filter.version = version + 2;
+}
+
+void BTreeBloom::remove(uint64_t ref, uint64_t version) {
+    if (!enabled())
+        return;
+    Stripe &s = stripe(ref);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.filters.find(ref);
+    if (it == s.filters.end())
+        return;
+    Filter &filter = it->second;
+    //a filter still holding a removed key only passes it by mistake
+    if (filter.version != version || ++filter.removed * 4 > filter.capacity) {
+        s.filters.erase(it);
+        return;
+    }
+    filter.version = version + 2;
+}
+
+template void BTreeBloom::build(const BasicBTreeNodeView<int> &, uint64_t);
+template void BTreeBloom::build(const BasicBTreeNodeView<int64_t> &, uint64_t);
+template void BTreeBloom::build(const BasicBTreeNodeView<uint64_t> &, uint64_t);
+template void BTreeBloom::build(const BasicBTreeNodeView<BTreeId> &, uint64_t);
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <stdint.h>
+#include "btree_latch.h"
+#include "btree_node_view.h"
+
+//Blocked Bloom filters of leaves, kept in memory beside the tree and keyed
+//by leaf ref. A key picks one 64 byte block of its leaf's filter and sets
+//one bit in each of the block's 8 words, so a probe reads one cache line.
+//A filter is sized for a full leaf and answers only while the leaf latch is
+//at the version the filter was last brought to. Single leaf writers keep it
+//current, structure modifications bump the versions of the leaves they touch
+//and the next lookup that reads such a leaf builds its filter again.
+//Filters take the hash of BTreeKey, so one class serves every key type.
+class BTreeBloom {
+public:
+    enum Probe {
+        EXCLUDED,       //key is not in the leaf
+        POSSIBLE,       //the filter passed the key
+        STALE           //no filter for the leaf at its current version
+    };
+    BTreeBloom(const BTreeLatches &latches, unsigned bits_per_key);
+    bool enabled() const;
+    Probe probe(uint64_t ref, uint64_t hash) const;
+    //filter of a leaf read at version, dropped if the leaf changed since
+    template <typename Key>
+    void build(const BasicBTreeNodeView<Key> &leaf, uint64_t version);
+    //a writer holding the latch it took at version adds a key to the leaf
+    void add(uint64_t ref, uint64_t version, uint64_t hash);
+    //a writer holding the latch it took at version removes a key, the
+    //filter is built again once a quarter of its capacity went that way
+    void remove(uint64_t ref, uint64_t version);
+    static const unsigned BLOCK_BITS = 512;
+private:
+    struct Free {
+        void operator()(uint64_t *words) const { free(words); }
+    };
+    struct Filter {
+        uint64_t version;
+        uint32_t blocks;
+        uint32_t capacity;
+        uint32_t removed;
+        std::unique_ptr<uint64_t[], Free> words;
+    };
+    struct Stripe {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Filter> filters;
+    };
+    static const int STRIPE_BITS = 6;
+    Stripe &stripe(uint64_t ref) const;
+    const BTreeLatches &_latches;
+    unsigned _bits_per_key;
+    std::unique_ptr<Stripe[]> _stripes;
+};
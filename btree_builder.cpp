@@ -0,0 +1,216 @@
+#include "btree_builder.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+//every page is written once into a fresh file, logging it buys nothing
+BTreeOptions unlogged(const BTreeOptions &options) {
+    BTreeOptions result = options;
+    result.durability = BTreeOptions::NONE;
+    return result;
+}
+
+}
+
+template <typename Key>
+BasicBTreeBuilder<Key>::BasicBTreeBuilder(const std::string &filename, int order, double fill_factor,
+                                          const BTreeOptions &options):
+    _vfs(filename, order, unlogged(options)),
+    _order(_vfs.order()),
+    _fill_factor(fill_factor),
+    _levels(),
+    _size(0),
+    _last_key(),
+    _finished(false) {
+    if (fill_factor <= 0 || fill_factor > 1) {
+        throw std::logic_error("Fill factor must be in (0, 1]");
+    }
+}
+
+template <typename Key>
+int BasicBTreeBuilder<Key>::levelOrder(size_t level) const {
+    return level == 0 && _vfs.leafOrder() != 0 ? _vfs.leafOrder() : _order;
+}
+
+template <typename Key>
+size_t BasicBTreeBuilder<Key>::nodeKeys(size_t level) const {
+    int order = levelOrder(level);
+    int node_keys = (int)(_fill_factor * order + 0.5);
+    node_keys = std::max(node_keys, std::max(order / 2, 1));
+    return std::min(node_keys, order);
+}
+
+template <typename Key>
+bool BasicBTreeBuilder<Key>::fits(size_t level, size_t from, size_t to) const {
+    if (level != 0 || _vfs.leafOrder() == 0)
+        return true;
+    const std::vector<Entry> &entries = _levels[level].entries;
+    std::vector<Key> keys;
+    std::vector<uint64_t> values;
+    for (size_t i = from; i < to; ++i) {
+        keys.push_back(entries[i].key);
+        values.push_back(entries[i].child);
+    }
+    return Node::HEADER_SIZE + BTreeKey<Key>::packedSize(keys.data(), values.data(), keys.size()) <=
+        (size_t)_vfs.pageSize();
+}
+
+template <typename Key>
+void BasicBTreeBuilder<Key>::add(Key key, uint64_t value) {
+    if (_finished) {
+        throw std::logic_error("Tree is already built");
+    }
+    if (_size != 0 && key <= _last_key) {
+        throw std::logic_error("Keys must be added in increasing order");
+    }
+    add(0, key, value);
+    _last_key = key;
+    ++_size;
+}
+
+template <typename Key>
+void BasicBTreeBuilder<Key>::addFile(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::logic_error("Could not open " + filename);
+    }
+    std::vector<Key> chunk(1 << 16);
+    ssize_t bytes_read;
+    while ((bytes_read = read(fd, chunk.data(), chunk.size() * sizeof(Key))) > 0) {
+        if (bytes_read % sizeof(Key) != 0) {
+            close(fd);
+            throw std::logic_error("Truncated key in " + filename);
+        }
+        for (size_t i = 0; i < bytes_read / sizeof(Key); ++i) {
+            add(chunk[i]);
+        }
+    }
+    close(fd);
+    if (bytes_read == -1) {
+        throw std::logic_error("Could not read " + filename);
+    }
+}
+
+template <typename Key>
+void BasicBTreeBuilder<Key>::add(size_t level, Key key, uint64_t child) {
+    if (level == _levels.size()) {
+        _levels.push_back(Level());
+        _levels.back().sentinel = 0;
+        _levels.back().nodes = 0;
+    }
+    Level &lv = _levels[level];
+    //the leftmost child of an interior level is the sentinel of its first node
+    if (level > 0 && lv.nodes == 0 && lv.sentinel == 0) {
+        lv.sentinel = child;
+        return;
+    }
+    lv.entries.push_back(Entry{key, child});
+    //keep enough entries back so that the last node of the level can not underflow
+    if (lv.entries.size() > nodeKeys(level) + levelOrder(level) / 2) {
+        flush(level, nodeKeys(level));
+    }
+}
+
+template <typename Key>
+void BasicBTreeBuilder<Key>::flush(size_t level, size_t keys_num) {
+    //longest prefix that fits, any two entries always do
+    size_t lo = std::min(keys_num, (size_t)2);
+    while (lo < keys_num) {
+        size_t mid = (lo + keys_num + 1) / 2;
+        if (fits(level, 0, mid))
+            lo = mid;
+        else
+            keys_num = mid - 1;
+    }
+    Node node = _vfs.allocNode(level == 0);
+    {
+        Level &lv = _levels[level];
+        if (lv.nodes == 0)
+            node.setSentinel(lv.sentinel);
+        for (size_t i = 0; i < keys_num; ++i) {
+            node.addChild(lv.entries[i].key, lv.entries[i].child);
+        }
+        node.setKeysNum(keys_num);
+        lv.entries.erase(lv.entries.begin(), lv.entries.begin() + keys_num);
+        if (lv.pending) {
+            node.setLeftSibling(lv.pending->ref());
+            writePending(lv, node.ref());
+        }
+        lv.pending.reset(new Node(std::move(node)));
+        ++lv.nodes;
+    }
+    //may reallocate _levels, so no references are held across it
+    Node &pending = *_levels[level].pending;
+    add(level + 1, pending.keysNum() > 0 ? pending.minKey() : Key(), pending.ref());
+}
+
+template <typename Key>
+void BasicBTreeBuilder<Key>::writePending(Level &level, uint64_t right_sibling) {
+    level.pending->setRightSibling(right_sibling);
+    _vfs.saveNode(*level.pending);
+    //keeps the dirty table within its limit, consecutive pages coalesce
+    _vfs.commit();
+    level.pending.reset();
+}
+
+template <typename Key>
+void BasicBTreeBuilder<Key>::finish() {
+    if (_finished) return;
+    _finished = true;
+    if (_levels.empty()) {
+        //empty tree is a single empty leaf
+        Node root = _vfs.allocNode(true);
+        _vfs.saveNode(root);
+        _vfs.setRootRef(root.ref());
+        return;
+    }
+    for (size_t level = 0; ; ++level) {
+        size_t rest = _levels[level].entries.size();
+        //even parts, two halves of at least order / 2 keys unless packed
+        //leaves need more parts to fit their pages
+        size_t parts = std::max((rest + levelOrder(level) - 1) / levelOrder(level), (size_t)1);
+        while (true) {
+            bool fit = true;
+            for (size_t part = 0; part < parts && fit; ++part) {
+                fit = fits(level, rest * part / parts, rest * (part + 1) / parts);
+            }
+            if (fit) break;
+            ++parts;
+        }
+        for (size_t part = 0; part < parts; ++part) {
+            size_t keys_num = rest * (part + 1) / parts - rest * part / parts;
+            if (keys_num > 0 || _levels[level].nodes == 0) {
+                flush(level, keys_num);
+            }
+        }
+        Level &lv = _levels[level];
+        uint64_t last = lv.pending->ref();
+        writePending(lv, 0);
+        if (lv.nodes == 1) {
+            _vfs.setRootRef(last);
+            _vfs.setTreeHeight(level);
+            break;
+        }
+    }
+    _vfs.setTreeSize(_size);
+}
+
+template <typename Key>
+uint64_t BasicBTreeBuilder<Key>::size() const {
+    return _size;
+}
+
+template <typename Key>
+BasicBTreeBuilder<Key>::~BasicBTreeBuilder() {
+    try {
+        finish();
+    }
+    catch (const std::exception &e) { }
+}
+
+BTREE_INSTANTIATE(BasicBTreeBuilder);
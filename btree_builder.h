@@ -0,0 +1,50 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "btree_fs.h"
+#include "btree_key.h"
+
+//Builds a tree bottom-up from keys given in increasing order.
+//Nodes are packed to fill_factor * order keys and every page is written
+//exactly once. Bit-packed leaves also stop at the keys that fit their page. Open the result with BTree(filename) after finish().
+template <typename Key>
+class BasicBTreeBuilder {
+public:
+    typedef BasicBTreeNode<Key> Node;
+    BasicBTreeBuilder(const std::string &filename, int order, double fill_factor = 1.0,
+                 const BTreeOptions &options = BTreeOptions());
+    void add(Key key, uint64_t value = 0);
+    //adds keys from a file of native keys sorted in increasing order
+    void addFile(const std::string &filename);
+    void finish();
+    uint64_t size() const;
+    ~BasicBTreeBuilder();
+private:
+    struct Entry {
+        Key key;
+        uint64_t child;
+    };
+    struct Level {
+        std::vector<Entry> entries;
+        uint64_t sentinel;
+        std::unique_ptr<Node> pending;
+        uint64_t nodes;
+    };
+    void add(size_t level, Key key, uint64_t child);
+    void flush(size_t level, size_t keys_num);
+    int levelOrder(size_t level) const;
+    size_t nodeKeys(size_t level) const;
+    //whether entries [from, to) of a level fit one page
+    bool fits(size_t level, size_t from, size_t to) const;
+    void writePending(Level &level, uint64_t right_sibling);
+    BasicBTreeFS<Key> _vfs;
+    int _order;
+    double _fill_factor;
+    std::vector<Level> _levels;
+    uint64_t _size;
+    Key _last_key;
+    bool _finished;
+};
+
+typedef BasicBTreeBuilder<int> BTreeBuilder;
@@ -0,0 +1,522 @@
+#include "btree_check.h"
+#include "btree_fs.h"
+#include "btree_key.h"
+#include "btree_node_view.h"
+#include "btree_wal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+//what the walk needs of a page, so that no page is read twice
+struct PageInfo {
+    enum State {
+        UNREAD,
+        NODE,
+        FREE,
+        CORRUPT
+    };
+    PageInfo(): state(UNREAD), leaf(false), packed(false), order(0), keys_num(0),
+        min_key(0), max_key(0), left(0), right(0), next_free(0) { }
+    State state;
+    bool leaf;
+    bool packed;
+    int order;
+    int keys_num;
+    int min_key;
+    int max_key;
+    uint64_t left;
+    uint64_t right;
+    uint64_t next_free;
+    //inner nodes only, the sentinel comes first in children
+    std::vector<int> keys;
+    std::vector<uint64_t> children;
+};
+
+//node to check with the separator bounds its parent gives, lo <= key < hi
+struct Task {
+    uint64_t ref;
+    int height;
+    int64_t lo;
+    int64_t hi;
+    bool exact;         //the smallest key has to be lo
+    bool root;
+};
+
+//nodes of a walk by height, left to right
+struct Walk {
+    explicit Walk(int height): levels(height + 1), nodes(0), leaves(0), keys(0) { }
+    std::vector<std::vector<uint64_t> > levels;
+    uint64_t nodes;
+    uint64_t leaves;
+    uint64_t keys;
+};
+
+class Checker {
+public:
+    Checker(const BTreeFS::Header &header, BTreeCheck::Report &report);
+    void pageError(const std::string &message);
+    void headerError(const std::string &message);
+    void leakError(const std::string &message);
+    uint64_t pageErrors() const;
+    //reads pages [from, to) in runs of READ_PAGES
+    void readPages(int fd, uint64_t from, uint64_t to);
+    uint64_t findRoot();
+    int depth(uint64_t ref) const;
+    void walkTree(uint64_t root, int height, unsigned threads);
+    void checkFreeList();
+private:
+    void error(const std::string &message);
+    bool isNode(uint64_t ref) const;
+    bool refIsValid(uint64_t ref) const;
+    uint64_t index(uint64_t ref) const;
+    uint64_t ref(uint64_t index) const;
+    void parsePage(const uint8_t *page, uint64_t ref, PageInfo &info);
+    void checkNode(const Task &task, Walk &walk, std::vector<Task> &children);
+    void walk(const Task &task, Walk &walk);
+    void checkSiblings(const std::vector<uint64_t> &level, int height);
+    BTreeFS::Header _header;
+    BTreeCheck::Report &_report;
+    std::mutex _report_mutex;
+    std::atomic<uint64_t> _page_errors;
+    std::vector<PageInfo> _pages;
+    std::unique_ptr<std::atomic<bool>[]> _reached;
+    std::vector<bool> _free;
+};
+
+Checker::Checker(const BTreeFS::Header &header, BTreeCheck::Report &report):
+    _header(header),
+    _report(report),
+    _page_errors(0),
+    _pages(header.pages_allocated),
+    _reached(new std::atomic<bool>[header.pages_allocated]),
+    _free(header.pages_allocated, false) {
+    for (uint64_t i = 0; i < header.pages_allocated; ++i) {
+        _reached[i] = false;
+    }
+}
+
+void Checker::error(const std::string &message) {
+    std::lock_guard<std::mutex> lock(_report_mutex);
+    if (_report.errors.size() < BTreeCheck::MAX_ERRORS)
+        _report.errors.push_back(message);
+    ++_report.errors_num;
+}
+
+void Checker::pageError(const std::string &message) {
+    ++_page_errors;
+    error(message);
+}
+
+void Checker::headerError(const std::string &message) {
+    {
+        std::lock_guard<std::mutex> lock(_report_mutex);
+        ++_report.header_errors;
+    }
+    error(message);
+}
+
+void Checker::leakError(const std::string &message) {
+    error(message);
+}
+
+uint64_t Checker::pageErrors() const {
+    return _page_errors;
+}
+
+bool Checker::refIsValid(uint64_t ref) const {
+    if (ref < _header.first_page) return false;
+    if (ref >= _header.first_page + _header.pages_allocated * _header.page_size) return false;
+    return (ref - _header.first_page) % _header.page_size == 0;
+}
+
+bool Checker::isNode(uint64_t ref) const {
+    return refIsValid(ref) && _pages[index(ref)].state == PageInfo::NODE;
+}
+
+uint64_t Checker::index(uint64_t ref) const {
+    return (ref - _header.first_page) / _header.page_size;
+}
+
+uint64_t Checker::ref(uint64_t index) const {
+    return _header.first_page + index * _header.page_size;
+}
+
+void Checker::readPages(int fd, uint64_t from, uint64_t to) {
+    std::vector<uint8_t> run(BTreeCheck::READ_PAGES * _header.page_size);
+    for (uint64_t first = from; first < to; first += BTreeCheck::READ_PAGES) {
+        uint64_t n = std::min<uint64_t>(BTreeCheck::READ_PAGES, to - first);
+        ssize_t length = n * _header.page_size;
+        if (pread(fd, run.data(), length, ref(first)) != length) {
+            for (uint64_t i = first; i < first + n; ++i) {
+                _pages[i].state = PageInfo::CORRUPT;
+            }
+            pageError("Pages from " + std::to_string(ref(first)) + " could not be read");
+            continue;
+        }
+        for (uint64_t i = 0; i < n; ++i) {
+            parsePage(run.data() + i * _header.page_size, ref(first + i), _pages[first + i]);
+        }
+    }
+}
+
+void Checker::parsePage(const uint8_t *page, uint64_t ref, PageInfo &info) {
+    //a free page keeps the mark in place of the order and the link in place of the ref
+    int mark;
+    memcpy(&mark, page, sizeof(mark));
+    if (mark == BTreeFS::FREE_PAGE_MARK) {
+        info.state = PageInfo::FREE;
+        memcpy(&info.next_free, page + sizeof(uint64_t), sizeof(info.next_free));
+        return;
+    }
+    info.state = PageInfo::CORRUPT;
+    std::string name = "Page " + std::to_string(ref);
+    BTreeNodeView node;
+    try {
+        node = BTreeNodeView(page, _header.page_size);
+    }
+    catch (const std::logic_error &) {
+        pageError(name + " can not be parsed");
+        return;
+    }
+    if (node.ref() != ref) {
+        pageError(name + " holds the node of " + std::to_string(node.ref()));
+        return;
+    }
+    if (node.isFull()) {
+        pageError(name + " holds more keys than its order");
+        return;
+    }
+    int order = node.isPacked() ? _header.leaf_order : _header.order;
+    if (node.order() != order) {
+        pageError(name + " has order " + std::to_string(node.order()) + " instead of " + std::to_string(order));
+        return;
+    }
+    for (int i = 1; i < node.keysNum(); ++i) {
+        if (node.key(i - 1) >= node.key(i)) {
+            pageError(name + " has keys out of order");
+            return;
+        }
+    }
+    info.state = PageInfo::NODE;
+    info.leaf = node.isLeaf();
+    info.packed = node.isPacked();
+    info.order = node.order();
+    info.keys_num = node.keysNum();
+    if (info.keys_num > 0) {
+        info.min_key = node.minKey();
+        info.max_key = node.maxKey();
+    }
+    info.left = node.leftSibling();
+    info.right = node.rightSibling();
+    if (info.leaf)
+        return;
+    info.keys.assign(node.keys(), node.keys() + node.keysNum());
+    info.children.push_back(node.sentinel());
+    for (int i = 0; i < node.keysNum(); ++i) {
+        info.children.push_back(node.child(i));
+    }
+}
+
+int Checker::depth(uint64_t ref) const {
+    //a path longer than any tree can have runs in a cycle
+    for (int height = 0; height < 64; ++height) {
+        if (!isNode(ref))
+            return -1;
+        const PageInfo &info = _pages[index(ref)];
+        if (info.leaf)
+            return height;
+        ref = info.children[0] != 0 || info.children.size() == 1 ? info.children[0] : info.children[1];
+    }
+    return -1;
+}
+
+uint64_t Checker::findRoot() {
+    //the root is the node no other node points to with the deepest subtree
+    std::vector<bool> referenced(_pages.size(), false);
+    for (const PageInfo &info: _pages) {
+        for (uint64_t child: info.children) {
+            if (refIsValid(child))
+                referenced[index(child)] = true;
+        }
+    }
+    uint64_t root = 0;
+    int best = -1;
+    for (uint64_t i = 0; i < _pages.size(); ++i) {
+        if (_pages[i].state != PageInfo::NODE || referenced[i])
+            continue;
+        int height = depth(ref(i));
+        if (height > best) {
+            best = height;
+            root = ref(i);
+        }
+    }
+    return root;
+}
+
+void Checker::checkNode(const Task &task, Walk &walk, std::vector<Task> &children) {
+    std::string name = "Page " + std::to_string(task.ref);
+    if (!refIsValid(task.ref)) {
+        pageError(name + " is not a page of the file");
+        return;
+    }
+    uint64_t idx = index(task.ref);
+    if (_reached[idx].exchange(true)) {
+        pageError(name + " is reached twice");
+        return;
+    }
+    const PageInfo &info = _pages[idx];
+    if (info.state == PageInfo::FREE) {
+        pageError(name + " is free but linked from the tree");
+        return;
+    }
+    //broken pages were reported while reading
+    if (info.state != PageInfo::NODE)
+        return;
+    ++walk.nodes;
+    walk.levels[task.height].push_back(task.ref);
+    if (info.leaf != (task.height == 0)) {
+        pageError(name + (info.leaf ? " is a leaf" : " is an inner node") +
+                  " at height " + std::to_string(task.height));
+        return;
+    }
+    //a packed leaf split by size may hold fewer keys, but never less than two
+    int min_keys = info.packed ? 2 : info.order / 2;
+    if (!task.root && info.keys_num < min_keys) {
+        pageError(name + " holds " + std::to_string(info.keys_num) + " keys, fewer than " +
+                  std::to_string(min_keys));
+    }
+    if (info.keys_num > 0) {
+        if (info.min_key < task.lo || info.max_key >= task.hi)
+            pageError(name + " has keys outside the separators of its parent");
+        else if (task.exact && info.min_key != task.lo)
+            pageError(name + " starts with a key other than its separator");
+    }
+    if (info.leaf) {
+        ++walk.leaves;
+        walk.keys += info.keys_num;
+        return;
+    }
+    int n = info.keys_num;
+    if (info.children[0] != 0) {
+        Task sentinel = { info.children[0], task.height - 1, task.lo, n > 0 ? info.keys[0] : task.hi, false, false };
+        children.push_back(sentinel);
+    }
+    for (int i = 0; i < n; ++i) {
+        Task child = { info.children[i + 1], task.height - 1, info.keys[i],
+                       i + 1 < n ? info.keys[i + 1] : task.hi, true, false };
+        children.push_back(child);
+    }
+}
+
+void Checker::walk(const Task &task, Walk &walk) {
+    std::vector<Task> children;
+    checkNode(task, walk, children);
+    for (const Task &child: children) {
+        this->walk(child, walk);
+    }
+}
+
+void Checker::walkTree(uint64_t root, int height, unsigned threads) {
+    //the top levels are checked here until there are enough subtrees to share
+    Walk top(height);
+    Task root_task = { root, height, INT64_MIN, INT64_MAX, false, true };
+    std::vector<Task> frontier(1, root_task);
+    while (!frontier.empty() && frontier.size() < 4 * threads && frontier.front().height > 0) {
+        std::vector<Task> next;
+        for (const Task &task: frontier) {
+            checkNode(task, top, next);
+        }
+        frontier.swap(next);
+    }
+    std::vector<std::unique_ptr<Walk> > walks;
+    for (size_t i = 0; i < frontier.size(); ++i) {
+        walks.push_back(std::unique_ptr<Walk>(new Walk(height)));
+    }
+    std::atomic<size_t> next_task(0);
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < std::min<size_t>(threads, frontier.size()); ++t) {
+        pool.push_back(std::thread([this, &frontier, &walks, &next_task]() {
+            for (size_t i = next_task++; i < frontier.size(); i = next_task++) {
+                walk(frontier[i], *walks[i]);
+            }
+        }));
+    }
+    for (std::thread &thread: pool) {
+        thread.join();
+    }
+    //subtrees are in key order, so their levels line up left to right
+    for (const std::unique_ptr<Walk> &walk: walks) {
+        top.nodes += walk->nodes;
+        top.leaves += walk->leaves;
+        top.keys += walk->keys;
+        for (int h = 0; h <= height; ++h) {
+            top.levels[h].insert(top.levels[h].end(), walk->levels[h].begin(), walk->levels[h].end());
+        }
+    }
+    for (int h = 0; h <= height; ++h) {
+        checkSiblings(top.levels[h], h);
+    }
+    _report.nodes = top.nodes;
+    _report.leaves = top.leaves;
+    _report.keys = top.keys;
+}
+
+void Checker::checkSiblings(const std::vector<uint64_t> &level, int height) {
+    for (size_t i = 0; i < level.size(); ++i) {
+        const PageInfo &info = _pages[index(level[i])];
+        uint64_t left = i > 0 ? level[i - 1] : 0;
+        uint64_t right = i + 1 < level.size() ? level[i + 1] : 0;
+        if (info.left != left || info.right != right) {
+            pageError("Page " + std::to_string(level[i]) + " has wrong sibling links at height " +
+                      std::to_string(height));
+        }
+    }
+}
+
+void Checker::checkFreeList() {
+    uint64_t free_pages = 0;
+    for (uint64_t ref = _header.free_head; ref != 0; ref = _pages[index(ref)].next_free) {
+        if (!refIsValid(ref) || _pages[index(ref)].state != PageInfo::FREE) {
+            pageError("Free list links page " + std::to_string(ref) + ", which is not free");
+            break;
+        }
+        if (_free[index(ref)]) {
+            pageError("Free list runs in a cycle at page " + std::to_string(ref));
+            break;
+        }
+        _free[index(ref)] = true;
+        ++free_pages;
+    }
+    _report.free_pages = free_pages;
+    if (free_pages != _header.free_pages) {
+        headerError("Header counts " + std::to_string(_header.free_pages) + " free pages, the list holds " +
+                    std::to_string(free_pages));
+    }
+    for (uint64_t i = 0; i < _pages.size(); ++i) {
+        if (!_reached[i] && !_free[i])
+            ++_report.leaked_pages;
+    }
+    if (_report.leaked_pages > 0) {
+        leakError(std::to_string(_report.leaked_pages) + " pages are neither reachable nor free");
+    }
+}
+
+}
+
+const size_t BTreeCheck::MAX_ERRORS;
+const size_t BTreeCheck::READ_PAGES;
+
+BTreeCheck::Report::Report():
+    errors_num(0),
+    header_errors(0),
+    pages(0),
+    nodes(0),
+    leaves(0),
+    keys(0),
+    height(-1),
+    root_ref(0),
+    free_pages(0),
+    leaked_pages(0),
+    repaired(false) { }
+
+bool BTreeCheck::Report::ok() const {
+    return errors_num == 0;
+}
+
+BTreeCheck::Report BTreeCheck::run(const std::string &filename, unsigned threads, bool repair) {
+    Report report;
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    //pages of the log are newer than the file
+    struct stat st;
+    bool has_log = stat(BTreeWal::logName(filename).c_str(), &st) == 0 && st.st_size > 0;
+    if (has_log) {
+        report.errors.push_back("Tree has a log to recover, open it writable first");
+        ++report.errors_num;
+    }
+    int fd = open(filename.c_str(), repair ? O_RDWR : O_RDONLY);
+    if (fd == -1) {
+        throw std::logic_error("Could not open " + filename);
+    }
+    std::vector<uint8_t> raw(BTreeFS::headerLength());
+    if (fstat(fd, &st) == -1 || pread(fd, raw.data(), raw.size(), 0) != (ssize_t)raw.size()) {
+        close(fd);
+        throw std::logic_error("Error during FS settings read");
+    }
+    BTreeFS::Header header = BTreeFS::parseHeader(raw.data());
+    if (!BTreeFS::headerIsValid(header) ||
+        header.first_page + header.pages_allocated * header.page_size > (uint64_t)st.st_size) {
+        close(fd);
+        report.errors.push_back("Header does not describe the file");
+        ++report.errors_num;
+        return report;
+    }
+    if (header.key_type != BTreeKey<int>::TYPE) {
+        close(fd);
+        report.errors.push_back("Tree has keys of another type, only int keys are checked");
+        ++report.errors_num;
+        return report;
+    }
+    report.pages = header.pages_allocated;
+    Checker checker(header, report);
+    //every thread reads its own run of the file in order
+    std::vector<std::thread> readers;
+    unsigned readers_num = std::min<uint64_t>(threads, std::max<uint64_t>(header.pages_allocated, 1));
+    for (unsigned t = 0; t < readers_num; ++t) {
+        uint64_t from = header.pages_allocated * t / readers_num;
+        uint64_t to = header.pages_allocated * (t + 1) / readers_num;
+        readers.push_back(std::thread(&Checker::readPages, &checker, fd, from, to));
+    }
+    for (std::thread &reader: readers) {
+        reader.join();
+    }
+    uint64_t root = header.root_ref;
+    int height = checker.depth(root);
+    if (height < 0) {
+        checker.headerError("Root " + std::to_string(root) + " is not a node of a tree");
+        root = checker.findRoot();
+        height = checker.depth(root);
+    }
+    if (height >= 0) {
+        report.root_ref = root;
+        report.height = height;
+        if (height != header.tree_height) {
+            checker.headerError("Header has height " + std::to_string(header.tree_height) + ", the tree " +
+                                std::to_string(height));
+        }
+        checker.walkTree(root, height, threads);
+        if (report.keys != header.tree_size) {
+            checker.headerError("Header counts " + std::to_string(header.tree_size) + " keys, the leaves hold " +
+                                std::to_string(report.keys));
+        }
+    }
+    else {
+        checker.pageError("No node can be the root");
+    }
+    checker.checkFreeList();
+    if (repair && report.header_errors > 0 && checker.pageErrors() == 0 && !has_log) {
+        header.root_ref = report.root_ref;
+        header.tree_height = report.height;
+        header.tree_size = report.keys;
+        header.free_pages = report.free_pages;
+        BTreeFS::formatHeader(header, raw.data());
+        if (pwrite(fd, raw.data(), raw.size(), 0) != (ssize_t)raw.size() || fdatasync(fd) == -1) {
+            close(fd);
+            throw std::logic_error("Error during FS settings write");
+        }
+        report.repaired = true;
+    }
+    close(fd);
+    return report;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//Integrity check of a closed tree file. A pool of threads reads the file
+//once, each thread a contiguous run of pages in file order, and keeps a
+//summary of every page. The structure is then walked from the root over
+//the summaries, one subtree per task. Checks key order, fill, separator
+//bounds, height, sibling links and the free list, and counts pages that
+//are neither reachable nor free.
+class BTreeCheck {
+public:
+    struct Report {
+        Report();
+        //no errors of any kind
+        bool ok() const;
+        std::vector<std::string> errors;    //the first MAX_ERRORS found
+        uint64_t errors_num;
+        uint64_t header_errors;     //header fields that disagree with the pages
+        uint64_t pages;             //pages allocated
+        uint64_t nodes;             //nodes reachable from the root
+        uint64_t leaves;
+        uint64_t keys;              //keys in the reachable leaves
+        int height;                 //height of the tree found, -1 without a usable root
+        uint64_t root_ref;          //root found, may differ from the header
+        uint64_t free_pages;        //pages on the free list
+        uint64_t leaked_pages;      //neither reachable nor free
+        bool repaired;              //header was rewritten
+    };
+    //threads 0 takes one per core; repair rewrites root, height, size and
+    //free count of the header from the pages when no page has an error
+    static Report run(const std::string &filename, unsigned threads = 0, bool repair = false);
+    static const size_t MAX_ERRORS = 100;
+    //pages one read takes
+    static const size_t READ_PAGES = 256;
+};
@@ -2,185 +2,1324 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <string.h>
 
+#include <algorithm>
+#include <memory>
+#include <new>
 #include <stdexcept>
 #include <iostream>
 
+namespace {
 
-BTreeFS::BTreeFS(const std::string &filename):
-    _filename(filename) {
+typedef std::unique_ptr<uint8_t, void (*)(void *)> AlignedPtr;
+
+const size_t IO_ALIGNMENT = 4096;
+//madvise takes addresses at memory page boundaries
+const uint64_t MMAP_ALIGNMENT = 4096;
+
+AlignedPtr alignedAlloc(size_t length) {
+    void *data = nullptr;
+    if (posix_memalign(&data, IO_ALIGNMENT, length) != 0)
+        throw std::bad_alloc();
+    return AlignedPtr(static_cast<uint8_t *>(data), free);
+}
+
+}
+
+template <typename Key>
+const uint32_t BasicBTreeFS<Key>::MAX_PAGE_SIZE = 32768;
+template <typename Key>
+const uint64_t BasicBTreeFS<Key>::MIN_MAP_SIZE = 1 << 20;
+template <typename Key>
+const uint32_t BasicBTreeFS<Key>::MIN_FIXED_PAGE_SIZE = 512;
+
+template <typename Key>
+BasicBTreeFS<Key>::BasicBTreeFS(const std::string &filename, const BTreeOptions &options):
+    BasicBTreeStorage<Key>(options.latency_stats),
+    _filename(filename),
+    _direct_io(false),
+    _pool(1, 0),
+    _use_mmap(options.use_mmap),
+    _map(nullptr),
+    _map_size(0),
+    _checkpoint_size(options.wal_checkpoint_size),
+    _dirty_limit(options.dirty_limit),
+    _dirty_bytes(0),
+    _extent_size(options.extent_size),
+    _max_extent_size(options.max_extent_size),
+    _reserved_end(0),
+    _use_io_uring(options.use_io_uring),
+    _io_depth(options.io_depth),
+    _read_ahead(options.read_ahead),
+    _bloom_bits_per_key(options.bloom_bits_per_key),
+    _page_saves(0),
+    _stop_flusher(false),
+    _flush_failed(false),
+    _has_snapshots(false) {
     if (access(filename.c_str(), F_OK) == -1) {
         throw std::logic_error("File not found " + filename);
     }
+    if (options.use_mmap && options.durability != BTreeOptions::NONE) {
+        throw std::logic_error("Log is not supported for mapped files");
+    }
     _fd = open(_filename.c_str(), O_RDWR | O_EXCL, 0644);
     if (_fd == -1) {
         throw std::logic_error("Could not open " + filename);
     }
+    //the log of a crashed session is applied whatever the durability level is
+    recover();
     readHeader();
+    //space reserved past the end last time is found again by fallocate
+    _reserved_end = _first_page + _pages_allocated * _page_size;
+    if (options.direct_io) {
+        if (_first_page != _page_size) {
+            throw std::logic_error("Direct I/O needs a tree with fixed size pages");
+        }
+        enableDirectIo();
+    }
+    if (_use_mmap) {
+        //the page cache is the buffer pool when the file is mapped
+        struct stat st;
+        if (fstat(_fd, &st) == -1) {
+            throw std::logic_error("Could not stat " + filename);
+        }
+        mapFile(st.st_size);
+    }
+    else {
+        _pool = BTreePool(_page_size, options.cache_size);
+    }
+    if (options.durability != BTreeOptions::NONE) {
+        _wal.reset(new BTreeWal(_filename, _page_size, options));
+        _logged_header.resize(headerLength());
+        serializeHeader(_logged_header.data());
+    }
+    if (!_use_mmap)
+        startFlusher();
 }
 
-BTreeFS::BTreeFS(const std::string &filename, int order) :
+template <typename Key>
+BasicBTreeFS<Key>::BasicBTreeFS(const std::string &filename, int order, const BTreeOptions &options) :
+    BasicBTreeStorage<Key>(options.latency_stats),
     _filename(filename),
     _order(order),
+    _leaf_order(options.leaf_order),
+    _root_ref(0),
     _tree_size(0),
     _tree_height(0),
-    _pages_allocated(0) {
-    _page_size = BTreeNode::maxNodeSerializationSize(_order);
-    if (_page_size > MAX_PAGE_SIZE) {
-        throw std::logic_error("Page size is too big. Try to decrease tree order");
+    _direct_io(false),
+    _pages_allocated(0),
+    _free_head(0),
+    _free_pages(0),
+    _pool(1, 0),
+    _use_mmap(options.use_mmap),
+    _map(nullptr),
+    _map_size(0),
+    _checkpoint_size(options.wal_checkpoint_size),
+    _dirty_limit(options.dirty_limit),
+    _dirty_bytes(0),
+    _extent_size(options.extent_size),
+    _max_extent_size(options.max_extent_size),
+    _reserved_end(0),
+    _use_io_uring(options.use_io_uring),
+    _io_depth(options.io_depth),
+    _read_ahead(options.read_ahead),
+    _bloom_bits_per_key(options.bloom_bits_per_key),
+    _page_saves(0),
+    _stop_flusher(false),
+    _flush_failed(false),
+    _has_snapshots(false) {
+    if (options.page_size != 0) {
+        //power of two sizes keep every page within aligned device blocks
+        if (options.page_size < MIN_FIXED_PAGE_SIZE || options.page_size > MAX_PAGE_SIZE ||
+            (options.page_size & (options.page_size - 1)) != 0) {
+            throw std::logic_error("Invalid page size");
+        }
+        if (_order == 0)
+            _order = BasicBTreeNode<Key>::maxOrder(options.page_size);
+        if (BasicBTreeNode<Key>::maxNodeSerializationSize(_order) > (int)options.page_size) {
+            throw std::logic_error("Order does not fit the page size");
+        }
+        _page_size = options.page_size;
+        _first_page = _page_size;
+    }
+    else {
+        _page_size = BasicBTreeNode<Key>::maxNodeSerializationSize(_order);
+        if (_page_size > MAX_PAGE_SIZE) {
+            throw std::logic_error("Page size is too big. Try to decrease tree order");
+        }
+        _first_page = headerLength();
     }
-    _fd = open(_filename.c_str(), O_CREAT | O_RDWR, 0644);
+    if (_order < 1) {
+        throw std::logic_error("Invalid order");
+    }
+    if (_leaf_order != 0 && !BTreeKey<Key>::PACKED) {
+        throw std::logic_error("Packed leaves need integer keys");
+    }
+    //any three packed entries have to fit a page, so sized splits keep two keys a leaf
+    if (_leaf_order < 0 || (_leaf_order != 0 &&
+        (_leaf_order < 4 || _page_size < (uint32_t)BasicBTreeNode<Key>::maxNodeSerializationSize(4)))) {
+        throw std::logic_error("Invalid leaf order");
+    }
+    if (options.use_mmap && options.durability != BTreeOptions::NONE) {
+        throw std::logic_error("Log is not supported for mapped files");
+    }
+    if (options.direct_io && (options.use_mmap || options.page_size == 0)) {
+        throw std::logic_error("Direct I/O needs a tree with fixed size pages");
+    }
+    //stale pages of a previous tree must not survive in the mapping
+    _fd = open(_filename.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
     if (_fd == -1) {
         throw std::logic_error("Could not open " + filename);
-    }    
+    }
+    if (options.direct_io)
+        enableDirectIo();
+    if (!_use_mmap)
+        _pool = BTreePool(_page_size, options.cache_size);
+    _reserved_end = _first_page;
+    //nor may the log of a previous tree be replayed over this one
+    unlink(BTreeWal::logName(_filename).c_str());
+    if (options.durability != BTreeOptions::NONE) {
+        _wal.reset(new BTreeWal(_filename, _page_size, options));
+        _logged_header.resize(headerLength());
+        serializeHeader(_logged_header.data());
+    }
+    if (!_use_mmap)
+        startFlusher();
 }
 
-BTreeNode BTreeFS::openNode(uint64_t ref) const {
+template <typename Key>
+BasicBTreeNode<Key> BasicBTreeFS<Key>::openNode(uint64_t ref) const {
     if (!refIsValid(ref)) {
         throw std::logic_error("Invalid reference");
     }
-    uint8_t page[MAX_PAGE_SIZE];
-    ssize_t bytes_read = pread(_fd, page, _page_size, ref);
-    if (bytes_read != _page_size) {
+    if (_map != nullptr) {
+        return BasicBTreeNode<Key>::deserialize(_map + ref, _page_size);
+    }
+    if (!_pool.enabled()) {
+        uint8_t page[MAX_PAGE_SIZE];
+        readPage(page, ref);
+        return BasicBTreeNode<Key>::deserialize(page, _page_size);
+    }
+    std::lock_guard<std::mutex> lock(_pool_mutex);
+    const uint8_t *page = pinPage(ref);
+    try {
+        BasicBTreeNode<Key> node = BasicBTreeNode<Key>::deserialize(page, _page_size);
+        _pool.unpin(ref);
+        return node;
+    }
+    catch (...) {
+        _pool.unpin(ref);
+        throw;
+    }
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTreeFS<Key>::viewNode(uint64_t ref) const {
+    if (!refIsValid(ref)) {
+        throw std::logic_error("Invalid reference");
+    }
+    if (_map != nullptr) {
+        return BasicBTreeNodeView<Key>(_map + ref, _page_size);
+    }
+    std::vector<uint8_t> page(_page_size);
+    if (!_pool.enabled()) {
+        readPage(page.data(), ref);
+    }
+    else {
+        std::lock_guard<std::mutex> lock(_pool_mutex);
+        memcpy(page.data(), pinPage(ref), _page_size);
+        _pool.unpin(ref);
+    }
+    return BasicBTreeNodeView<Key>(std::move(page));
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTreeFS<Key>::copyNode(uint64_t ref) const {
+    if (_map == nullptr)
+        return viewNode(ref);
+    if (!refIsValid(ref)) {
+        throw std::logic_error("Invalid reference");
+    }
+    return BasicBTreeNodeView<Key>(std::vector<uint8_t>(_map + ref, _map + ref + _page_size));
+}
+
+template <typename Key>
+std::vector<BasicBTreeNodeView<Key> > BasicBTreeFS<Key>::viewNodes(const std::vector<uint64_t> &refs,
+                                                                   std::vector<bool> &read) const {
+    std::vector<BasicBTreeNodeView<Key> > views(refs.size());
+    read.assign(refs.size(), false);
+    std::vector<std::vector<uint8_t> > pages(refs.size());
+    std::vector<size_t> missing;
+    uint64_t saves = _page_saves;
+    for (size_t i = 0; i < refs.size(); ++i) {
+        uint64_t ref = refs[i];
+        if (!refIsValid(ref))
+            continue;
+        if (_map != nullptr) {
+            pages[i].assign(_map + ref, _map + ref + _page_size);
+            continue;
+        }
+        pages[i].resize(_page_size);
+        if (_pool.enabled()) {
+            std::lock_guard<std::mutex> lock(_pool_mutex);
+            const uint8_t *page = _pool.pin(ref);
+            if (page != nullptr) {
+                _stats.add(BTreeStats::CACHE_HITS);
+                memcpy(pages[i].data(), page, _page_size);
+                _pool.unpin(ref);
+                continue;
+            }
+            _stats.add(BTreeStats::CACHE_MISSES);
+        }
+        if (!readDirty(pages[i].data(), ref, _page_size))
+            missing.push_back(i);
+    }
+    if (!missing.empty())
+        readPages(refs, missing, pages, saves);
+    for (size_t i = 0; i < refs.size(); ++i) {
+        if (pages[i].empty())
+            continue;
+        try {
+            views[i] = BasicBTreeNodeView<Key>(std::move(pages[i]));
+            read[i] = true;
+        }
+        catch (const std::logic_error &) {
+            //a stale ref may point to a freed page
+        }
+    }
+    return views;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::readPages(const std::vector<uint64_t> &refs, const std::vector<size_t> &missing,
+                                  std::vector<std::vector<uint8_t> > &pages, uint64_t saves) const {
+    std::vector<BTreeReader::Request> requests(missing.size());
+    //one aligned buffer serves direct I/O as well
+    AlignedPtr buffer = alignedAlloc(missing.size() * _page_size);
+    for (size_t j = 0; j < missing.size(); ++j) {
+        requests[j].data = buffer.get() + j * _page_size;
+        requests[j].length = _page_size;
+        requests[j].offset = refs[missing[j]];
+    }
+    reader().read(requests.data(), requests.size());
+    _stats.add(BTreeStats::READ_CALLS, requests.size());
+    _stats.add(BTreeStats::READ_BYTES, requests.size() * _page_size);
+    _stats.add(BTreeStats::PAGES_READ, requests.size());
+    for (size_t j = 0; j < missing.size(); ++j) {
+        std::vector<uint8_t> &page = pages[missing[j]];
+        if (!requests[j].done) {
+            page.clear();
+            continue;
+        }
+        memcpy(page.data(), requests[j].data, _page_size);
+        if (!_pool.enabled())
+            continue;
+        //a page saved since the batch started may be older on disk than in the tree
+        uint64_t ref = refs[missing[j]];
+        std::lock_guard<std::mutex> lock(_pool_mutex);
+        if (_page_saves != saves)
+            continue;
+        uint8_t *frame = _pool.pin(ref);
+        if (frame == nullptr) {
+            frame = _pool.pinForWrite(ref);
+            memcpy(frame, page.data(), _page_size);
+        }
+        _pool.unpin(ref);
+    }
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::prefetch(std::vector<uint64_t> refs) const {
+    std::sort(refs.begin(), refs.end());
+    refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+    refs.erase(std::remove_if(refs.begin(), refs.end(), [this](uint64_t ref) {
+        return !refIsValid(ref);
+    }), refs.end());
+    if (refs.empty())
+        return;
+    _stats.add(BTreeStats::PAGES_PREFETCHED, refs.size());
+    if (_direct_io) {
+        //direct reads pass the page cache by, so the pages go to the pool
+        if (!_pool.enabled())
+            return;
+        std::vector<std::vector<uint8_t> > pages(refs.size());
+        std::vector<size_t> missing;
+        uint64_t saves = _page_saves;
+        for (size_t i = 0; i < refs.size(); ++i) {
+            {
+                std::lock_guard<std::mutex> lock(_pool_mutex);
+                if (_pool.pin(refs[i]) != nullptr) {
+                    _pool.unpin(refs[i]);
+                    continue;
+                }
+            }
+            pages[i].resize(_page_size);
+            if (!readDirty(pages[i].data(), refs[i], _page_size))
+                missing.push_back(i);
+        }
+        if (!missing.empty())
+            readPages(refs, missing, pages, saves);
+        return;
+    }
+    //runs of adjacent pages take one hint
+    size_t begin = 0;
+    while (begin < refs.size()) {
+        size_t end = begin + 1;
+        while (end < refs.size() && refs[end] == refs[end - 1] + _page_size)
+            ++end;
+        uint64_t offset = refs[begin];
+        uint64_t length = refs[end - 1] + _page_size - offset;
+        if (_map != nullptr) {
+            uint64_t aligned = offset / MMAP_ALIGNMENT * MMAP_ALIGNMENT;
+            madvise(_map + aligned, length + (offset - aligned), MADV_WILLNEED);
+        }
+        else {
+            posix_fadvise(_fd, offset, length, POSIX_FADV_WILLNEED);
+        }
+        begin = end;
+    }
+}
+
+template <typename Key>
+unsigned BasicBTreeFS<Key>::readAhead() const {
+    return _read_ahead;
+}
+
+template <typename Key>
+unsigned BasicBTreeFS<Key>::bloomBitsPerKey() const {
+    return _bloom_bits_per_key;
+}
+
+template <typename Key>
+bool BasicBTreeFS<Key>::usesIoUring() const {
+    return _map == nullptr && reader().usesUring();
+}
+
+template <typename Key>
+BTreeReader &BasicBTreeFS<Key>::reader() const {
+    std::lock_guard<std::mutex> lock(_reader_mutex);
+    if (!_reader)
+        _reader.reset(new BTreeReader(_fd, _io_depth, _use_io_uring));
+    return *_reader;
+}
+
+template <typename Key>
+const uint8_t *BasicBTreeFS<Key>::pinPage(uint64_t ref) const {
+    const uint8_t *page = _pool.pin(ref);
+    if (page != nullptr) {
+        _stats.add(BTreeStats::CACHE_HITS);
+        return page;
+    }
+    _stats.add(BTreeStats::CACHE_MISSES);
+    uint8_t *frame = _pool.pinForWrite(ref);
+    try {
+        readPage(frame, ref);
+    }
+    catch (...) {
+        _pool.invalidate(ref);
+        throw;
+    }
+    return frame;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::readPage(uint8_t *page, uint64_t ref) const {
+    if (readDirty(page, ref, _page_size))
+        return;
+    if (!readAt(page, _page_size, ref)) {
         throw std::logic_error("Could not read page");
     }
-    BTreeNode node = BTreeNode::deserialize(page, _page_size);
-    return node;
+    _stats.add(BTreeStats::PAGES_READ);
 }
 
-void BTreeFS::saveNode(const BTreeNode &node) {
-    uint8_t page[MAX_PAGE_SIZE];
-    node.serialize(page);
-    ssize_t bytes_written = pwrite(_fd, page, _page_size, node.ref());
-    if (bytes_written != _page_size) {
-        throw std::logic_error("Could not write page");
+template <typename Key>
+bool BasicBTreeFS<Key>::readAt(uint8_t *data, size_t length, uint64_t offset) const {
+    _stats.add(BTreeStats::READ_CALLS);
+    _stats.add(BTreeStats::READ_BYTES, length);
+    if (!_direct_io || isAligned(data, length, offset))
+        return pread(_fd, data, length, offset) == (ssize_t)length;
+    //direct reads cover whole pages
+    uint64_t begin = offset / _page_size * _page_size;
+    uint64_t end = (offset + length + _page_size - 1) / _page_size * _page_size;
+    AlignedPtr buffer = alignedAlloc(end - begin);
+    if (pread(_fd, buffer.get(), end - begin, begin) != (ssize_t)(end - begin))
+        return false;
+    memcpy(data, buffer.get() + (offset - begin), length);
+    return true;
+}
+
+template <typename Key>
+bool BasicBTreeFS<Key>::writeAt(const uint8_t *data, size_t length, uint64_t offset) {
+    _stats.add(BTreeStats::WRITE_CALLS);
+    _stats.add(BTreeStats::WRITE_BYTES, length);
+    //direct writes are always whole pages, only the memory may be unaligned
+    if (!_direct_io || isAligned(data, length, offset))
+        return pwrite(_fd, data, length, offset) == (ssize_t)length;
+    AlignedPtr buffer = alignedAlloc(length);
+    memcpy(buffer.get(), data, length);
+    return pwrite(_fd, buffer.get(), length, offset) == (ssize_t)length;
+}
+
+template <typename Key>
+bool BasicBTreeFS<Key>::isAligned(const uint8_t *data, size_t length, uint64_t offset) const {
+    uintptr_t alignment = std::min((uintptr_t)_page_size, (uintptr_t)IO_ALIGNMENT);
+    return (uintptr_t)data % alignment == 0 && length % _page_size == 0 && offset % _page_size == 0;
+}
+
+template <typename Key>
+bool BasicBTreeFS<Key>::writeHeaderPage(const uint8_t *header) {
+    std::vector<uint8_t> page(_first_page, 0);
+    memcpy(page.data(), header, headerLength());
+    return writeAt(page.data(), page.size(), 0);
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::enableDirectIo() {
+    int flags = fcntl(_fd, F_GETFL);
+    if (flags == -1 || fcntl(_fd, F_SETFL, flags | O_DIRECT) == -1) {
+        throw std::logic_error("Direct I/O is not supported for " + _filename);
+    }
+    _direct_io = true;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::saveNode(const BasicBTreeNode<Key> &node) {
+    if (_map != nullptr) {
+        node.serialize(_map + node.ref());
+        return;
+    }
+    preserve(node.ref());
+    uint8_t stack_page[MAX_PAGE_SIZE];
+    std::unique_lock<std::mutex> lock(_pool_mutex, std::defer_lock);
+    if (_pool.enabled())
+        lock.lock();
+    ++_page_saves;
+    //write-through: the saved page stays hot in the pool
+    uint8_t *page = _pool.enabled() ? _pool.pinForWrite(node.ref()) : stack_page;
+    int size = node.serialize(page);
+    //fixed size pages may be larger than the node
+    memset(page + size, 0, _page_size - size);
+    try {
+        writePage(page, node.ref());
+    }
+    catch (...) {
+        _pool.invalidate(node.ref());
+        throw;
+    }
+    if (_pool.enabled())
+        _pool.unpin(node.ref());
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::writePage(const uint8_t *page, uint64_t ref) {
+    if (_wal) {
+        //held back until the operation is logged
+        std::lock_guard<std::mutex> lock(_txn_mutex);
+        _txns[std::this_thread::get_id()].pages[ref].assign(page, page + _page_size);
+        return;
+    }
+    markDirty(ref, PagePtr(new std::vector<uint8_t>(page, page + _page_size)), 0);
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::markDirty(uint64_t ref, const PagePtr &page, uint64_t lsn) {
+    std::lock_guard<std::mutex> lock(_dirty_mutex);
+    DirtyPage &dirty = _dirty[ref];
+    if (!dirty.page)
+        _dirty_bytes += _page_size;
+    //a page being written back keeps its old copy alive
+    dirty.page = page;
+    dirty.lsn = lsn;
+}
+
+template <typename Key>
+bool BasicBTreeFS<Key>::readDirty(uint8_t *page, uint64_t ref, size_t length) const {
+    if (_wal) {
+        //pages of other threads are latched by their writers until logged,
+        //but a page read from the file under them would stay in the pool
+        std::lock_guard<std::mutex> lock(_txn_mutex);
+        for (const auto &txn: _txns) {
+            auto page_it = txn.second.pages.find(ref);
+            if (page_it != txn.second.pages.end()) {
+                memcpy(page, page_it->second.data(), length);
+                return true;
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(_dirty_mutex);
+    auto dirty_it = _dirty.find(ref);
+    if (dirty_it == _dirty.end())
+        return false;
+    memcpy(page, dirty_it->second.page->data(), length);
+    return true;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::writeBack() {
+    std::lock_guard<std::mutex> write_lock(_write_mutex);
+    uint64_t durable_lsn = _wal ? _wal->durableLsn() : 0;
+    std::vector<std::pair<uint64_t, PagePtr> > pages;
+    {
+        std::lock_guard<std::mutex> lock(_dirty_mutex);
+        for (const auto &dirty: _dirty) {
+            //no page reaches the tree file before its log record is durable
+            if (dirty.second.lsn <= durable_lsn)
+                pages.push_back(std::make_pair(dirty.first, dirty.second.page));
+        }
+    }
+    //runs of adjacent pages go out in one call
+    std::vector<struct iovec> iov;
+    size_t begin = 0;
+    while (begin < pages.size()) {
+        size_t end = begin;
+        iov.clear();
+        while (end < pages.size() && iov.size() < IOV_MAX &&
+               (end == begin || pages[end].first == pages[end - 1].first + _page_size)) {
+            struct iovec vec;
+            vec.iov_base = const_cast<uint8_t *>(pages[end].second->data());
+            vec.iov_len = _page_size;
+            iov.push_back(vec);
+            ++end;
+        }
+        ssize_t length = (end - begin) * _page_size;
+        bool written;
+        if (_direct_io) {
+            //direct writes take one aligned buffer instead of the page copies
+            AlignedPtr buffer = alignedAlloc(length);
+            for (size_t i = begin; i < end; ++i) {
+                memcpy(buffer.get() + (i - begin) * _page_size, pages[i].second->data(), _page_size);
+            }
+            written = pwrite(_fd, buffer.get(), length, pages[begin].first) == length;
+        }
+        else {
+            written = pwritev(_fd, iov.data(), iov.size(), pages[begin].first) == length;
+        }
+        if (!written) {
+            throw std::logic_error("Could not write page");
+        }
+        _stats.add(BTreeStats::WRITE_CALLS);
+        _stats.add(BTreeStats::WRITE_BYTES, length);
+        _stats.add(BTreeStats::PAGES_WRITTEN, end - begin);
+        begin = end;
+    }
+    std::lock_guard<std::mutex> lock(_dirty_mutex);
+    for (const auto &page: pages) {
+        auto it = _dirty.find(page.first);
+        //pages saved again meanwhile stay dirty
+        if (it != _dirty.end() && it->second.page == page.second) {
+            _dirty.erase(it);
+            _dirty_bytes -= _page_size;
+        }
+    }
+}
+
+template <typename Key>
+size_t BasicBTreeFS<Key>::dirtyBytes() const {
+    std::lock_guard<std::mutex> lock(_dirty_mutex);
+    return _dirty_bytes;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::startFlusher() {
+    if (_dirty_limit != 0)
+        _flusher = std::thread(&BasicBTreeFS::flusherLoop, this);
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::stopFlusher() {
+    if (!_flusher.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_dirty_mutex);
+        _stop_flusher = true;
+    }
+    _flusher_wakeup.notify_all();
+    _flusher.join();
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::flusherLoop() {
+    std::unique_lock<std::mutex> lock(_dirty_mutex);
+    while (!_stop_flusher) {
+        _flusher_wakeup.wait(lock);
+        if (_stop_flusher || _dirty_bytes < _dirty_limit / 2)
+            continue;
+        lock.unlock();
+        try {
+            writeBack();
+        }
+        catch (const std::exception &e) {
+            //reported by the next commit
+            _flush_failed = true;
+        }
+        lock.lock();
+    }
+}
+
+template <typename Key>
+BasicBTreeNode<Key> BasicBTreeFS<Key>::allocNode(bool is_leaf) {
+    bool append = _free_head == 0;
+    uint64_t ref = append ? _first_page + _pages_allocated * _page_size : _free_head;
+    if (_use_mmap && ref + _page_size > _map_size) {
+        //grow geometrically to keep remaps rare
+        mapFile(std::max(ref + _page_size, std::max(2 * _map_size, MIN_MAP_SIZE)));
+    }
+    else if (!_use_mmap && append) {
+        reserve(ref + _page_size);
+    }
+    if (!append) {
+        _free_head = readFreeLink(ref);
+        --_free_pages;
+        _stats.add(BTreeStats::PAGES_REUSED);
+    }
+    //file pages get their content on the first write-back of the node
+    if (_use_mmap) {
+        memset(_map + ref, 0, _page_size);
+    }
+    if (append) {
+        ++_pages_allocated;
+        _stats.add(BTreeStats::PAGES_APPENDED);
+    }
+    if (is_leaf && _leaf_order != 0) {
+        BasicBTreeNode<Key> node(_leaf_order, ref, true);
+        node.setPacked(_page_size);
+        return node;
+    }
+    return BasicBTreeNode<Key>(_order, ref, is_leaf);
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::freeNode(uint64_t ref) {
+    if (!refIsValid(ref)) {
+        throw std::logic_error("Invalid reference");
     }
+    writeFreePage(ref, _free_head);
+    _free_head = ref;
+    ++_free_pages;
+    _stats.add(BTreeStats::PAGES_FREED);
 }
 
-BTreeNode BTreeFS::allocNode(bool is_leaf) {
-    uint64_t ref = headerLength() + _pages_allocated * _page_size;
+template <typename Key>
+void BasicBTreeFS<Key>::writeFreePage(uint64_t ref, uint64_t next) {
+    preserve(ref);
+    //free page keeps the mark in place of the order and the link in place of the ref
+    uint8_t link[2 * sizeof(uint64_t)];
+    memset(link, 0, sizeof(link));
+    int mark = FREE_PAGE_MARK;
+    memcpy(link, &mark, sizeof(mark));
+    memcpy(link + sizeof(uint64_t), &next, sizeof(next));
+    {
+        std::lock_guard<std::mutex> lock(_pool_mutex);
+        ++_page_saves;
+        _pool.invalidate(ref);
+    }
+    if (_map != nullptr) {
+        memcpy(_map + ref, link, sizeof(link));
+        return;
+    }
     uint8_t page[MAX_PAGE_SIZE];
     memset(page, 0, _page_size);
-    ssize_t bytes_written = pwrite(_fd, page, _page_size, ref);
-    if (bytes_written != _page_size) {
-        throw std::logic_error("Could not allocate page");
+    memcpy(page, link, sizeof(link));
+    writePage(page, ref);
+}
+
+template <typename Key>
+uint64_t BasicBTreeFS<Key>::readFreeLink(uint64_t ref) const {
+    uint8_t link[2 * sizeof(uint64_t)];
+    if (_map != nullptr) {
+        memcpy(link, _map + ref, sizeof(link));
     }
-    ++_pages_allocated;
-    return BTreeNode(_order, ref, is_leaf);
+    else if (!readDirty(link, ref, sizeof(link)) && !readAt(link, sizeof(link), ref)) {
+        throw std::logic_error("Could not read free page");
+    }
+    int mark;
+    uint64_t next;
+    memcpy(&mark, link, sizeof(mark));
+    memcpy(&next, link + sizeof(uint64_t), sizeof(next));
+    if (mark != FREE_PAGE_MARK || (next != 0 && !refIsValid(next))) {
+        throw std::logic_error("Free page list is corrupted");
+    }
+    return next;
 }
 
-int BTreeFS::order() const {
+template <typename Key>
+uint64_t BasicBTreeFS<Key>::vacuum() {
+    std::vector<uint64_t> free_refs;
+    for (uint64_t ref = _free_head; ref != 0; ref = readFreeLink(ref)) {
+        free_refs.push_back(ref);
+    }
+    std::sort(free_refs.begin(), free_refs.end());
+    uint64_t released = 0;
+    while (!free_refs.empty() &&
+           free_refs.back() == _first_page + (_pages_allocated - 1) * _page_size) {
+        {
+            std::lock_guard<std::mutex> lock(_pool_mutex);
+            _pool.invalidate(free_refs.back());
+        }
+        free_refs.pop_back();
+        --_pages_allocated;
+        ++released;
+    }
+    //relink in file order so that allocation fills the lowest holes first
+    _free_head = 0;
+    for (auto it = free_refs.rbegin(); it != free_refs.rend(); ++it) {
+        writeFreePage(*it, _free_head);
+        _free_head = *it;
+    }
+    _free_pages = free_refs.size();
+    if (released == 0)
+        return 0;
+    uint64_t length = _first_page + _pages_allocated * _page_size;
+    {
+        //released pages must not be written back past the new end
+        std::lock_guard<std::mutex> write_lock(_write_mutex);
+        std::lock_guard<std::mutex> txn_lock(_txn_mutex);
+        std::lock_guard<std::mutex> lock(_dirty_mutex);
+        for (auto &txn: _txns) {
+            txn.second.pages.erase(txn.second.pages.lower_bound(length), txn.second.pages.end());
+        }
+        for (auto it = _dirty.lower_bound(length); it != _dirty.end(); it = _dirty.erase(it)) {
+            _dirty_bytes -= _page_size;
+        }
+    }
+    if (_wal) {
+        //the shorter tree is on disk before the file shrinks
+        checkpoint();
+    }
+    if (ftruncate(_fd, length) == -1) {
+        throw std::logic_error("Could not truncate " + _filename);
+    }
+    //the reserved blocks past the end went with the truncation
+    _reserved_end = length;
+    if (_map != nullptr) {
+        void *map = mremap(_map, _map_size, length, MREMAP_MAYMOVE);
+        if (map == MAP_FAILED) {
+            throw std::logic_error("Could not map " + _filename);
+        }
+        _map = static_cast<uint8_t *>(map);
+        _map_size = length;
+    }
+    return released;
+}
+
+template <typename Key>
+int BasicBTreeFS<Key>::order() const {
     return _order;
 }
 
-uint64_t BTreeFS::rootRef() const {
+template <typename Key>
+int BasicBTreeFS<Key>::leafOrder() const {
+    return _leaf_order;
+}
+
+template <typename Key>
+uint64_t BasicBTreeFS<Key>::rootRef() const {
     return _root_ref;
 }
 
-void BTreeFS::setRootRef(uint64_t root) {
+template <typename Key>
+void BasicBTreeFS<Key>::setRootRef(uint64_t root) {
     _root_ref = root;
 }
 
-uint64_t BTreeFS::treeSize() const {
+template <typename Key>
+uint64_t BasicBTreeFS<Key>::treeSize() const {
     return _tree_size;
 }
 
-void BTreeFS::setTreeSize(uint64_t tree_size) {
+template <typename Key>
+void BasicBTreeFS<Key>::setTreeSize(uint64_t tree_size) {
     _tree_size = tree_size;
 }
 
-int BTreeFS::treeHeight() const {
+template <typename Key>
+void BasicBTreeFS<Key>::addTreeSize(int64_t delta) {
+    if (!_wal) {
+        _tree_size += delta;
+        return;
+    }
+    //the logged size only counts logged operations
+    std::lock_guard<std::mutex> lock(_txn_mutex);
+    _txns[std::this_thread::get_id()].size_delta += delta;
+}
+
+template <typename Key>
+int BasicBTreeFS<Key>::treeHeight() const {
     return _tree_height;
 }
 
-void BTreeFS::setTreeHeight(int tree_height) {
+template <typename Key>
+void BasicBTreeFS<Key>::setTreeHeight(int tree_height) {
     _tree_height = tree_height;
 }
 
-uint32_t BTreeFS::pageSize() const {
+template <typename Key>
+uint32_t BasicBTreeFS<Key>::pageSize() const {
     return _page_size;
 }
 
-uint64_t BTreeFS::pagesAllocated() const {
+template <typename Key>
+uint64_t BasicBTreeFS<Key>::pagesAllocated() const {
     return _pages_allocated;
 }
 
-void BTreeFS::writeHeader() {
-    uint64_t offset = 0;
-    if (pwrite(_fd, &_page_size, sizeof(_page_size), offset) != sizeof(_page_size)) {
-        throw std::logic_error("Error during FS settings write");
+template <typename Key>
+uint64_t BasicBTreeFS<Key>::freePages() const {
+    return _free_pages;
+}
+
+template <typename Key>
+bool BasicBTreeFS<Key>::isMapped() const {
+    return _map != nullptr;
+}
+
+template <typename Key>
+bool BasicBTreeFS<Key>::writesInPlace() const {
+    return isMapped();
+}
+
+template <typename Key>
+std::shared_ptr<typename BasicBTreeFS<Key>::SnapshotPages> BasicBTreeFS<Key>::takeSnapshot() const {
+    //pages change in place in the mapping, nothing could keep the old image
+    if (_map != nullptr) {
+        throw std::logic_error("Snapshots are not supported in mmap mode");
     }
-    offset += sizeof(_page_size);
-    if (pwrite(_fd, &_pages_allocated, sizeof(_pages_allocated), offset) != sizeof(_pages_allocated)) {
-        throw std::logic_error("Error during FS settings write");
+    std::shared_ptr<SnapshotPages> snapshot =
+        std::make_shared<SnapshotPages>(_first_page + _pages_allocated * _page_size);
+    std::lock_guard<std::mutex> lock(_snapshot_mutex);
+    _snapshots.push_back(snapshot);
+    _has_snapshots = true;
+    return snapshot;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::preserve(uint64_t ref) {
+    if (!_has_snapshots)
+        return;
+    std::vector<std::shared_ptr<SnapshotPages> > targets;
+    {
+        std::lock_guard<std::mutex> lock(_snapshot_mutex);
+        auto it = _snapshots.begin();
+        while (it != _snapshots.end()) {
+            std::shared_ptr<SnapshotPages> snapshot = it->lock();
+            if (!snapshot) {
+                //released snapshots took their images with them
+                it = _snapshots.erase(it);
+                continue;
+            }
+            if (ref < snapshot->end) {
+                std::lock_guard<std::mutex> pages_lock(snapshot->mutex);
+                if (snapshot->pages.find(ref) == snapshot->pages.end())
+                    targets.push_back(snapshot);
+            }
+            ++it;
+        }
+        _has_snapshots = !_snapshots.empty();
     }
-    offset += sizeof(_pages_allocated);
-    if (pwrite(_fd, &_root_ref, sizeof(_root_ref), offset) != sizeof(_root_ref)) {
-        throw std::logic_error("Error during FS settings write");
+    if (targets.empty())
+        return;
+    //the writer holds the page latch, so the image is the one before this operation
+    std::shared_ptr<std::vector<uint8_t> > page = std::make_shared<std::vector<uint8_t> >(_page_size);
+    readPage(page->data(), ref);
+    for (const std::shared_ptr<SnapshotPages> &snapshot: targets) {
+        std::lock_guard<std::mutex> lock(snapshot->mutex);
+        snapshot->pages[ref] = page;
     }
-    offset += sizeof(_root_ref);
-    if (pwrite(_fd, &_tree_size, sizeof(_tree_size), offset) != sizeof(_tree_size)) {
-        throw std::logic_error("Error during FS settings write");
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTreeFS<Key>::viewNode(const SnapshotPages &snapshot, uint64_t ref) const {
+    //the live page is read first: a writer keeps the old image before it
+    //changes the page, so a changed page is always found below
+    BasicBTreeNodeView<Key> view;
+    try {
+        view = viewNode(ref);
+    }
+    catch (const std::logic_error &) {
+        //freed and released since, then the old image has to be there
+        std::lock_guard<std::mutex> lock(snapshot.mutex);
+        auto it = snapshot.pages.find(ref);
+        if (it == snapshot.pages.end())
+            throw;
+        return BasicBTreeNodeView<Key>(it->second->data(), _page_size);
+    }
+    std::lock_guard<std::mutex> lock(snapshot.mutex);
+    auto it = snapshot.pages.find(ref);
+    if (it != snapshot.pages.end())
+        return BasicBTreeNodeView<Key>(it->second->data(), _page_size);
+    return view;
+}
+
+template <typename Key>
+size_t BasicBTreeFS<Key>::snapshotPages() const {
+    size_t pages = 0;
+    std::lock_guard<std::mutex> lock(_snapshot_mutex);
+    for (const std::weak_ptr<SnapshotPages> &weak: _snapshots) {
+        std::shared_ptr<SnapshotPages> snapshot = weak.lock();
+        if (snapshot) {
+            std::lock_guard<std::mutex> pages_lock(snapshot->mutex);
+            pages += snapshot->pages.size();
+        }
     }
-    offset += sizeof(_tree_size);    
-    if (pwrite(_fd, &_tree_height, sizeof(_tree_height), offset) != sizeof(_tree_height)) {
+    return pages;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::mapFile(uint64_t length) {
+    struct stat st;
+    if (fstat(_fd, &st) == -1) {
+        throw std::logic_error("Could not stat " + _filename);
+    }
+    //the mapping needs the file size, an extent also gets the blocks in one piece
+    if ((uint64_t)st.st_size < length && !allocateExtent(st.st_size, length - st.st_size, false) &&
+        ftruncate(_fd, length) == -1) {
+        throw std::logic_error("Could not extend " + _filename);
+    }
+    void *map;
+    if (_map == nullptr)
+        map = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    else
+        map = mremap(_map, _map_size, length, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) {
+        throw std::logic_error("Could not map " + _filename);
+    }
+    _map = static_cast<uint8_t *>(map);
+    _map_size = length;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::reserve(uint64_t end) {
+    if (end <= _reserved_end || _extent_size == 0)
+        return;
+    //extents grow with the tree, so their number grows with its log
+    uint64_t extent = std::max(_reserved_end - _first_page, _extent_size);
+    extent = std::min(extent, std::max(_max_extent_size, _extent_size));
+    extent = std::max(extent, end - _reserved_end);
+    //the file size still follows write-back, the blocks are just there already
+    if (allocateExtent(_reserved_end, extent, true))
+        _reserved_end += extent;
+}
+
+template <typename Key>
+bool BasicBTreeFS<Key>::allocateExtent(uint64_t offset, uint64_t length, bool keep_size) {
+    if (_extent_size == 0)
+        return false;
+    if (fallocate(_fd, keep_size ? FALLOC_FL_KEEP_SIZE : 0, offset, length) == -1) {
+        //pages are written either way, so the file just grows the old way
+        _extent_size = 0;
+        return false;
+    }
+    _stats.add(BTreeStats::EXTENT_CALLS);
+    _stats.add(BTreeStats::EXTENT_BYTES, length);
+    return true;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::serializeHeader(uint8_t *header) const {
+    Header fields;
+    fields.page_size = _page_size;
+    fields.pages_allocated = _pages_allocated;
+    fields.root_ref = _root_ref;
+    fields.tree_size = _tree_size;
+    fields.tree_height = _tree_height;
+    fields.order = _order;
+    fields.free_head = _free_head;
+    fields.free_pages = _free_pages;
+    fields.leaf_order = _leaf_order;
+    fields.first_page = _first_page;
+    fields.key_type = BTreeKey<Key>::TYPE;
+    formatHeader(fields, header);
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::formatHeader(const Header &fields, uint8_t *header) {
+    memset(header, 0, headerLength());
+    uint8_t *out = header;
+    memcpy(out, &fields.page_size, sizeof(fields.page_size));
+    out += sizeof(fields.page_size);
+    memcpy(out, &fields.pages_allocated, sizeof(fields.pages_allocated));
+    out += sizeof(fields.pages_allocated);
+    memcpy(out, &fields.root_ref, sizeof(fields.root_ref));
+    out += sizeof(fields.root_ref);
+    memcpy(out, &fields.tree_size, sizeof(fields.tree_size));
+    out += sizeof(fields.tree_size);
+    memcpy(out, &fields.tree_height, sizeof(fields.tree_height));
+    out += sizeof(fields.tree_height);
+    memcpy(out, &fields.order, sizeof(fields.order));
+    out += sizeof(fields.order);
+    memcpy(out, &fields.free_head, sizeof(fields.free_head));
+    out += sizeof(fields.free_head);
+    memcpy(out, &fields.free_pages, sizeof(fields.free_pages));
+    out += sizeof(fields.free_pages);
+    memcpy(out, &fields.leaf_order, sizeof(fields.leaf_order));
+    out += sizeof(fields.leaf_order);
+    memcpy(out, &fields.first_page, sizeof(fields.first_page));
+    out += sizeof(fields.first_page);
+    memcpy(out, &fields.key_type, sizeof(fields.key_type));
+}
+
+template <typename Key>
+typename BasicBTreeFS<Key>::Header BasicBTreeFS<Key>::parseHeader(const uint8_t *header) {
+    Header fields;
+    const uint8_t *in = header;
+    memcpy(&fields.page_size, in, sizeof(fields.page_size));
+    in += sizeof(fields.page_size);
+    memcpy(&fields.pages_allocated, in, sizeof(fields.pages_allocated));
+    in += sizeof(fields.pages_allocated);
+    memcpy(&fields.root_ref, in, sizeof(fields.root_ref));
+    in += sizeof(fields.root_ref);
+    memcpy(&fields.tree_size, in, sizeof(fields.tree_size));
+    in += sizeof(fields.tree_size);
+    memcpy(&fields.tree_height, in, sizeof(fields.tree_height));
+    in += sizeof(fields.tree_height);
+    memcpy(&fields.order, in, sizeof(fields.order));
+    in += sizeof(fields.order);
+    memcpy(&fields.free_head, in, sizeof(fields.free_head));
+    in += sizeof(fields.free_head);
+    memcpy(&fields.free_pages, in, sizeof(fields.free_pages));
+    in += sizeof(fields.free_pages);
+    memcpy(&fields.leaf_order, in, sizeof(fields.leaf_order));
+    in += sizeof(fields.leaf_order);
+    memcpy(&fields.first_page, in, sizeof(fields.first_page));
+    in += sizeof(fields.first_page);
+    memcpy(&fields.key_type, in, sizeof(fields.key_type));
+    return fields;
+}
+
+template <typename Key>
+bool BasicBTreeFS<Key>::headerIsValid(const Header &fields) {
+    if (fields.page_size == 0 || fields.page_size > MAX_PAGE_SIZE)
+        return false;
+    return fields.first_page == headerLength() || fields.first_page == fields.page_size;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::deserializeHeader(const uint8_t *header) {
+    Header fields = parseHeader(header);
+    if (!headerIsValid(fields)) {
+        throw std::logic_error("Unsupported tree file format");
+    }
+    if (fields.key_type != BTreeKey<Key>::TYPE) {
+        throw std::logic_error("Tree file has keys of another type");
+    }
+    _page_size = fields.page_size;
+    _pages_allocated = fields.pages_allocated;
+    _root_ref = fields.root_ref;
+    _tree_size = fields.tree_size;
+    _tree_height = fields.tree_height;
+    _order = fields.order;
+    _free_head = fields.free_head;
+    _free_pages = fields.free_pages;
+    _leaf_order = fields.leaf_order;
+    _first_page = fields.first_page;
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::writeHeader() {
+    std::vector<uint8_t> header(headerLength());
+    serializeHeader(header.data());
+    if (!writeHeaderPage(header.data())) {
         throw std::logic_error("Error during FS settings write");
     }
-    offset += sizeof(_tree_height);
 }
 
-void BTreeFS::readHeader() {
-    uint64_t offset = 0;
-    if (pread(_fd, &_page_size, sizeof(_page_size), offset) != sizeof(_page_size)) {
+template <typename Key>
+void BasicBTreeFS<Key>::readHeader() {
+    std::vector<uint8_t> header(headerLength());
+    if (pread(_fd, header.data(), header.size(), 0) != (ssize_t)header.size()) {
         throw std::logic_error("Error during FS settings read");
     }
-    offset += sizeof(_page_size);
-    if (pread(_fd, &_pages_allocated, sizeof(_pages_allocated), offset) != sizeof(_pages_allocated)) {
-        throw std::logic_error("Error during FS settings read");
+    deserializeHeader(header.data());
+}
+
+template <typename Key>
+uint64_t BasicBTreeFS<Key>::prepare() {
+    if (!_wal)
+        return 0;
+    //the pages stay staged and visible to readers until they are dirty,
+    //only this thread and vacuum under the tree lock change them
+    Txn empty;
+    Txn *txn = &empty;
+    {
+        std::lock_guard<std::mutex> lock(_txn_mutex);
+        auto it = _txns.find(std::this_thread::get_id());
+        if (it != _txns.end())
+            txn = &it->second;
     }
-    offset += sizeof(_pages_allocated);
-    if (pread(_fd, &_root_ref, sizeof(_root_ref), offset) != sizeof(_root_ref)) {
-        throw std::logic_error("Error during FS settings read");
+    //records reach the log in the order their headers were taken
+    std::lock_guard<std::mutex> lock(_log_mutex);
+    try {
+        _tree_size += txn->size_delta;
+        std::vector<uint8_t> header(headerLength());
+        serializeHeader(header.data());
+        uint64_t lsn = 0;
+        if (!txn->pages.empty() || header != _logged_header) {
+            std::vector<BTreeWal::Page> pages;
+            for (const auto &page: txn->pages) {
+                pages.push_back(BTreeWal::Page(page.first, page.second.data()));
+            }
+            lsn = _wal->append(header.data(), header.size(), pages);
+            _logged_header.swap(header);
+        }
+        std::lock_guard<std::mutex> txn_lock(_txn_mutex);
+        for (auto &page: txn->pages) {
+            std::shared_ptr<std::vector<uint8_t> > logged = std::make_shared<std::vector<uint8_t> >();
+            logged->swap(page.second);
+            markDirty(page.first, logged, lsn);
+        }
+        _txns.erase(std::this_thread::get_id());
+        return lsn;
     }
-    offset += sizeof(_root_ref);    
-    if (pread(_fd, &_tree_size, sizeof(_tree_size), offset) != sizeof(_tree_size)) {
-        throw std::logic_error("Error during FS settings read");
+    catch (...) {
+        std::lock_guard<std::mutex> txn_lock(_txn_mutex);
+        _txns.erase(std::this_thread::get_id());
+        throw;
     }
-    offset += sizeof(_tree_size);
-    if (pread(_fd, &_tree_height, sizeof(_tree_height), offset) != sizeof(_tree_height)) {
-        throw std::logic_error("Error during FS settings read");
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::commit(uint64_t lsn) {
+    if (_map != nullptr)
+        return;
+    if (_flush_failed) {
+        throw std::logic_error("Could not write page");
+    }
+    if (lsn != 0)
+        _wal->commit(lsn);
+    size_t dirty_bytes = dirtyBytes();
+    if (dirty_bytes > _dirty_limit) {
+        //writers only wait for write-back when the flusher falls behind
+        writeBack();
+        if (_wal && dirtyBytes() > _dirty_limit) {
+            _wal->sync();
+            writeBack();
+        }
+    }
+    else if (dirty_bytes > _dirty_limit / 2) {
+        _flusher_wakeup.notify_one();
+    }
+    if (_wal && _wal->size() >= _checkpoint_size) {
+        checkpoint();
+    }
+}
+
+template <typename Key>
+void BasicBTreeFS<Key>::checkpoint() {
+    if (!_wal)
+        return;
+    prepare();
+    //no record may be logged between the write-back and the truncation
+    std::lock_guard<std::mutex> lock(_log_mutex);
+    _wal->sync();
+    writeBack();
+    if (!writeHeaderPage(_logged_header.data())) {
+        throw std::logic_error("Error during FS settings write");
+    }
+    if (fdatasync(_fd) == -1) {
+        throw std::logic_error("Could not sync " + _filename);
     }
-    offset += sizeof(_tree_height);
+    _wal->truncate();
 }
 
-bool BTreeFS::refIsValid(uint64_t ref) const {
-    uint32_t header_len = headerLength();
-    if (ref < header_len) return false;
-    if (ref > header_len + _pages_allocated * _page_size) return false;
-    return (ref - header_len) % _page_size == 0;
+template <typename Key>
+void BasicBTreeFS<Key>::recover() {
+    uint64_t replayed = BTreeWal::replay(_filename, [this](const uint8_t *header, uint32_t header_len,
+                                                           const std::vector<BTreeWal::Page> &pages) {
+        uint32_t page_size;
+        memcpy(&page_size, header, sizeof(page_size));
+        for (const BTreeWal::Page &page: pages) {
+            if (pwrite(_fd, page.second, page_size, page.first) != page_size) {
+                throw std::logic_error("Could not write page");
+            }
+        }
+        if (pwrite(_fd, header, header_len, 0) != header_len) {
+            throw std::logic_error("Error during FS settings write");
+        }
+    });
+    if (replayed != 0 && fdatasync(_fd) == -1) {
+        throw std::logic_error("Could not sync " + _filename);
+    }
+    unlink(BTreeWal::logName(_filename).c_str());
 }
 
+template <typename Key>
+uint64_t BasicBTreeFS<Key>::writeCalls() const {
+    return _stats.counter(BTreeStats::WRITE_CALLS);
+}
 
-const uint32_t BTreeFS::MAX_PAGE_SIZE = 32768;
+template <typename Key>
+uint64_t BasicBTreeFS<Key>::extentCalls() const {
+    return _stats.counter(BTreeStats::EXTENT_CALLS);
+}
+
+template <typename Key>
+uint64_t BasicBTreeFS<Key>::logSyncs() const {
+    return _wal ? _wal->syncs() : 0;
+}
 
-uint32_t BTreeFS::headerLength() const {
+template <typename Key>
+bool BasicBTreeFS<Key>::refIsValid(uint64_t ref) const {
+    if (ref < _first_page) return false;
+    if (ref >= _first_page + _pages_allocated * _page_size) return false;
+    return (ref - _first_page) % _page_size == 0;
+}
+
+
+template <typename Key>
+uint32_t BasicBTreeFS<Key>::headerLength() {
     uint32_t length = sizeof(_page_size);
-    length += sizeof(_pages_allocated);
+    length += sizeof(uint64_t);
     length += sizeof(_root_ref);
-    length += sizeof(_tree_size);
+    length += sizeof(uint64_t);
     length += sizeof(_tree_height);
+    length += sizeof(_order);
+    length += sizeof(_free_head);
+    length += sizeof(_free_pages);
+    length += sizeof(_leaf_order);
+    length += sizeof(_first_page);
+    length += sizeof(uint32_t);
+    //pages start 8 byte aligned
+    length = (length + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
     return length;
 }
 
-BTreeFS::~BTreeFS() {
+template <typename Key>
+BasicBTreeFS<Key>::~BasicBTreeFS() {
+    stopFlusher();
+    bool closed = false;
     try {
-        writeHeader();
+        if (_wal) {
+            checkpoint();
+        }
+        else {
+            writeBack();
+            writeHeader();
+        }
+        closed = true;
     }
     catch (const std::exception &e) {
         std::cout << e.what() <<std::endl;
     }
-    
+    if (_wal) {
+        _wal.reset();
+        //a log that failed to checkpoint is left for recovery
+        if (closed)
+            unlink(BTreeWal::logName(_filename).c_str());
+    }
+    uint64_t end = _first_page + _pages_allocated * _page_size;
+    if (_map != nullptr)
+        munmap(_map, _map_size);
+    //drop the unused tail of the last mapping extent or the unused reserved
+    //blocks, which truncation frees even past the end of the file
+    if ((_map != nullptr || _reserved_end > end) && ftruncate(_fd, end) == -1) {
+        std::cout << "Could not truncate " << _filename << std::endl;
+    }
     close(_fd);
 }
+
+BTREE_INSTANTIATE(BasicBTreeFS);
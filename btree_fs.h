@@ -1,39 +1,220 @@
 #pragma once
 #include "btree_node.h"
+#include "btree_node_view.h"
+#include "btree_options.h"
+#include "btree_pool.h"
+#include "btree_reader.h"
+#include "btree_stats.h"
+#include "btree_storage.h"
+#include "btree_wal.h"
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <stdint.h>
 
-
-class BTreeFS {
+//Tree file. The header records the key type, a file written with other
+//keys does not open. BTreeFS keeps int keys.
+template <typename Key>
+class BasicBTreeFS: public BasicBTreeStorage<Key> {
 public:
-explicit BTreeFS(const std::string &filename);
-    BTreeFS(const std::string &filename, int order);
-    BTreeNode openNode(uint64_t ref) const;
-    void saveNode(const BTreeNode &node);
-    BTreeNode allocNode(bool is_leaf);
-    int order() const;
-    uint64_t rootRef() const;
-    void setRootRef(uint64_t root);
-    uint64_t treeSize() const;
-    void setTreeSize(uint64_t tree_size);
-    int treeHeight() const;
-    void setTreeHeight(int tree_height);
-    uint32_t pageSize() const;
+    typedef BasicBTreeNode<Key> Node;
+    typedef BasicBTreeNodeView<Key> NodeView;
+    typedef typename BasicBTreeStorage<Key>::PagePtr PagePtr;
+    typedef typename BasicBTreeStorage<Key>::SnapshotPages SnapshotPages;
+    explicit BasicBTreeFS(const std::string &filename, const BTreeOptions &options = BTreeOptions());
+    BasicBTreeFS(const std::string &filename, int order, const BTreeOptions &options = BTreeOptions());
+    Node openNode(uint64_t ref) const override;
+    //read-only access, zero-copy in mmap mode
+    //views into the mapping are invalidated by allocNode
+    NodeView viewNode(uint64_t ref) const override;
+    //view owning its page also in mmap mode
+    NodeView copyNode(uint64_t ref) const override;
+    //the pages neither cached nor dirty are read from the file all at once
+    std::vector<NodeView> viewNodes(const std::vector<uint64_t> &refs,
+                                    std::vector<bool> &read) const override;
+    //batched reads go through io_uring rather than a thread pool
+    bool usesIoUring() const;
+    //the kernel reads the pages into the page cache,
+    //with direct I/O they are read into the pool
+    void prefetch(std::vector<uint64_t> refs) const override;
+    unsigned readAhead() const override;
+    unsigned bloomBitsPerKey() const override;
+    void saveNode(const Node &node) override;
+    //reuses freed pages before growing the file
+    Node allocNode(bool is_leaf) override;
+    void freeNode(uint64_t ref) override;
+    //gives trailing free pages back to the filesystem
+    uint64_t vacuum() override;
+    //operations are staged per thread; prepare() logs the pages the
+    //calling thread saved and returns the lsn to wait for (0 without a log),
+    //commit(lsn) waits for the log as the durability level requires and
+    //writes dirty pages back once they pass the dirty limit
+    uint64_t prepare() override;
+    void commit(uint64_t lsn) override;
+    using BasicBTreeStorage<Key>::commit;
+    //writes logged pages and the header to the tree file and drops the log
+    void checkpoint() override;
+    uint64_t writeCalls() const;
+    //fallocate calls made to reserve file space
+    uint64_t extentCalls() const;
+    uint64_t logSyncs() const override;
+    int order() const override;
+    //order of the bit-packed leaves, 0 if leaves are plain
+    int leafOrder() const;
+    uint64_t rootRef() const override;
+    void setRootRef(uint64_t root) override;
+    uint64_t treeSize() const override;
+    void setTreeSize(uint64_t tree_size) override;
+    void addTreeSize(int64_t delta) override;
+    int treeHeight() const override;
+    void setTreeHeight(int tree_height) override;
+    uint32_t pageSize() const override;
     uint64_t pagesAllocated() const;
-    ~BTreeFS();
+    uint64_t freePages() const;
+    bool isMapped() const;
+    //true in mmap mode
+    bool writesInPlace() const override;
+    //not supported in mmap mode
+    std::shared_ptr<SnapshotPages> takeSnapshot() const override;
+    NodeView viewNode(const SnapshotPages &snapshot, uint64_t ref) const override;
+    size_t snapshotPages() const override;
+    //fields of the header at the start of a tree file
+    struct Header {
+        uint32_t page_size;
+        uint64_t pages_allocated;
+        uint64_t root_ref;
+        uint64_t tree_size;
+        int tree_height;
+        int order;
+        uint64_t free_head;
+        uint64_t free_pages;
+        int leaf_order;
+        uint32_t first_page;
+        uint32_t key_type;      //TYPE of BTreeKey, 0 in files written before it was kept
+    };
+    static Header parseHeader(const uint8_t *header);
+    static void formatHeader(const Header &fields, uint8_t *header);
+    //pages start right after the header or one page in, files of
+    //earlier formats fail this
+    static bool headerIsValid(const Header &fields);
+    //bytes of the serialized header
+    static uint32_t headerLength();
+    ~BasicBTreeFS();
     static const uint32_t MAX_PAGE_SIZE;
+    static const uint64_t MIN_MAP_SIZE;
+    //order field of a page on the free list
+    static const int FREE_PAGE_MARK = -1;
 private:
+    using BasicBTreeStorage<Key>::_stats;
     void readHeader();
     void writeHeader();
+    void serializeHeader(uint8_t *header) const;
+    void deserializeHeader(const uint8_t *header);
+    void readPage(uint8_t *page, uint64_t ref) const;
+    //pread and pwrite of the tree file, through an aligned buffer when
+    //direct I/O gets memory it can not use
+    bool readAt(uint8_t *data, size_t length, uint64_t offset) const;
+    bool writeAt(const uint8_t *data, size_t length, uint64_t offset);
+    bool isAligned(const uint8_t *data, size_t length, uint64_t offset) const;
+    //writes the header padded to the first page
+    bool writeHeaderPage(const uint8_t *header);
+    void enableDirectIo();
+    //keeps the current image of the page for snapshots that still need it
+    void preserve(uint64_t ref);
+    //saved pages go to the dirty table, not to the file
+    void writePage(const uint8_t *page, uint64_t ref);
+    void markDirty(uint64_t ref, const PagePtr &page, uint64_t lsn);
+    //copies the newest unwritten version of the page if there is one
+    bool readDirty(uint8_t *page, uint64_t ref, size_t length) const;
+    size_t dirtyBytes() const;
+    //writes every dirty page whose log record is durable
+    void writeBack();
+    void startFlusher();
+    void stopFlusher();
+    void flusherLoop();
+    void recover();
+    void writeFreePage(uint64_t ref, uint64_t next);
+    uint64_t readFreeLink(uint64_t ref) const;
+    const uint8_t *pinPage(uint64_t ref) const;
+    //reads pages[missing[j]] of refs in one batch, caching them unless
+    //a page was saved after saves was taken; failed pages are left empty
+    void readPages(const std::vector<uint64_t> &refs, const std::vector<size_t> &missing,
+                   std::vector<std::vector<uint8_t> > &pages, uint64_t saves) const;
+    //reader of batched page reads, made by the first batch
+    BTreeReader &reader() const;
+    void mapFile(uint64_t length);
+    //reserves file space up to at least end, one extent at a time
+    void reserve(uint64_t end);
+    bool allocateExtent(uint64_t offset, uint64_t length, bool keep_size);
     bool refIsValid(uint64_t ref) const;
-    uint32_t headerLength() const;
+    static const uint32_t MIN_FIXED_PAGE_SIZE;
     std::string _filename;
     int _order;
+    int _leaf_order;            //0 keeps leaves in the plain layout
     int _fd;
     uint64_t _root_ref;
-    uint64_t _tree_size;
+    std::atomic<uint64_t> _tree_size;
     int _tree_height;
     uint32_t _page_size;
-    uint64_t _pages_allocated;
-    
+    uint32_t _first_page;       //offset of the first page, a whole page with fixed size pages
+    bool _direct_io;
+    //read by optimistic readers while a writer allocates
+    std::atomic<uint64_t> _pages_allocated;
+    uint64_t _free_head;
+    uint64_t _free_pages;
+    mutable BTreePool _pool;
+    mutable std::mutex _pool_mutex;
+    bool _use_mmap;
+    uint8_t *_map;
+    uint64_t _map_size;
+    struct DirtyPage {
+        PagePtr page;
+        uint64_t lsn;           //log record of the page, 0 without a log
+    };
+    std::unique_ptr<BTreeWal> _wal;
+    uint64_t _checkpoint_size;
+    struct Txn {
+        Txn(): size_delta(0) { }
+        std::map<uint64_t, std::vector<uint8_t> > pages;
+        int64_t size_delta;
+    };
+    //running operations by thread, logged by prepare
+    std::map<std::thread::id, Txn> _txns;
+    mutable std::mutex _txn_mutex;
+    std::mutex _log_mutex;
+    std::vector<uint8_t> _logged_header;
+    //pages newer than the file, ordered so that neighbours coalesce
+    std::map<uint64_t, DirtyPage> _dirty;
+    size_t _dirty_limit;
+    size_t _dirty_bytes;
+    mutable std::mutex _dirty_mutex;
+    //one write-back at a time
+    std::mutex _write_mutex;
+    uint64_t _extent_size;      //0 once fallocate turned out unsupported
+    uint64_t _max_extent_size;
+    uint64_t _reserved_end;
+    bool _use_io_uring;
+    unsigned _io_depth;
+    unsigned _read_ahead;
+    unsigned _bloom_bits_per_key;
+    mutable std::unique_ptr<BTreeReader> _reader;
+    mutable std::mutex _reader_mutex;
+    //changes of pages, a batch read does not cache a page that may have changed meanwhile
+    std::atomic<uint64_t> _page_saves;
+    std::thread _flusher;
+    std::condition_variable _flusher_wakeup;
+    bool _stop_flusher;
+    std::atomic<bool> _flush_failed;
+    //taken by readers, so the list is mutable
+    mutable std::vector<std::weak_ptr<SnapshotPages> > _snapshots;
+    mutable std::mutex _snapshot_mutex;
+    //writers skip the snapshot list while it is empty
+    mutable std::atomic<bool> _has_snapshots;
 };
+
+typedef BasicBTreeFS<int> BTreeFS;
@@ -0,0 +1,19 @@
+#include "btree_key.h"
+
+#include <iomanip>
+#include <ostream>
+
+const uint32_t BTreeKey<int>::TYPE;
+const uint32_t BTreeKey<int64_t>::TYPE;
+const uint32_t BTreeKey<uint64_t>::TYPE;
+const uint32_t BTreeKey<BTreeId>::TYPE;
+const bool BTreeKey<BTreeId>::PACKED;
+
+std::ostream &operator<<(std::ostream &out, const BTreeId &id) {
+    std::ios_base::fmtflags flags = out.flags();
+    char fill = out.fill('0');
+    out << std::hex << std::setw(16) << id.high << std::setw(16) << id.low;
+    out.fill(fill);
+    out.flags(flags);
+    return out;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <iosfwd>
+#include <limits>
+#include <stdexcept>
+#include <stdint.h>
+#include "btree_pack.h"
+#include "btree_search.h"
+
+//16 byte keys such as UUIDs, ordered by high and then low
+struct BTreeId {
+    uint64_t high;
+    uint64_t low;
+};
+
+inline bool operator==(const BTreeId &a, const BTreeId &b) {
+    return a.high == b.high && a.low == b.low;
+}
+
+inline bool operator!=(const BTreeId &a, const BTreeId &b) {
+    return !(a == b);
+}
+
+inline bool operator<(const BTreeId &a, const BTreeId &b) {
+    return a.high < b.high || (a.high == b.high && a.low < b.low);
+}
+
+inline bool operator>(const BTreeId &a, const BTreeId &b) {
+    return b < a;
+}
+
+inline bool operator<=(const BTreeId &a, const BTreeId &b) {
+    return !(b < a);
+}
+
+inline bool operator>=(const BTreeId &a, const BTreeId &b) {
+    return !(a < b);
+}
+
+//hex digits of high and low
+std::ostream &operator<<(std::ostream &out, const BTreeId &id);
+
+//What a tree needs of its key type. Keys are fixed size values stored in
+//pages as they are and ordered by their operators; TYPE goes to the file
+//header, so a file only opens with the key type it was written with.
+//Trees are instantiated for int, int64_t, uint64_t and BTreeId keys.
+template <typename Key>
+struct BTreeKey;
+
+//binary search, bit-packed leaves
+template <typename Key>
+struct BTreeIntegerKey {
+    static Key min() {
+        return std::numeric_limits<Key>::min();
+    }
+    static Key max() {
+        return std::numeric_limits<Key>::max();
+    }
+    //index of the first key not less / greater than key
+    static int lowerBound(const Key *keys, int n, Key key) {
+        return std::lower_bound(keys, keys + n, key) - keys;
+    }
+    static int upperBound(const Key *keys, int n, Key key) {
+        return std::upper_bound(keys, keys + n, key) - keys;
+    }
+    //for the leaf Bloom filters
+    static uint64_t hash(Key key) {
+        uint64_t h = (uint64_t)key;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+    static const bool PACKED = true;
+    static size_t packedSize(const Key *keys, const uint64_t *values, int n) {
+        return BTreePack::packedSize(keys, values, n);
+    }
+    static size_t pack(const Key *keys, const uint64_t *values, int n, uint8_t *out) {
+        return BTreePack::pack(keys, values, n, out);
+    }
+    static void unpack(const uint8_t *in, size_t length, int n, Key *keys, uint64_t *values) {
+        BTreePack::unpack(in, length, n, keys, values);
+    }
+};
+
+template <typename Key>
+const bool BTreeIntegerKey<Key>::PACKED;
+
+//searches with the SIMD compares of BTreeSearch
+template <>
+struct BTreeKey<int>: BTreeIntegerKey<int> {
+    static const uint32_t TYPE = 0;
+    static int lowerBound(const int *keys, int n, int key) {
+        return BTreeSearch::lowerBound(keys, n, key);
+    }
+    static int upperBound(const int *keys, int n, int key) {
+        return BTreeSearch::upperBound(keys, n, key);
+    }
+};
+
+template <>
+struct BTreeKey<int64_t>: BTreeIntegerKey<int64_t> {
+    static const uint32_t TYPE = 1;
+};
+
+template <>
+struct BTreeKey<uint64_t>: BTreeIntegerKey<uint64_t> {
+    static const uint32_t TYPE = 2;
+};
+
+//binary search, leaves stay plain
+template <>
+struct BTreeKey<BTreeId> {
+    static const uint32_t TYPE = 3;
+    static BTreeId min() {
+        return BTreeId{0, 0};
+    }
+    static BTreeId max() {
+        return BTreeId{~(uint64_t)0, ~(uint64_t)0};
+    }
+    static int lowerBound(const BTreeId *keys, int n, BTreeId key) {
+        return std::lower_bound(keys, keys + n, key) - keys;
+    }
+    static int upperBound(const BTreeId *keys, int n, BTreeId key) {
+        return std::upper_bound(keys, keys + n, key) - keys;
+    }
+    static uint64_t hash(BTreeId key) {
+        return BTreeKey<uint64_t>::hash(key.high ^ BTreeKey<uint64_t>::hash(key.low));
+    }
+    static const bool PACKED = false;
+    static size_t packedSize(const BTreeId *, const uint64_t *, int) {
+        throw std::logic_error("Packed leaves need integer keys");
+    }
+    static size_t pack(const BTreeId *, const uint64_t *, int, uint8_t *) {
+        throw std::logic_error("Packed leaves need integer keys");
+    }
+    static void unpack(const uint8_t *, size_t, int, BTreeId *, uint64_t *) {
+        throw std::logic_error("Packed leaves need integer keys");
+    }
+};
+
+//explicit instantiations of a tree class template for every key type,
+//used once in the .cpp defining its members
+#define BTREE_INSTANTIATE(Template) \
+    template class Template<int>; \
+    template class Template<int64_t>; \
+    template class Template<uint64_t>; \
+    template class Template<BTreeId>
@@ -0,0 +1,134 @@
+#include "btree_latch.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+const uint64_t BTreeLatches::CHUNK_BITS;
+const uint64_t BTreeLatches::MAX_CHUNKS;
+const uint64_t BTreeLatches::MIN_DIRECTORY;
+
+BTreeLatches::Directory::Directory(uint64_t size):
+    size(size),
+    chunks(new std::atomic<std::atomic<uint64_t> *>[size]) {
+    for (uint64_t i = 0; i < size; ++i) {
+        chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+BTreeLatches::BTreeLatches(uint32_t page_size):
+    _page_size(page_size) {
+    _directories.emplace_back(new Directory(MIN_DIRECTORY));
+    _directory.store(_directories.back().get());
+}
+
+std::atomic<uint64_t> &BTreeLatches::slot(uint64_t ref) const {
+    //the file header is shorter than a page, so every page gets its own number
+    uint64_t page = ref / _page_size;
+    uint64_t chunk_idx = page >> CHUNK_BITS;
+    Directory *directory = _directory.load(std::memory_order_acquire);
+    std::atomic<uint64_t> *chunk = chunk_idx < directory->size ?
+        directory->chunks[chunk_idx].load(std::memory_order_acquire) : nullptr;
+    if (chunk == nullptr)
+        chunk = growTo(chunk_idx);
+    return chunk[page & ((1 << CHUNK_BITS) - 1)];
+}
+
+std::atomic<uint64_t> *BTreeLatches::growTo(uint64_t chunk_idx) const {
+    if (chunk_idx >= MAX_CHUNKS) {
+        throw std::logic_error("Invalid reference");
+    }
+    std::lock_guard<std::mutex> lock(_grow_mutex);
+    Directory *directory = _directory.load(std::memory_order_acquire);
+    if (chunk_idx >= directory->size) {
+        //chunks move over, the old directory stays for readers still on it
+        std::unique_ptr<Directory> grown(new Directory(std::max(chunk_idx + 1, 2 * directory->size)));
+        for (uint64_t i = 0; i < directory->size; ++i) {
+            grown->chunks[i].store(directory->chunks[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        directory = grown.get();
+        _directories.push_back(std::move(grown));
+        _directory.store(directory, std::memory_order_release);
+    }
+    std::atomic<uint64_t> *chunk = directory->chunks[chunk_idx].load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+        chunk = new std::atomic<uint64_t>[1 << CHUNK_BITS];
+        for (uint64_t i = 0; i < (1 << CHUNK_BITS); ++i) {
+            chunk[i].store(0, std::memory_order_relaxed);
+        }
+        directory->chunks[chunk_idx].store(chunk, std::memory_order_release);
+    }
+    return chunk;
+}
+
+uint64_t BTreeLatches::readLock(uint64_t ref) const {
+    std::atomic<uint64_t> &version = slot(ref);
+    uint64_t value = version.load(std::memory_order_acquire);
+    while (value & 1) {
+        std::this_thread::yield();
+        value = version.load(std::memory_order_acquire);
+    }
+    return value;
+}
+
+bool BTreeLatches::validate(uint64_t ref, uint64_t version) const {
+    //pages are copied under the pool or dirty table mutex, which orders
+    //the copy before this load, so no fence is needed
+    return slot(ref).load(std::memory_order_acquire) == version;
+}
+
+void BTreeLatches::lock(uint64_t ref) {
+    std::atomic<uint64_t> &version = slot(ref);
+    while (true) {
+        uint64_t value = version.load(std::memory_order_acquire);
+        if (!(value & 1) && version.compare_exchange_weak(value, value + 1, std::memory_order_acquire))
+            return;
+        std::this_thread::yield();
+    }
+}
+
+bool BTreeLatches::tryLock(uint64_t ref, uint64_t version) {
+    return slot(ref).compare_exchange_strong(version, version + 1, std::memory_order_acquire);
+}
+
+void BTreeLatches::unlock(uint64_t ref) {
+    slot(ref).fetch_add(1, std::memory_order_release);
+}
+
+BTreeLatches::~BTreeLatches() {
+    //the newest directory holds every chunk
+    Directory *directory = _directory.load();
+    for (uint64_t i = 0; i < directory->size; ++i) {
+        delete[] directory->chunks[i].load();
+    }
+}
+
+BTreeSharedMutex::BTreeSharedMutex() {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    if (pthread_rwlock_init(&_lock, &attr) != 0) {
+        throw std::logic_error("Could not create tree lock");
+    }
+    pthread_rwlockattr_destroy(&attr);
+}
+
+void BTreeSharedMutex::lock() {
+    pthread_rwlock_wrlock(&_lock);
+}
+
+void BTreeSharedMutex::unlock() {
+    pthread_rwlock_unlock(&_lock);
+}
+
+void BTreeSharedMutex::lock_shared() {
+    pthread_rwlock_rdlock(&_lock);
+}
+
+void BTreeSharedMutex::unlock_shared() {
+    pthread_rwlock_unlock(&_lock);
+}
+
+BTreeSharedMutex::~BTreeSharedMutex() {
+    pthread_rwlock_destroy(&_lock);
+}
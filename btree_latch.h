@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+
+//Version latches of pages for optimistic lock coupling.
+//A writer makes the version odd while it holds the latch and the
+//unlock bumps it, so readers copy a page and validate the version
+//afterwards instead of locking. Versions survive page reuse.
+//Versions live in chunks of a directory that both grow with the pages
+//touched, so a small tree keeps only a few kilobytes of them.
+class BTreeLatches {
+public:
+    explicit BTreeLatches(uint32_t page_size);
+    //waits while the page is latched, returns its version
+    uint64_t readLock(uint64_t ref) const;
+    //true if the page did not change since version was read
+    bool validate(uint64_t ref, uint64_t version) const;
+    void lock(uint64_t ref);
+    //latches the page only if it is still at version
+    bool tryLock(uint64_t ref, uint64_t version);
+    void unlock(uint64_t ref);
+    ~BTreeLatches();
+private:
+    static const uint64_t CHUNK_BITS = 12;
+    static const uint64_t MAX_CHUNKS = 1 << 20;
+    static const uint64_t MIN_DIRECTORY = 16;
+    struct Directory {
+        explicit Directory(uint64_t size);
+        uint64_t size;
+        std::unique_ptr<std::atomic<std::atomic<uint64_t> *>[]> chunks;
+    };
+    std::atomic<uint64_t> &slot(uint64_t ref) const;
+    //takes _grow_mutex, allocates the chunk and grows the directory as needed
+    std::atomic<uint64_t> *growTo(uint64_t chunk_idx) const;
+    uint32_t _page_size;
+    mutable std::atomic<Directory *> _directory;
+    //every directory so far, readers may still look at a replaced one
+    mutable std::vector<std::unique_ptr<Directory>> _directories;
+    mutable std::mutex _grow_mutex;
+};
+
+//Writer lock of a tree: writers that change a single leaf share it,
+//structure modifications hold it alone. Exclusive lockers are preferred
+//so that splits are not starved by a stream of leaf writes.
+class BTreeSharedMutex {
+public:
+    BTreeSharedMutex();
+    void lock();
+    void unlock();
+    void lock_shared();
+    void unlock_shared();
+    ~BTreeSharedMutex();
+private:
+    BTreeSharedMutex(const BTreeSharedMutex &);
+    BTreeSharedMutex &operator=(const BTreeSharedMutex &);
+    pthread_rwlock_t _lock;
+};
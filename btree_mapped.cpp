@@ -0,0 +1,153 @@
+#include "btree_mapped.h"
+#include "btree_wal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <stdexcept>
+
+template <typename Key>
+BasicBTreeMapped<Key>::BasicBTreeMapped(const std::string &filename, const BTreeOptions &options):
+    BasicBTreeStorage<Key>(options.latency_stats),
+    _filename(filename),
+    _map(nullptr),
+    _map_size(0) {
+    //replaying a log would write to the tree file
+    struct stat st;
+    if (stat(BTreeWal::logName(filename).c_str(), &st) == 0 && st.st_size > 0) {
+        throw std::logic_error("Tree has a log to recover, open it writable first " + filename);
+    }
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::logic_error("Could not open " + filename);
+    }
+    if (fstat(fd, &st) == -1 || (uint64_t)st.st_size < BasicBTreeFS<Key>::headerLength()) {
+        close(fd);
+        throw std::logic_error("Could not read the header of " + filename);
+    }
+    _map_size = st.st_size;
+    void *map = mmap(nullptr, _map_size, PROT_READ, MAP_SHARED, fd, 0);
+    //the mapping keeps the file
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw std::logic_error("Could not map " + filename);
+    }
+    _map = static_cast<const uint8_t *>(map);
+    _header = BasicBTreeFS<Key>::parseHeader(_map);
+    if (!BasicBTreeFS<Key>::headerIsValid(_header) || _header.key_type != BTreeKey<Key>::TYPE ||
+        _header.first_page + _header.pages_allocated * _header.page_size > _map_size ||
+        !refIsValid(_header.root_ref)) {
+        munmap(const_cast<uint8_t *>(_map), _map_size);
+        throw std::logic_error("Invalid tree file " + filename);
+    }
+}
+
+template <typename Key>
+bool BasicBTreeMapped<Key>::refIsValid(uint64_t ref) const {
+    if (ref < _header.first_page) return false;
+    if (ref >= _header.first_page + _header.pages_allocated * _header.page_size) return false;
+    return (ref - _header.first_page) % _header.page_size == 0;
+}
+
+template <typename Key>
+BasicBTreeNode<Key> BasicBTreeMapped<Key>::openNode(uint64_t ref) const {
+    if (!refIsValid(ref)) {
+        throw std::logic_error("Invalid reference");
+    }
+    return BasicBTreeNode<Key>::deserialize(_map + ref, _header.page_size);
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTreeMapped<Key>::viewNode(uint64_t ref) const {
+    if (!refIsValid(ref)) {
+        throw std::logic_error("Invalid reference");
+    }
+    return BasicBTreeNodeView<Key>(_map + ref, _header.page_size);
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTreeMapped<Key>::copyNode(uint64_t ref) const {
+    if (!refIsValid(ref)) {
+        throw std::logic_error("Invalid reference");
+    }
+    return BasicBTreeNodeView<Key>(std::vector<uint8_t>(_map + ref, _map + ref + _header.page_size));
+}
+
+template <typename Key>
+void BasicBTreeMapped<Key>::saveNode(const BasicBTreeNode<Key> &) {
+    throw std::logic_error("Tree is read-only");
+}
+
+template <typename Key>
+BasicBTreeNode<Key> BasicBTreeMapped<Key>::allocNode(bool) {
+    throw std::logic_error("Tree is read-only");
+}
+
+template <typename Key>
+void BasicBTreeMapped<Key>::freeNode(uint64_t) {
+    throw std::logic_error("Tree is read-only");
+}
+
+template <typename Key>
+int BasicBTreeMapped<Key>::order() const {
+    return _header.order;
+}
+
+template <typename Key>
+uint64_t BasicBTreeMapped<Key>::rootRef() const {
+    return _header.root_ref;
+}
+
+template <typename Key>
+void BasicBTreeMapped<Key>::setRootRef(uint64_t) {
+    throw std::logic_error("Tree is read-only");
+}
+
+template <typename Key>
+uint64_t BasicBTreeMapped<Key>::treeSize() const {
+    return _header.tree_size;
+}
+
+template <typename Key>
+void BasicBTreeMapped<Key>::setTreeSize(uint64_t) {
+    throw std::logic_error("Tree is read-only");
+}
+
+template <typename Key>
+void BasicBTreeMapped<Key>::addTreeSize(int64_t) {
+    throw std::logic_error("Tree is read-only");
+}
+
+template <typename Key>
+int BasicBTreeMapped<Key>::treeHeight() const {
+    return _header.tree_height;
+}
+
+template <typename Key>
+void BasicBTreeMapped<Key>::setTreeHeight(int) {
+    throw std::logic_error("Tree is read-only");
+}
+
+template <typename Key>
+uint32_t BasicBTreeMapped<Key>::pageSize() const {
+    return _header.page_size;
+}
+
+template <typename Key>
+bool BasicBTreeMapped<Key>::writesInPlace() const {
+    return false;
+}
+
+template <typename Key>
+std::shared_ptr<typename BasicBTreeMapped<Key>::SnapshotPages> BasicBTreeMapped<Key>::takeSnapshot() const {
+    return std::make_shared<SnapshotPages>(_header.first_page + _header.pages_allocated * _header.page_size);
+}
+
+template <typename Key>
+BasicBTreeMapped<Key>::~BasicBTreeMapped() {
+    munmap(const_cast<uint8_t *>(_map), _map_size);
+}
+
+BTREE_INSTANTIATE(BasicBTreeMapped);
@@ -0,0 +1,51 @@
+#pragma once
+#include "btree_fs.h"
+#include "btree_node.h"
+#include "btree_node_view.h"
+#include "btree_options.h"
+#include "btree_storage.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//Read-only tree file mapped as a whole. Views point into the mapping and
+//nothing ever changes under them, so readers take no lock, copy nothing
+//and iterators keep the page in place. Writes throw. A file left with a
+//log by a crash has to be opened writable once to recover it first.
+template <typename Key>
+class BasicBTreeMapped: public BasicBTreeStorage<Key> {
+public:
+    typedef BasicBTreeNode<Key> Node;
+    typedef BasicBTreeNodeView<Key> NodeView;
+    typedef typename BasicBTreeStorage<Key>::SnapshotPages SnapshotPages;
+    //of the options only latency_stats applies
+    explicit BasicBTreeMapped(const std::string &filename, const BTreeOptions &options = BTreeOptions());
+    Node openNode(uint64_t ref) const override;
+    NodeView viewNode(uint64_t ref) const override;
+    NodeView copyNode(uint64_t ref) const override;
+    void saveNode(const Node &node) override;
+    Node allocNode(bool is_leaf) override;
+    void freeNode(uint64_t ref) override;
+    int order() const override;
+    uint64_t rootRef() const override;
+    void setRootRef(uint64_t root) override;
+    uint64_t treeSize() const override;
+    void setTreeSize(uint64_t tree_size) override;
+    void addTreeSize(int64_t delta) override;
+    int treeHeight() const override;
+    void setTreeHeight(int tree_height) override;
+    uint32_t pageSize() const override;
+    bool writesInPlace() const override;
+    //the tree never changes, a snapshot is the tree itself
+    std::shared_ptr<SnapshotPages> takeSnapshot() const override;
+    using BasicBTreeStorage<Key>::viewNode;
+    ~BasicBTreeMapped();
+private:
+    bool refIsValid(uint64_t ref) const;
+    std::string _filename;
+    typename BasicBTreeFS<Key>::Header _header;
+    const uint8_t *_map;
+    uint64_t _map_size;
+};
+
+typedef BasicBTreeMapped<int> BTreeMapped;
@@ -0,0 +1,143 @@
+#include "btree_memory.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+template <typename Key>
+BasicBTreeMemory<Key>::BasicBTreeMemory(int order, const BTreeOptions &options):
+    BasicBTreeStorage<Key>(options.latency_stats),
+    _order(order),
+    _root_ref(0),
+    _tree_size(0),
+    _tree_height(0) {
+    if (_order < 1) {
+        throw std::logic_error("Invalid order");
+    }
+}
+
+template <typename Key>
+const BasicBTreeNode<Key> &BasicBTreeMemory<Key>::node(uint64_t ref) const {
+    if (ref == 0 || ref > _nodes.size() || !_nodes[ref - 1]) {
+        throw std::logic_error("Invalid reference");
+    }
+    return *_nodes[ref - 1];
+}
+
+template <typename Key>
+BasicBTreeNode<Key> BasicBTreeMemory<Key>::openNode(uint64_t ref) const {
+    return node(ref);
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTreeMemory<Key>::viewNode(uint64_t ref) const {
+    return BasicBTreeNodeView<Key>(node(ref));
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTreeMemory<Key>::copyNode(uint64_t ref) const {
+    const BasicBTreeNode<Key> &copied = node(ref);
+    std::vector<uint8_t> page(BasicBTreeNode<Key>::maxNodeSerializationSize(copied.order()));
+    copied.serialize(page.data());
+    return BasicBTreeNodeView<Key>(std::move(page));
+}
+
+template <typename Key>
+void BasicBTreeMemory<Key>::saveNode(const BasicBTreeNode<Key> &saved) {
+    //the slot keeps its arrays where they fit, views of other nodes stay put
+    *_nodes.at(saved.ref() - 1) = saved;
+}
+
+template <typename Key>
+BasicBTreeNode<Key> BasicBTreeMemory<Key>::allocNode(bool is_leaf) {
+    uint64_t ref;
+    if (!_free.empty()) {
+        ref = _free.back();
+        _free.pop_back();
+        _stats.add(BTreeStats::PAGES_REUSED);
+    }
+    else {
+        _nodes.push_back(nullptr);
+        ref = _nodes.size();
+        _stats.add(BTreeStats::PAGES_APPENDED);
+    }
+    _nodes[ref - 1].reset(new BasicBTreeNode<Key>(_order, ref, is_leaf));
+    return *_nodes[ref - 1];
+}
+
+template <typename Key>
+void BasicBTreeMemory<Key>::freeNode(uint64_t ref) {
+    node(ref);
+    _nodes[ref - 1].reset();
+    _free.push_back(ref);
+    _stats.add(BTreeStats::PAGES_FREED);
+}
+
+template <typename Key>
+uint64_t BasicBTreeMemory<Key>::vacuum() {
+    uint64_t dropped = 0;
+    while (!_nodes.empty() && !_nodes.back()) {
+        _nodes.pop_back();
+        ++dropped;
+    }
+    uint64_t end = _nodes.size();
+    _free.erase(std::remove_if(_free.begin(), _free.end(),
+                               [end](uint64_t ref) { return ref > end; }), _free.end());
+    return dropped;
+}
+
+template <typename Key>
+int BasicBTreeMemory<Key>::order() const {
+    return _order;
+}
+
+template <typename Key>
+uint64_t BasicBTreeMemory<Key>::rootRef() const {
+    return _root_ref;
+}
+
+template <typename Key>
+void BasicBTreeMemory<Key>::setRootRef(uint64_t root) {
+    _root_ref = root;
+}
+
+template <typename Key>
+uint64_t BasicBTreeMemory<Key>::treeSize() const {
+    return _tree_size;
+}
+
+template <typename Key>
+void BasicBTreeMemory<Key>::setTreeSize(uint64_t tree_size) {
+    _tree_size = tree_size;
+}
+
+template <typename Key>
+void BasicBTreeMemory<Key>::addTreeSize(int64_t delta) {
+    _tree_size += delta;
+}
+
+template <typename Key>
+int BasicBTreeMemory<Key>::treeHeight() const {
+    return _tree_height;
+}
+
+template <typename Key>
+void BasicBTreeMemory<Key>::setTreeHeight(int tree_height) {
+    _tree_height = tree_height;
+}
+
+template <typename Key>
+uint32_t BasicBTreeMemory<Key>::pageSize() const {
+    return 1;
+}
+
+template <typename Key>
+bool BasicBTreeMemory<Key>::writesInPlace() const {
+    return true;
+}
+
+template <typename Key>
+uint64_t BasicBTreeMemory<Key>::nodes() const {
+    return _nodes.size() - _free.size();
+}
+
+BTREE_INSTANTIATE(BasicBTreeMemory);
@@ -0,0 +1,56 @@
+#pragma once
+#include "btree_node.h"
+#include "btree_node_view.h"
+#include "btree_options.h"
+#include "btree_storage.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+//Nodes kept as they are in an arena, nothing is serialized or copied.
+//Views point at the arrays of the live nodes, so the storage writes in
+//place and readers of its tree shut writers out. A ref is the slot of
+//the node plus one with a page size of 1, which keeps the latch table
+//indexed by slot. Freed slots are reused first.
+template <typename Key>
+class BasicBTreeMemory: public BasicBTreeStorage<Key> {
+public:
+    typedef BasicBTreeNode<Key> Node;
+    typedef BasicBTreeNodeView<Key> NodeView;
+    //of the options only latency_stats applies
+    explicit BasicBTreeMemory(int order, const BTreeOptions &options = BTreeOptions());
+    Node openNode(uint64_t ref) const override;
+    NodeView viewNode(uint64_t ref) const override;
+    using BasicBTreeStorage<Key>::viewNode;
+    NodeView copyNode(uint64_t ref) const override;
+    void saveNode(const Node &node) override;
+    Node allocNode(bool is_leaf) override;
+    void freeNode(uint64_t ref) override;
+    //drops trailing free slots
+    uint64_t vacuum() override;
+    int order() const override;
+    uint64_t rootRef() const override;
+    void setRootRef(uint64_t root) override;
+    uint64_t treeSize() const override;
+    void setTreeSize(uint64_t tree_size) override;
+    void addTreeSize(int64_t delta) override;
+    int treeHeight() const override;
+    void setTreeHeight(int tree_height) override;
+    uint32_t pageSize() const override;
+    bool writesInPlace() const override;
+    //slots holding a node
+    uint64_t nodes() const;
+private:
+    using BasicBTreeStorage<Key>::_stats;
+    const Node &node(uint64_t ref) const;
+    int _order;
+    uint64_t _root_ref;
+    std::atomic<uint64_t> _tree_size;
+    int _tree_height;
+    //slot ref - 1 holds the node of ref, nullptr while free
+    std::vector<std::unique_ptr<Node> > _nodes;
+    std::vector<uint64_t> _free;
+};
+
+typedef BasicBTreeMemory<int> BTreeMemory;
@@ -1,146 +1,266 @@
 #include "btree_node.h"
 
 #include <algorithm>
-#include <iterator>
-#include <iostream>
+#include <stdexcept>
 
 #include <string.h>
 
-BTreeNode::BTreeNode(int order, uint64_t ref, bool is_leaf):
+template <typename Key>
+BasicBTreeNode<Key>::BasicBTreeNode(int order, uint64_t ref, bool is_leaf):
     _order(order),
     _keys_num(0),
     _ref(ref),
     _is_leaf(is_leaf),
+    _packed_page_size(0),
     _sentinel(0),
-    _keys() { }
+    _left_sibling(0),
+    _right_sibling(0),
+    _keys(),
+    _children() {
+    _keys.reserve(order + 1);
+    _children.reserve(order + 1);
+}
 
-BTreeNode::BTreeNode(BTreeNode &&that): 
+template <typename Key>
+BasicBTreeNode<Key>::BasicBTreeNode(BasicBTreeNode<Key> &&that) noexcept:
     _order(that._order),
     _keys_num(that._keys_num),
     _ref(that._ref),
     _is_leaf(that._is_leaf),
-    _sentinel(that._sentinel)
+    _packed_page_size(that._packed_page_size),
+    _sentinel(that._sentinel),
+    _left_sibling(that._left_sibling),
+    _right_sibling(that._right_sibling)
 {
     std::swap(_keys, that._keys);
+    std::swap(_children, that._children);
 }
 
-bool operator==(const BTreeNode &left, const BTreeNode &right) {
+template <typename Key>
+bool operator==(const BasicBTreeNode<Key> &left, const BasicBTreeNode<Key> &right) {
     if (left._order != right._order) return false;
     if (left._keys_num != right._keys_num) return false;
     if (left._ref != right._ref) return false;
     if (left._is_leaf != right._is_leaf) return false;
+    if (left._packed_page_size != right._packed_page_size) return false;
     if (left._sentinel != right._sentinel) return false;
-    return left._keys == right._keys;
+    if (left._left_sibling != right._left_sibling) return false;
+    if (left._right_sibling != right._right_sibling) return false;
+    return left._keys == right._keys && left._children == right._children;
+}
+
+template <typename Key>
+int BasicBTreeNode<Key>::lowerBound(Key key) const {
+    return BTreeKey<Key>::lowerBound(_keys.data(), _keys.size(), key);
 }
 
+template <typename Key>
+int BasicBTreeNode<Key>::upperBound(Key key) const {
+    return BTreeKey<Key>::upperBound(_keys.data(), _keys.size(), key);
+}
 
-uint64_t BTreeNode::next(int key) const {
-    auto it = _keys.upper_bound(key);
-    if (it != _keys.begin()) {
-        return (--it)->second;
+template <typename Key>
+int BasicBTreeNode<Key>::find(Key key) const {
+    int idx = lowerBound(key);
+    if (idx == (int)_keys.size() || _keys[idx] != key)
+        return -1;
+    return idx;
+}
+
+template <typename Key>
+uint64_t BasicBTreeNode<Key>::next(Key key) const {
+    int idx = upperBound(key);
+    if (idx != 0) {
+        return _children[idx - 1];
     }
     return _sentinel;
 }
 
-void BTreeNode::put(int key) {
-    if (_keys.find(key) != _keys.end()) {
+template <typename Key>
+void BasicBTreeNode<Key>::put(Key key, uint64_t value) {
+    int idx = lowerBound(key);
+    if (idx != (int)_keys.size() && _keys[idx] == key) {
         throw std::logic_error("Key already exists");
     }
-    
-    _keys[key] = 0;
+    _keys.insert(_keys.begin() + idx, key);
+    _children.insert(_children.begin() + idx, value);
     ++_keys_num;
 }
 
-void BTreeNode::put(const BTreeNode &node) {
-    _keys[node.minKey()] = node.ref();
+template <typename Key>
+void BasicBTreeNode<Key>::put(const BasicBTreeNode<Key> &node) {
+    addChild(node.minKey(), node.ref());
     ++_keys_num;
 }
 
-std::map<int, uint64_t> BTreeNode::keys() const {
+template <typename Key>
+const std::vector<Key> &BasicBTreeNode<Key>::keys() const {
     return _keys;
 }
 
-void BTreeNode::removeKey(int key) {
-    auto it = _keys.find(key);
-    if (it == _keys.end())
+template <typename Key>
+const std::vector<uint64_t> &BasicBTreeNode<Key>::children() const {
+    return _children;
+}
+
+template <typename Key>
+Key BasicBTreeNode<Key>::key(int idx) const {
+    return _keys[idx];
+}
+
+template <typename Key>
+uint64_t BasicBTreeNode<Key>::child(int idx) const {
+    return _children[idx];
+}
+
+template <typename Key>
+void BasicBTreeNode<Key>::removeKey(Key key) {
+    int idx = find(key);
+    if (idx == -1)
         throw std::logic_error("Invalid key");
-    _keys.erase(it);
+    _keys.erase(_keys.begin() + idx);
+    _children.erase(_children.begin() + idx);
     --_keys_num;
 }
 
-int BTreeNode::order() const {
+template <typename Key>
+int BasicBTreeNode<Key>::order() const {
     return _order;
 }
 
-int BTreeNode::keysNum() const {
+template <typename Key>
+int BasicBTreeNode<Key>::keysNum() const {
     return _keys_num;
 }
 
-bool BTreeNode::isFull() const {
-    return _keys_num > _order;
+template <typename Key>
+bool BasicBTreeNode<Key>::isFull() const {
+    return _keys_num > _order || (_packed_page_size != 0 && packedSize(0, _keys_num) > _packed_page_size);
 }
 
-uint64_t BTreeNode::ref() const {
+template <typename Key>
+uint64_t BasicBTreeNode<Key>::ref() const {
     return _ref;
 }
 
-bool BTreeNode::isLeaf() const {
+template <typename Key>
+bool BasicBTreeNode<Key>::isLeaf() const {
     return _is_leaf;
 }
 
-uint64_t BTreeNode::sentinel() const {
+template <typename Key>
+uint64_t BasicBTreeNode<Key>::sentinel() const {
     return _sentinel;
 }
 
-int BTreeNode::minKey() const {
+template <typename Key>
+uint64_t BasicBTreeNode<Key>::leftSibling() const {
+    return _left_sibling;
+}
+
+template <typename Key>
+uint64_t BasicBTreeNode<Key>::rightSibling() const {
+    return _right_sibling;
+}
+
+template <typename Key>
+Key BasicBTreeNode<Key>::minKey() const {
     if (_keys_num > 0)
-        return _keys.begin()->first;
+        return _keys.front();
     else 
         throw std::logic_error("Ivalid node operation");
 }
 
-int BTreeNode::maxKey() const {
+template <typename Key>
+Key BasicBTreeNode<Key>::maxKey() const {
     if (_keys_num > 0) 
-        return _keys.rbegin()->first;
+        return _keys.back();
     else
         throw std::logic_error("Invalid node operation");
 }
 
-bool BTreeNode::contains(int key) const {
-    return _keys.find(key) != _keys.end();
+template <typename Key>
+bool BasicBTreeNode<Key>::contains(Key key) const {
+    return find(key) != -1;
 }
 
-void BTreeNode::setIsLeaf(bool is_leaf) {
+template <typename Key>
+void BasicBTreeNode<Key>::setIsLeaf(bool is_leaf) {
     _is_leaf = is_leaf;
 }
 
-int BTreeNode::serialize(uint8_t *page) const {
+template <typename Key>
+void BasicBTreeNode<Key>::setPacked(int page_size) {
+    _packed_page_size = page_size;
+}
+
+template <typename Key>
+bool BasicBTreeNode<Key>::isPacked() const {
+    return _packed_page_size != 0;
+}
+
+template <typename Key>
+int BasicBTreeNode<Key>::packedPageSize() const {
+    return _packed_page_size;
+}
+
+template <typename Key>
+int BasicBTreeNode<Key>::packedSize(int from, int to) const {
+    return HEADER_SIZE + BTreeKey<Key>::packedSize(_keys.data() + from, _children.data() + from, to - from);
+}
+
+template <typename Key>
+int BasicBTreeNode<Key>::serialize(uint8_t *page) const {
     int offset = 0;
     memcpy(page + offset, &_order, sizeof(_order));
     offset += sizeof(_order);
     memcpy(page + offset, &_keys_num, sizeof(_keys_num));
-    offset += sizeof(_order);
+    offset += sizeof(_keys_num);
     memcpy(page + offset, &_ref, sizeof(_ref));
     offset += sizeof(_ref);
-    memcpy(page + offset, &_is_leaf, sizeof(_is_leaf));
-    offset += sizeof(_is_leaf);
     memcpy(page + offset, &_sentinel, sizeof(_sentinel));
     offset += sizeof(_sentinel);
-    for (std::pair<int, uint64_t> pair: _keys) {
-        memcpy(page + offset, &pair.first, sizeof(pair.first));
-        offset += sizeof(pair.first);
-        memcpy(page + offset, &pair.second, sizeof(pair.second));
-        offset += sizeof(pair.second);
+    memcpy(page + offset, &_left_sibling, sizeof(_left_sibling));
+    offset += sizeof(_left_sibling);
+    memcpy(page + offset, &_right_sibling, sizeof(_right_sibling));
+    offset += sizeof(_right_sibling);
+    memcpy(page + offset, &_is_leaf, sizeof(_is_leaf));
+    offset += sizeof(_is_leaf);
+    memset(page + offset, 0, HEADER_SIZE - offset);
+    if (_packed_page_size != 0) {
+        //full nodes are split before they are saved, so this is a bug
+        if (packedSize(0, _keys_num) > _packed_page_size) {
+            throw std::logic_error("Packed node does not fit its page");
+        }
+        page[offset] = 1;
+        int size = HEADER_SIZE + BTreeKey<Key>::pack(_keys.data(), _children.data(), _keys_num, page + HEADER_SIZE);
+        memset(page + size, 0, _packed_page_size - size);
+        return _packed_page_size;
     }
-    return offset;
+    memcpy(page + HEADER_SIZE, _keys.data(), _keys.size() * sizeof(Key));
+    offset = childrenOffset(_order);
+    memcpy(page + offset, _children.data(), _children.size() * sizeof(uint64_t));
+    return maxNodeSerializationSize(_order);
+}
+
+template <typename Key>
+int BasicBTreeNode<Key>::maxOrder(uint32_t page_size) {
+    //padding may cost one more entry
+    int order = ((int)page_size - HEADER_SIZE) / (sizeof(Key) + sizeof(uint64_t));
+    while (order > 0 && maxNodeSerializationSize(order) > (int)page_size)
+        --order;
+    return order;
 }
 
-BTreeNode BTreeNode::deserialize(const uint8_t *page, int page_size) {
+template <typename Key>
+BasicBTreeNode<Key> BasicBTreeNode<Key>::deserialize(const uint8_t *page, int page_size) {
     int order;
     int keys_num;
     uint64_t ref;
     bool is_leaf;
     uint64_t sentinel;
+    uint64_t left_sibling;
+    uint64_t right_sibling;
     int offset = 0;
     memcpy(&order, page + offset, sizeof(order));
     offset += sizeof(order);
@@ -148,63 +268,132 @@ BTreeNode BTreeNode::deserialize(const uint8_t *page, int page_size) {
     offset += sizeof(keys_num);
     memcpy(&ref, page + offset, sizeof(ref));
     offset += sizeof(ref);
-    memcpy(&is_leaf, page + offset, sizeof(is_leaf));
-    offset += sizeof(is_leaf);
     memcpy(&sentinel, page + offset, sizeof(sentinel));
     offset += sizeof(sentinel);
-    BTreeNode node(order, ref, is_leaf);
+    memcpy(&left_sibling, page + offset, sizeof(left_sibling));
+    offset += sizeof(left_sibling);
+    memcpy(&right_sibling, page + offset, sizeof(right_sibling));
+    offset += sizeof(right_sibling);
+    memcpy(&is_leaf, page + offset, sizeof(is_leaf));
+    offset += sizeof(is_leaf);
+    bool packed = page[offset] != 0;
+
+    if (order < 0 || keys_num < 0 || keys_num > order + 1 ||
+        (!packed && maxNodeSerializationSize(order) > page_size))
+        throw std::logic_error("Deserialization error");
+    BasicBTreeNode node(order, ref, is_leaf);
     node.setSentinel(sentinel);
+    node.setLeftSibling(left_sibling);
+    node.setRightSibling(right_sibling);
     node.setKeysNum(keys_num);
-    for (int i = 0; i < keys_num; i++) {
-        int key;
-        memcpy(&key, page + offset, sizeof(key));
-        offset += sizeof(key);
-        uint64_t child;
-        memcpy(&child, page + offset, sizeof(child));
-        offset += sizeof(child);
-        node.addChild(key, child);
+    node._keys.resize(keys_num);
+    if (packed) {
+        node.setPacked(page_size);
+        node._children.resize(keys_num);
+        BTreeKey<Key>::unpack(page + HEADER_SIZE, page_size - HEADER_SIZE, keys_num,
+                          node._keys.data(), node._children.data());
+        return node;
     }
-
-    if (offset > page_size)
-        throw std::logic_error("Deserialization error");
+    memcpy(node._keys.data(), page + HEADER_SIZE, keys_num * sizeof(Key));
+    node._children.resize(keys_num);
+    memcpy(node._children.data(), page + childrenOffset(order), keys_num * sizeof(uint64_t));
     return node;
 }
 
-int BTreeNode::maxNodeSerializationSize(int order) {
-    int size = sizeof(int);                     //order
-    size += sizeof(int);                        //keys_num
-    size += sizeof(uint64_t);                   //ref
-    size += sizeof(bool);                       //is_leaf
-    size += sizeof(uint64_t);                   //sentinel
-    size += (order + 1) * sizeof(int);                //keys
-    size += (order + 1) * sizeof(uint64_t);           //children
-    return size;
+template <typename Key>
+void BasicBTreeNode<Key>::setSentinel(uint64_t sentinel) {
+    _sentinel = sentinel;
+}
+
+template <typename Key>
+void BasicBTreeNode<Key>::setLeftSibling(uint64_t ref) {
+    _left_sibling = ref;
 }
 
-void BTreeNode::setSentinel(uint64_t sentinel) {
-    _sentinel = sentinel;
+template <typename Key>
+void BasicBTreeNode<Key>::setRightSibling(uint64_t ref) {
+    _right_sibling = ref;
 }
 
-void BTreeNode::addChild(int key, uint64_t child) {
-    _keys[key] = child;
+template <typename Key>
+void BasicBTreeNode<Key>::addChild(Key key, uint64_t child) {
+    //appending in key order is the common case during merges
+    if (_keys.empty() || _keys.back() < key) {
+        _keys.push_back(key);
+        _children.push_back(child);
+        return;
+    }
+    int idx = lowerBound(key);
+    if (_keys[idx] == key) {
+        _children[idx] = child;
+        return;
+    }
+    _keys.insert(_keys.begin() + idx, key);
+    _children.insert(_children.begin() + idx, child);
 }
 
-void BTreeNode::setKeysNum(int keys_num) {
+template <typename Key>
+void BasicBTreeNode<Key>::addChildren(const Key *keys, const uint64_t *children, int n) {
+    std::vector<Key> merged_keys;
+    std::vector<uint64_t> merged_children;
+    merged_keys.reserve(std::max((int)_keys.size() + n, _order + 1));
+    merged_children.reserve(merged_keys.capacity());
+    size_t i = 0;
+    int j = 0;
+    while (i < _keys.size() || j < n) {
+        if (j == n || (i < _keys.size() && _keys[i] < keys[j])) {
+            merged_keys.push_back(_keys[i]);
+            merged_children.push_back(_children[i]);
+            ++i;
+        }
+        else {
+            merged_keys.push_back(keys[j]);
+            merged_children.push_back(children[j]);
+            ++j;
+        }
+    }
+    _keys.swap(merged_keys);
+    _children.swap(merged_children);
+    _keys_num += n;
+}
+
+template <typename Key>
+void BasicBTreeNode<Key>::moveTail(BasicBTreeNode<Key> &to, int count) {
+    int from = _keys.size() - count;
+    to._keys.insert(to._keys.begin(), _keys.begin() + from, _keys.end());
+    to._children.insert(to._children.begin(), _children.begin() + from, _children.end());
+    to._keys_num += count;
+    _keys.resize(from);
+    _children.resize(from);
+    _keys_num -= count;
+}
+
+template <typename Key>
+void BasicBTreeNode<Key>::setKeysNum(int keys_num) {
     _keys_num = keys_num;
 }
 
-uint64_t BTreeNode::nextChild(int key) const {
-    auto it = _keys.find(key);
-    if (it == _keys.end())
+template <typename Key>
+uint64_t BasicBTreeNode<Key>::nextChild(Key key) const {
+    int idx = find(key);
+    if (idx == -1 || idx + 1 == (int)_keys.size())
         return 0;
-    if (std::distance(it, _keys.end()) == 1)
-        return 0;
-    return (++it)->second;
+    return _children[idx + 1];
 }
 
-uint64_t BTreeNode::prevChild(int key) const {    
-    auto it = _keys.find(key);
-    if (it == _keys.end() || it == _keys.begin())
+template <typename Key>
+uint64_t BasicBTreeNode<Key>::prevChild(Key key) const {    
+    int idx = find(key);
+    if (idx <= 0)
         return 0;
-    return (--it)->second;
+    return _children[idx - 1];
 }
+
+template <typename Key>
+const int BasicBTreeNode<Key>::HEADER_SIZE;
+
+BTREE_INSTANTIATE(BasicBTreeNode);
+template bool operator==(const BasicBTreeNode<int> &, const BasicBTreeNode<int> &);
+template bool operator==(const BasicBTreeNode<int64_t> &, const BasicBTreeNode<int64_t> &);
+template bool operator==(const BasicBTreeNode<uint64_t> &, const BasicBTreeNode<uint64_t> &);
+template bool operator==(const BasicBTreeNode<BTreeId> &, const BasicBTreeNode<BTreeId> &);
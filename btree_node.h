@@ -1,44 +1,95 @@
 #pragma once
 #include <stdint.h>
-#include <map>
 #include <vector>
+#include "btree_key.h"
 
-class BTreeNode {
+template <typename Key>
+class BasicBTreeNode;
+
+template <typename Key>
+bool operator==(const BasicBTreeNode<Key> &, const BasicBTreeNode<Key> &);
+
+//Keys are of one of the types of BTreeKey, BTreeNode keeps int keys.
+template <typename Key>
+class BasicBTreeNode {
 public:
-    BTreeNode(int order, uint64_t ref, bool is_leaf);
-    BTreeNode(BTreeNode &&);
-    friend bool operator==(const BTreeNode &, const BTreeNode &);
-    void put(int key);
-    void put(const BTreeNode &node);
-    uint64_t next(int key) const;
-    std::map<int, uint64_t> keys() const;
-    void removeKey(int key);
+    BasicBTreeNode(int order, uint64_t ref, bool is_leaf);
+    BasicBTreeNode(const BasicBTreeNode &) = default;
+    BasicBTreeNode(BasicBTreeNode &&) noexcept;
+    BasicBTreeNode &operator=(const BasicBTreeNode &) = default;
+    BasicBTreeNode &operator=(BasicBTreeNode &&) = default;
+    friend bool operator== <>(const BasicBTreeNode &, const BasicBTreeNode &);
+    //leaves keep a value in the child slot of each key
+    void put(Key key, uint64_t value = 0);
+    void put(const BasicBTreeNode &node);
+    uint64_t next(Key key) const;
+    const std::vector<Key> &keys() const;
+    const std::vector<uint64_t> &children() const;
+    Key key(int idx) const;
+    uint64_t child(int idx) const;
+    //index of the first key not less / greater than key
+    int lowerBound(Key key) const;
+    int upperBound(Key key) const;
+    void removeKey(Key key);
     int order() const;
     int keysNum() const;
+    //over order keys, or a packed node that no longer fits its page
     bool isFull() const;
     uint64_t ref() const;
     bool isLeaf() const;
     uint64_t sentinel() const;
-    int minKey() const;
-    int maxKey() const;
-    bool contains(int key) const;
+    //neighbours on the same level, 0 at the edges
+    uint64_t leftSibling() const;
+    uint64_t rightSibling() const;
+    Key minKey() const;
+    Key maxKey() const;
+    bool contains(Key key) const;
 
-    uint64_t nextChild(int key) const;
-    uint64_t prevChild(int key) const;
+    uint64_t nextChild(Key key) const;
+    uint64_t prevChild(Key key) const;
     void setIsLeaf(bool is_leaf);
+    //stores the entries bit-packed in a page of page_size bytes
+    void setPacked(int page_size);
+    bool isPacked() const;
+    int packedPageSize() const;
+    //page bytes keys [from, to) would take in a packed node
+    int packedSize(int from, int to) const;
     void setSentinel(uint64_t child);
+    void setLeftSibling(uint64_t ref);
+    void setRightSibling(uint64_t ref);
     void setKeysNum(int keys_num);
-    void addChild(int key, uint64_t child);
+    void addChild(Key key, uint64_t child);
+    //merges n sorted keys which are not in the node yet
+    void addChildren(const Key *keys, const uint64_t *children, int n);
+    //moves count greatest keys with their children to the empty node to
+    void moveTail(BasicBTreeNode &to, int count);
     int serialize(uint8_t *page) const;
-    static BTreeNode deserialize(const uint8_t *page, int page_size);
-    static int maxNodeSerializationSize(int order);
+    static BasicBTreeNode deserialize(const uint8_t *page, int page_size);
+    //page layout: fixed header, then keys and children as contiguous arrays,
+    //or the blocks of BTreePack in a packed node
+    static const int HEADER_SIZE = 48;
+    //largest order whose nodes fit in page_size bytes
+    static int maxOrder(uint32_t page_size);
+    static constexpr int maxNodeSerializationSize(int order) {
+        return childrenOffset(order) + (order + 1) * sizeof(uint64_t);
+    }
+    //children are kept 8 byte aligned
+    static constexpr int childrenOffset(int order) {
+        return (HEADER_SIZE + (order + 1) * sizeof(Key) + sizeof(uint64_t) - 1)
+            / sizeof(uint64_t) * sizeof(uint64_t);
+    }
 private:
+    int find(Key key) const;
     int _order;
     int _keys_num;
     uint64_t _ref;
     bool _is_leaf;
+    int _packed_page_size;      //0 for the plain layout
     uint64_t _sentinel;
-    std::map<int, uint64_t> _keys;
+    uint64_t _left_sibling;
+    uint64_t _right_sibling;
+    std::vector<Key> _keys;
+    std::vector<uint64_t> _children;
 };
 
-
+typedef BasicBTreeNode<int> BTreeNode;
@@ -0,0 +1,189 @@
+#include "btree_node_view.h"
+#include "btree_node.h"
+
+#include <stdexcept>
+
+#include <string.h>
+
+template <typename Key>
+BasicBTreeNodeView<Key>::BasicBTreeNodeView():
+    _buffer(),
+    _unpacked_keys(),
+    _unpacked_children(),
+    _order(0),
+    _keys_num(0),
+    _ref(0),
+    _is_leaf(true),
+    _packed(false),
+    _sentinel(0),
+    _left_sibling(0),
+    _right_sibling(0),
+    _keys(nullptr),
+    _children(nullptr) { }
+
+template <typename Key>
+BasicBTreeNodeView<Key>::BasicBTreeNodeView(const uint8_t *page, int page_size):
+    _buffer() {
+    parse(page, page_size);
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key>::BasicBTreeNodeView(std::vector<uint8_t> &&page):
+    _buffer(std::move(page)) {
+    parse(_buffer.data(), _buffer.size());
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key>::BasicBTreeNodeView(const BasicBTreeNode<Key> &node):
+    _buffer(),
+    _unpacked_keys(),
+    _unpacked_children(),
+    _order(node.order()),
+    _keys_num(node.keysNum()),
+    _ref(node.ref()),
+    _is_leaf(node.isLeaf()),
+    _packed(node.isPacked()),
+    _sentinel(node.sentinel()),
+    _left_sibling(node.leftSibling()),
+    _right_sibling(node.rightSibling()),
+    _keys(node.keys().data()),
+    _children(node.children().data()) { }
+
+template <typename Key>
+void BasicBTreeNodeView<Key>::parse(const uint8_t *page, int page_size) {
+    //same header layout as BTreeNode::serialize
+    int offset = 0;
+    memcpy(&_order, page + offset, sizeof(_order));
+    offset += sizeof(_order);
+    memcpy(&_keys_num, page + offset, sizeof(_keys_num));
+    offset += sizeof(_keys_num);
+    memcpy(&_ref, page + offset, sizeof(_ref));
+    offset += sizeof(_ref);
+    memcpy(&_sentinel, page + offset, sizeof(_sentinel));
+    offset += sizeof(_sentinel);
+    memcpy(&_left_sibling, page + offset, sizeof(_left_sibling));
+    offset += sizeof(_left_sibling);
+    memcpy(&_right_sibling, page + offset, sizeof(_right_sibling));
+    offset += sizeof(_right_sibling);
+    memcpy(&_is_leaf, page + offset, sizeof(_is_leaf));
+    offset += sizeof(_is_leaf);
+    _packed = page[offset] != 0;
+    if (_order < 0 || _keys_num < 0 || _keys_num > _order + 1 ||
+        (!_packed && BasicBTreeNode<Key>::maxNodeSerializationSize(_order) > page_size))
+        throw std::logic_error("Deserialization error");
+    if (_packed) {
+        _unpacked_keys.resize(_keys_num);
+        _unpacked_children.resize(_keys_num);
+        BTreeKey<Key>::unpack(page + BasicBTreeNode<Key>::HEADER_SIZE, page_size - BasicBTreeNode<Key>::HEADER_SIZE, _keys_num,
+                          _unpacked_keys.data(), _unpacked_children.data());
+        _keys = _unpacked_keys.data();
+        _children = _unpacked_children.data();
+        return;
+    }
+    //pages are 8 byte aligned, so both arrays are naturally aligned
+    _keys = reinterpret_cast<const Key *>(page + BasicBTreeNode<Key>::HEADER_SIZE);
+    _children = reinterpret_cast<const uint64_t *>(page + BasicBTreeNode<Key>::childrenOffset(_order));
+}
+
+template <typename Key>
+uint64_t BasicBTreeNodeView<Key>::next(Key key) const {
+    int idx = upperBound(key);
+    if (idx != 0) {
+        return _children[idx - 1];
+    }
+    return _sentinel;
+}
+
+template <typename Key>
+const Key *BasicBTreeNodeView<Key>::keys() const {
+    return _keys;
+}
+
+template <typename Key>
+Key BasicBTreeNodeView<Key>::key(int idx) const {
+    return _keys[idx];
+}
+
+template <typename Key>
+uint64_t BasicBTreeNodeView<Key>::child(int idx) const {
+    return _children[idx];
+}
+
+template <typename Key>
+int BasicBTreeNodeView<Key>::lowerBound(Key key) const {
+    return BTreeKey<Key>::lowerBound(_keys, _keys_num, key);
+}
+
+template <typename Key>
+int BasicBTreeNodeView<Key>::upperBound(Key key) const {
+    return BTreeKey<Key>::upperBound(_keys, _keys_num, key);
+}
+
+template <typename Key>
+int BasicBTreeNodeView<Key>::order() const {
+    return _order;
+}
+
+template <typename Key>
+int BasicBTreeNodeView<Key>::keysNum() const {
+    return _keys_num;
+}
+
+template <typename Key>
+bool BasicBTreeNodeView<Key>::isFull() const {
+    return _keys_num > _order;
+}
+
+template <typename Key>
+bool BasicBTreeNodeView<Key>::isPacked() const {
+    return _packed;
+}
+
+template <typename Key>
+uint64_t BasicBTreeNodeView<Key>::ref() const {
+    return _ref;
+}
+
+template <typename Key>
+bool BasicBTreeNodeView<Key>::isLeaf() const {
+    return _is_leaf;
+}
+
+template <typename Key>
+uint64_t BasicBTreeNodeView<Key>::sentinel() const {
+    return _sentinel;
+}
+
+template <typename Key>
+uint64_t BasicBTreeNodeView<Key>::leftSibling() const {
+    return _left_sibling;
+}
+
+template <typename Key>
+uint64_t BasicBTreeNodeView<Key>::rightSibling() const {
+    return _right_sibling;
+}
+
+template <typename Key>
+Key BasicBTreeNodeView<Key>::minKey() const {
+    if (_keys_num > 0)
+        return _keys[0];
+    else
+        throw std::logic_error("Invalid node operation");
+}
+
+template <typename Key>
+Key BasicBTreeNodeView<Key>::maxKey() const {
+    if (_keys_num > 0)
+        return _keys[_keys_num - 1];
+    else
+        throw std::logic_error("Invalid node operation");
+}
+
+template <typename Key>
+bool BasicBTreeNodeView<Key>::contains(Key key) const {
+    int idx = lowerBound(key);
+    return idx != _keys_num && _keys[idx] == key;
+}
+
+BTREE_INSTANTIATE(BasicBTreeNodeView);
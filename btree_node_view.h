@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "btree_key.h"
+
+template <typename Key>
+class BasicBTreeNode;
+
+//Read-only node over a serialized page, no deserialization step.
+//The view either points into memory owned by somebody else (mapped file,
+//arrays of an in-memory node) or owns a private copy of the page. Packed leaves are decoded once into
+//arrays the view owns, so searches run on plain keys either way.
+template <typename Key>
+class BasicBTreeNodeView {
+public:
+    //empty placeholder, assign a view before use
+    BasicBTreeNodeView();
+    BasicBTreeNodeView(const uint8_t *page, int page_size);
+    explicit BasicBTreeNodeView(std::vector<uint8_t> &&page);
+    //points at the arrays of node, valid until node changes
+    explicit BasicBTreeNodeView(const BasicBTreeNode<Key> &node);
+    BasicBTreeNodeView(BasicBTreeNodeView &&) = default;
+    BasicBTreeNodeView &operator=(BasicBTreeNodeView &&) = default;
+    uint64_t next(Key key) const;
+    const Key *keys() const;
+    Key key(int idx) const;
+    uint64_t child(int idx) const;
+    int lowerBound(Key key) const;
+    int upperBound(Key key) const;
+    int order() const;
+    int keysNum() const;
+    bool isFull() const;
+    //entries were bit-packed on the page
+    bool isPacked() const;
+    uint64_t ref() const;
+    bool isLeaf() const;
+    uint64_t sentinel() const;
+    uint64_t leftSibling() const;
+    uint64_t rightSibling() const;
+    Key minKey() const;
+    Key maxKey() const;
+    bool contains(Key key) const;
+private:
+    void parse(const uint8_t *page, int page_size);
+    std::vector<uint8_t> _buffer;
+    std::vector<Key> _unpacked_keys;
+    std::vector<uint64_t> _unpacked_children;
+    int _order;
+    int _keys_num;
+    uint64_t _ref;
+    bool _is_leaf;
+    bool _packed;
+    uint64_t _sentinel;
+    uint64_t _left_sibling;
+    uint64_t _right_sibling;
+    const Key *_keys;
+    const uint64_t *_children;
+};
+
+typedef BasicBTreeNodeView<int> BTreeNodeView;
@@ -0,0 +1,67 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+struct BTreeOptions {
+    //NONE writes pages in place and persists the header on close,
+    //other levels log every operation before its pages reach the tree file
+    enum Durability {
+        NONE,           //no log, a crash may corrupt the tree
+        SYNC,           //every operation waits for its own log fsync
+        GROUP,          //concurrent operations share one log fsync
+        ASYNC           //log is synced in the background, a crash loses recent operations
+    };
+    BTreeOptions();
+    size_t cache_size;          //buffer pool budget in bytes, 0 disables caching
+    bool use_mmap;              //map the tree file, read paths use pages in place
+    size_t dirty_limit;         //saved pages held before writers wait for write-back,
+                                //a background thread starts at half of it, 0 writes at every commit
+    Durability durability;
+    unsigned wal_group_window_us;       //group commit leader waits this long for followers
+    unsigned wal_sync_interval_ms;      //async log sync period
+    uint64_t wal_checkpoint_size;       //log size that triggers a checkpoint
+    int leaf_order;             //keys per bit-packed leaf of a new tree, at least 4; 0 keeps plain leaves;
+                                //a packed leaf also splits early when it outgrows its page
+    uint32_t page_size;         //fixed page size of a new tree, a power of two from 512 to 32K;
+                                //the header fills the first page and order 0 takes the largest
+                                //order that fits. 0 sizes pages to the order, packed after the header
+    bool direct_io;             //O_DIRECT file access, needs a tree with fixed size pages
+                                //and a page size that is a multiple of the device block size
+    uint64_t extent_size;       //file space is reserved with fallocate in extents of the tree
+                                //size, at least this many bytes; 0 leaves growth to write-back
+    uint64_t max_extent_size;   //largest single extent
+    bool latency_stats;         //time every operation into the latency histograms of stats()
+    bool use_io_uring;          //batched lookups read through io_uring when the kernel allows it,
+                                //otherwise through a pool of pread threads
+    unsigned io_depth;          //most page reads a batched lookup keeps in flight
+    unsigned read_ahead;        //most leaves a sequential scan prefetches at once, 0 disables read-ahead
+    unsigned bloom_bits_per_key;        //Bloom filter bits per key slot of a leaf, kept in memory so that
+                                        //lookups of absent keys mostly skip the leaf; 10 passes about 1%
+                                        //of them, 0 disables the filters
+
+    static const size_t DEFAULT_CACHE_SIZE = 8 << 20;
+    static const size_t DEFAULT_DIRTY_LIMIT = 4 << 20;
+    static const uint64_t DEFAULT_EXTENT_SIZE = 1 << 20;
+    static const uint64_t DEFAULT_MAX_EXTENT_SIZE = 64 << 20;
+    static const unsigned DEFAULT_IO_DEPTH = 128;
+    static const unsigned DEFAULT_READ_AHEAD = 64;
+};
+
+inline BTreeOptions::BTreeOptions():
+    cache_size(DEFAULT_CACHE_SIZE),
+    use_mmap(false),
+    dirty_limit(DEFAULT_DIRTY_LIMIT),
+    durability(NONE),
+    wal_group_window_us(100),
+    wal_sync_interval_ms(10),
+    wal_checkpoint_size(64 << 20),
+    leaf_order(0),
+    page_size(0),
+    direct_io(false),
+    extent_size(DEFAULT_EXTENT_SIZE),
+    max_extent_size(DEFAULT_MAX_EXTENT_SIZE),
+    latency_stats(true),
+    use_io_uring(true),
+    io_depth(DEFAULT_IO_DEPTH),
+    read_ahead(DEFAULT_READ_AHEAD),
+    bloom_bits_per_key(0) { }
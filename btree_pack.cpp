@@ -0,0 +1,172 @@
+#include "btree_pack.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include <string.h>
+
+namespace {
+
+int bitWidth(uint64_t value) {
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+//offsets are stored in whole 64 bit words, so decoding reads words only
+size_t wordBytes(int count, int width) {
+    return ((size_t)count * width + 63) / 64 * sizeof(uint64_t);
+}
+
+template <typename Key>
+struct BlockHeader {
+    Key key_base;
+    uint8_t key_width;
+    uint8_t value_width;
+    uint16_t count;
+    uint64_t value_base;
+};
+static_assert(sizeof(BlockHeader<int>) == 16, "block header layout");
+static_assert(sizeof(BlockHeader<int64_t>) == 24, "block header layout");
+
+//offsets from the first key of a block, wrapping like the unsigned type
+template <typename Key>
+uint64_t keyOffset(Key key, Key base) {
+    typedef typename std::make_unsigned<Key>::type Unsigned;
+    return (Unsigned)((Unsigned)key - (Unsigned)base);
+}
+
+template <typename Key>
+Key keyAt(Key base, uint64_t offset) {
+    typedef typename std::make_unsigned<Key>::type Unsigned;
+    return (Key)(Unsigned)((Unsigned)base + (Unsigned)offset);
+}
+
+template <typename Key>
+BlockHeader<Key> blockHeader(const Key *keys, const uint64_t *values, int count) {
+    BlockHeader<Key> header;
+    //64 bit headers have padding, pages get no stray bytes
+    memset(&header, 0, sizeof(header));
+    header.key_base = keys[0];
+    //keys are sorted, so the last offset is the widest
+    header.key_width = bitWidth(keyOffset(keys[count - 1], keys[0]));
+    header.value_base = *std::min_element(values, values + count);
+    uint64_t spread = 0;
+    for (int i = 0; i < count; ++i) {
+        spread |= values[i] - header.value_base;
+    }
+    header.value_width = bitWidth(spread);
+    header.count = count;
+    return header;
+}
+
+template <typename Key>
+size_t blockSize(const BlockHeader<Key> &header) {
+    return sizeof(header) + wordBytes(header.count, header.key_width) +
+        wordBytes(header.count, header.value_width);
+}
+
+void packBits(const uint64_t *offsets, int count, int width, uint8_t *out) {
+    uint64_t words[BTreePack::BLOCK] = { 0 };
+    for (int i = 0; i < count && width != 0; ++i) {
+        uint64_t bit = (uint64_t)i * width;
+        uint64_t word = bit / 64;
+        int shift = bit % 64;
+        words[word] |= offsets[i] << shift;
+        if (shift + width > 64)
+            words[word + 1] |= offsets[i] >> (64 - shift);
+    }
+    memcpy(out, words, wordBytes(count, width));
+}
+
+void unpackBits(const uint8_t *in, int count, int width, uint64_t *offsets) {
+    if (width == 0) {
+        std::fill(offsets, offsets + count, 0);
+        return;
+    }
+    uint64_t words[BTreePack::BLOCK];
+    memcpy(words, in, wordBytes(count, width));
+    uint64_t mask = width == 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+    for (int i = 0; i < count; ++i) {
+        uint64_t bit = (uint64_t)i * width;
+        uint64_t word = bit / 64;
+        int shift = bit % 64;
+        uint64_t offset = words[word] >> shift;
+        if (shift + width > 64)
+            offset |= words[word + 1] << (64 - shift);
+        offsets[i] = offset & mask;
+    }
+}
+
+}
+
+const int BTreePack::BLOCK;
+
+template <typename Key>
+size_t BTreePack::packedSize(const Key *keys, const uint64_t *values, int n) {
+    size_t size = 0;
+    for (int from = 0; from < n; from += BLOCK) {
+        int count = std::min(BLOCK, n - from);
+        size += blockSize(blockHeader(keys + from, values + from, count));
+    }
+    return size;
+}
+
+template <typename Key>
+size_t BTreePack::pack(const Key *keys, const uint64_t *values, int n, uint8_t *out) {
+    uint8_t *begin = out;
+    uint64_t offsets[BLOCK];
+    for (int from = 0; from < n; from += BLOCK) {
+        int count = std::min(BLOCK, n - from);
+        BlockHeader<Key> header = blockHeader(keys + from, values + from, count);
+        memcpy(out, &header, sizeof(header));
+        out += sizeof(header);
+        for (int i = 0; i < count; ++i) {
+            offsets[i] = keyOffset(keys[from + i], header.key_base);
+        }
+        packBits(offsets, count, header.key_width, out);
+        out += wordBytes(count, header.key_width);
+        for (int i = 0; i < count; ++i) {
+            offsets[i] = values[from + i] - header.value_base;
+        }
+        packBits(offsets, count, header.value_width, out);
+        out += wordBytes(count, header.value_width);
+    }
+    return out - begin;
+}
+
+template <typename Key>
+void BTreePack::unpack(const uint8_t *in, size_t length, int n, Key *keys, uint64_t *values) {
+    const uint8_t *end = in + length;
+    uint64_t offsets[BLOCK];
+    for (int from = 0; from < n; from += BLOCK) {
+        int count = std::min(BLOCK, n - from);
+        BlockHeader<Key> header;
+        if ((size_t)(end - in) < sizeof(header))
+            throw std::logic_error("Deserialization error");
+        memcpy(&header, in, sizeof(header));
+        if (header.count != count || header.key_width > sizeof(Key) * 8 || header.value_width > 64 ||
+            (size_t)(end - in) < blockSize(header))
+            throw std::logic_error("Deserialization error");
+        in += sizeof(header);
+        unpackBits(in, count, header.key_width, offsets);
+        in += wordBytes(count, header.key_width);
+        for (int i = 0; i < count; ++i) {
+            keys[from + i] = keyAt(header.key_base, offsets[i]);
+        }
+        unpackBits(in, count, header.value_width, offsets);
+        in += wordBytes(count, header.value_width);
+        for (int i = 0; i < count; ++i) {
+            values[from + i] = header.value_base + offsets[i];
+        }
+    }
+}
+
+template size_t BTreePack::packedSize(const int *, const uint64_t *, int);
+template size_t BTreePack::packedSize(const int64_t *, const uint64_t *, int);
+template size_t BTreePack::packedSize(const uint64_t *, const uint64_t *, int);
+template size_t BTreePack::pack(const int *, const uint64_t *, int, uint8_t *);
+template size_t BTreePack::pack(const int64_t *, const uint64_t *, int, uint8_t *);
+template size_t BTreePack::pack(const uint64_t *, const uint64_t *, int, uint8_t *);
+template void BTreePack::unpack(const uint8_t *, size_t, int, int *, uint64_t *);
+template void BTreePack::unpack(const uint8_t *, size_t, int, int64_t *, uint64_t *);
+template void BTreePack::unpack(const uint8_t *, size_t, int, uint64_t *, uint64_t *);
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+
+//Bit-packed encoding of leaf entries.
+//Entries go in blocks of BLOCK; a block keeps its first key and its
+//smallest value and packs every entry as offsets from them, using the
+//fewest bits the block needs. Dense keys take a few bits, equal values none.
+//Keys are int, int64_t or uint64_t.
+class BTreePack {
+public:
+    static const int BLOCK = 32;
+    //bytes n sorted entries take once packed
+    template <typename Key>
+    static size_t packedSize(const Key *keys, const uint64_t *values, int n);
+    //returns the number of bytes written to out
+    template <typename Key>
+    static size_t pack(const Key *keys, const uint64_t *values, int n, uint8_t *out);
+    //decodes n entries from at most length bytes, throws if they do not fit
+    template <typename Key>
+    static void unpack(const uint8_t *in, size_t length, int n, Key *keys, uint64_t *values);
+};
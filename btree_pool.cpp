@@ -0,0 +1,136 @@
+#include "btree_pool.h"
+
+#include <new>
+#include <stdexcept>
+
+#include <stdlib.h>
+
+namespace {
+
+uint8_t *allocFrames(size_t length) {
+    void *data = nullptr;
+    if (length != 0 && posix_memalign(&data, 4096, length) != 0)
+        throw std::bad_alloc();
+    return static_cast<uint8_t *>(data);
+}
+
+}
+
+BTreePool::BTreePool(uint32_t page_size, size_t capacity):
+    _page_size(page_size),
+    _frames(capacity / page_size),
+    _data(allocFrames(_frames.size() * page_size), free),
+    _table(),
+    _hand(0),
+    _hits(0),
+    _misses(0),
+    _evictions(0) {
+    for (Frame &frame: _frames) {
+        frame.ref = 0;
+        frame.pin_count = 0;
+        frame.referenced = false;
+    }
+}
+
+bool BTreePool::enabled() const {
+    return !_frames.empty();
+}
+
+uint8_t *BTreePool::pin(uint64_t ref) {
+    auto it = _table.find(ref);
+    if (it == _table.end()) {
+        ++_misses;
+        return nullptr;
+    }
+    ++_hits;
+    Frame &frame = _frames[it->second];
+    ++frame.pin_count;
+    frame.referenced = true;
+    return _data.get() + it->second * _page_size;
+}
+
+uint8_t *BTreePool::pinForWrite(uint64_t ref) {
+    size_t idx;
+    auto it = _table.find(ref);
+    if (it != _table.end()) {
+        idx = it->second;
+    }
+    else {
+        idx = findVictim();
+        Frame &victim = _frames[idx];
+        if (victim.ref != 0) {
+            _table.erase(victim.ref);
+            ++_evictions;
+        }
+        victim.ref = ref;
+        _table[ref] = idx;
+    }
+    Frame &frame = _frames[idx];
+    ++frame.pin_count;
+    frame.referenced = true;
+    return _data.get() + idx * _page_size;
+}
+
+void BTreePool::unpin(uint64_t ref) {
+    auto it = _table.find(ref);
+    if (it == _table.end())
+        throw std::logic_error("Unpinning page which is not cached");
+    Frame &frame = _frames[it->second];
+    if (frame.pin_count == 0)
+        throw std::logic_error("Unpinning page which is not pinned");
+    --frame.pin_count;
+}
+
+void BTreePool::invalidate(uint64_t ref) {
+    auto it = _table.find(ref);
+    if (it == _table.end())
+        return;
+    Frame &frame = _frames[it->second];
+    frame.ref = 0;
+    frame.pin_count = 0;
+    frame.referenced = false;
+    _table.erase(it);
+}
+
+size_t BTreePool::findVictim() {
+    //second pass is guaranteed to find a frame unless all of them are pinned
+    for (size_t step = 0; step < 2 * _frames.size(); ++step) {
+        size_t idx = _hand;
+        _hand = (_hand + 1) % _frames.size();
+        Frame &frame = _frames[idx];
+        if (frame.pin_count > 0)
+            continue;
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        return idx;
+    }
+    throw std::logic_error("Buffer pool is exhausted: all pages are pinned");
+}
+
+size_t BTreePool::frames() const {
+    return _frames.size();
+}
+
+size_t BTreePool::pagesCached() const {
+    return _table.size();
+}
+
+uint64_t BTreePool::hits() const {
+    return _hits;
+}
+
+uint64_t BTreePool::misses() const {
+    return _misses;
+}
+
+uint64_t BTreePool::evictions() const {
+    return _evictions;
+}
+
+void BTreePool::resetStats() {
+    _hits = 0;
+    _misses = 0;
+    _evictions = 0;
+}
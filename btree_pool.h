@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+//Fixed budget cache of raw pages with CLOCK eviction.
+//Pinned frames are never evicted, every pin must be paired with unpin.
+//Frames are aligned like pages in the file, so direct reads land in them.
+class BTreePool {
+public:
+    BTreePool(uint32_t page_size, size_t capacity);
+    bool enabled() const;
+    //returns cached page or nullptr, counts hit/miss
+    uint8_t *pin(uint64_t ref);
+    //returns cached page or takes a free frame for ref, caller fills it
+    uint8_t *pinForWrite(uint64_t ref);
+    void unpin(uint64_t ref);
+    void invalidate(uint64_t ref);
+    size_t frames() const;
+    size_t pagesCached() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+    uint64_t evictions() const;
+    void resetStats();
+private:
+    struct Frame {
+        uint64_t ref;
+        int pin_count;
+        bool referenced;
+    };
+    size_t findVictim();
+    uint32_t _page_size;
+    std::vector<Frame> _frames;
+    std::unique_ptr<uint8_t, void (*)(void *)> _data;
+    std::unordered_map<uint64_t, size_t> _table;
+    size_t _hand;
+    uint64_t _hits;
+    uint64_t _misses;
+    uint64_t _evictions;
+};
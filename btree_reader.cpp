@@ -0,0 +1,247 @@
+#include "btree_reader.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+//Submission and completion rings shared with the kernel, set up with the
+//raw system calls so that no library is needed.
+struct BTreeReader::Ring {
+    //nullptr if the kernel or its sandbox refuses io_uring
+    static Ring *create(unsigned entries);
+    ~Ring();
+    int fd;
+    unsigned entries;
+    void *sq_ring;
+    size_t sq_size;
+    void *cq_ring;
+    size_t cq_size;
+    io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    io_uring_cqe *cqes;
+};
+
+struct BTreeReader::Batch {
+    size_t left;
+};
+
+namespace {
+
+template <typename T>
+T *ringField(void *ring, uint32_t offset) {
+    return reinterpret_cast<T *>(static_cast<uint8_t *>(ring) + offset);
+}
+
+void *mapRing(int fd, size_t size, off_t offset) {
+    void *ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ring == MAP_FAILED ? nullptr : ring;
+}
+
+}
+
+const unsigned BTreeReader::MAX_THREADS;
+
+BTreeReader::Ring *BTreeReader::Ring::create(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+        return nullptr;
+    std::unique_ptr<Ring> ring(new Ring());
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sq_ring = mapRing(fd, ring->sq_size, IORING_OFF_SQ_RING);
+    ring->cq_ring = mapRing(fd, ring->cq_size, IORING_OFF_CQ_RING);
+    ring->sqes = static_cast<io_uring_sqe *>(mapRing(fd, ring->sqes_size, IORING_OFF_SQES));
+    if (ring->sq_ring == nullptr || ring->cq_ring == nullptr || ring->sqes == nullptr)
+        return nullptr;
+    ring->sq_tail = ringField<unsigned>(ring->sq_ring, params.sq_off.tail);
+    ring->sq_mask = ringField<unsigned>(ring->sq_ring, params.sq_off.ring_mask);
+    ring->sq_array = ringField<unsigned>(ring->sq_ring, params.sq_off.array);
+    ring->cq_head = ringField<unsigned>(ring->cq_ring, params.cq_off.head);
+    ring->cq_tail = ringField<unsigned>(ring->cq_ring, params.cq_off.tail);
+    ring->cq_mask = ringField<unsigned>(ring->cq_ring, params.cq_off.ring_mask);
+    ring->cqes = ringField<io_uring_cqe>(ring->cq_ring, params.cq_off.cqes);
+    return ring.release();
+}
+
+BTreeReader::Ring::~Ring() {
+    if (sq_ring != nullptr)
+        munmap(sq_ring, sq_size);
+    if (cq_ring != nullptr)
+        munmap(cq_ring, cq_size);
+    if (sqes != nullptr)
+        munmap(sqes, sqes_size);
+    close(fd);
+}
+
+BTreeReader::BTreeReader(int fd, unsigned depth, bool use_uring):
+    _fd(fd),
+    _depth(std::max(depth, 1u)),
+    _ring_on(false),
+    _stop(false) {
+    if (use_uring)
+        _ring.reset(Ring::create(_depth));
+    _ring_on = _ring != nullptr;
+}
+
+void BTreeReader::read(Request *requests, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        requests[i].done = false;
+    }
+    if (n == 0)
+        return;
+    if (_ring_on && readUring(requests, n))
+        return;
+    //reads the ring finished are not repeated
+    std::vector<Request> rest;
+    std::vector<size_t> idx;
+    for (size_t i = 0; i < n; ++i) {
+        if (!requests[i].done) {
+            rest.push_back(requests[i]);
+            idx.push_back(i);
+        }
+    }
+    readThreads(rest.data(), rest.size());
+    for (size_t i = 0; i < rest.size(); ++i) {
+        requests[idx[i]].done = rest[i].done;
+    }
+}
+
+bool BTreeReader::usesUring() const {
+    return _ring_on;
+}
+
+bool BTreeReader::readUring(Request *requests, size_t n) {
+    std::lock_guard<std::mutex> lock(_ring_mutex);
+    if (!_ring_on)
+        return false;
+    Ring &ring = *_ring;
+    //the kernel may read an iovec until its request completes
+    std::vector<struct iovec> iov(n);
+    size_t next = 0;
+    size_t completed = 0;
+    unsigned in_flight = 0;
+    unsigned unsubmitted = 0;
+    while (completed < n) {
+        unsigned tail = *ring.sq_tail;
+        while (next < n && in_flight < ring.entries) {
+            unsigned idx = tail & *ring.sq_mask;
+            iov[next].iov_base = requests[next].data;
+            iov[next].iov_len = requests[next].length;
+            io_uring_sqe *sqe = &ring.sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = _fd;
+            sqe->addr = (uint64_t)(uintptr_t)&iov[next];
+            sqe->len = 1;
+            sqe->off = requests[next].offset;
+            sqe->user_data = next;
+            ring.sq_array[idx] = idx;
+            ++tail;
+            ++next;
+            ++in_flight;
+            ++unsubmitted;
+        }
+        __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+        //submits the new reads and waits for at least one of all in flight
+        int submitted = syscall(__NR_io_uring_enter, ring.fd, unsubmitted, 1, IORING_ENTER_GETEVENTS,
+                                nullptr, 0);
+        bool failed = submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY;
+        if (submitted > 0)
+            unsubmitted -= submitted;
+        if (failed) {
+            //reads the kernel has not taken are taken back, so no later
+            //call submits them with the iovecs of this one
+            __atomic_store_n(ring.sq_tail, tail - unsubmitted, __ATOMIC_RELEASE);
+            in_flight -= unsubmitted;
+            unsubmitted = 0;
+            _ring_on = false;
+        }
+        completed += reap(ring, requests, in_flight);
+        if (!failed)
+            continue;
+        //the kernel still reads into the buffers and through the iovecs of
+        //the reads in flight, both go away with this call
+        while (in_flight > 0) {
+            if (syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+                std::this_thread::yield();
+            reap(ring, requests, in_flight);
+        }
+        return false;
+    }
+    return true;
+}
+
+size_t BTreeReader::reap(Ring &ring, Request *requests, unsigned &in_flight) {
+    size_t reaped = 0;
+    unsigned head = *ring.cq_head;
+    while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe &cqe = ring.cqes[head & *ring.cq_mask];
+        Request &request = requests[cqe.user_data];
+        request.done = cqe.res >= 0 && (size_t)cqe.res == request.length;
+        ++head;
+        --in_flight;
+        ++reaped;
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+void BTreeReader::readThreads(Request *requests, size_t n) {
+    std::unique_lock<std::mutex> lock(_queue_mutex);
+    while (_threads.size() < std::min(_depth, MAX_THREADS)) {
+        _threads.push_back(std::thread(&BTreeReader::workerLoop, this));
+    }
+    Batch batch;
+    batch.left = n;
+    for (size_t i = 0; i < n; ++i) {
+        _queue.push_back(std::make_pair(&requests[i], &batch));
+    }
+    _work.notify_all();
+    _finished.wait(lock, [&batch]() { return batch.left == 0; });
+}
+
+void BTreeReader::workerLoop() {
+    std::unique_lock<std::mutex> lock(_queue_mutex);
+    while (true) {
+        _work.wait(lock, [this]() { return _stop || !_queue.empty(); });
+        if (_queue.empty())
+            return;
+        std::pair<Request *, Batch *> item = _queue.front();
+        _queue.pop_front();
+        lock.unlock();
+        Request &request = *item.first;
+        request.done = pread(_fd, request.data, request.length, request.offset) == (ssize_t)request.length;
+        lock.lock();
+        if (--item.second->left == 0)
+            _finished.notify_all();
+    }
+}
+
+BTreeReader::~BTreeReader() {
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        _stop = true;
+    }
+    _work.notify_all();
+    for (std::thread &thread: _threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+//Reads many pages of a file at once, so the device sees a deep queue
+//instead of one read after another. Reads go through io_uring when the
+//kernel allows it, otherwise through a pool of threads doing pread.
+//Calls from several threads are safe; they share the ring or the pool.
+//A ring that fails is drained and switched off, its batch and all later
+//ones go to the pool.
+class BTreeReader {
+public:
+    struct Request {
+        uint8_t *data;
+        size_t length;
+        uint64_t offset;
+        bool done;              //set by read() if every byte was read
+    };
+    //depth is the most reads in flight, use_uring false always takes the thread pool
+    BTreeReader(int fd, unsigned depth, bool use_uring);
+    BTreeReader(const BTreeReader &) = delete;
+    BTreeReader &operator=(const BTreeReader &) = delete;
+    //returns once every request is done or failed
+    void read(Request *requests, size_t n);
+    bool usesUring() const;
+    ~BTreeReader();
+    static const unsigned MAX_THREADS = 32;
+private:
+    struct Ring;
+    struct Batch;
+    //false if the ring failed and the batch has to go to the pool
+    bool readUring(Request *requests, size_t n);
+    //takes the completions posted so far, returns their number
+    static size_t reap(Ring &ring, Request *requests, unsigned &in_flight);
+    void readThreads(Request *requests, size_t n);
+    void workerLoop();
+    int _fd;
+    unsigned _depth;
+    std::unique_ptr<Ring> _ring;
+    std::atomic<bool> _ring_on;
+    std::mutex _ring_mutex;
+    //fallback pool, started by the first read
+    std::vector<std::thread> _threads;
+    std::deque<std::pair<Request *, Batch *> > _queue;
+    std::mutex _queue_mutex;
+    std::condition_variable _work;
+    std::condition_variable _finished;
+    bool _stop;
+};
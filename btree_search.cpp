@@ -0,0 +1,194 @@
+#include "btree_search.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BTREE_SEARCH_X86
+#endif
+
+namespace {
+
+typedef int (*CountFn)(const int *keys, int n, int key);
+
+//binary search stops when that many keys are left
+const int WINDOW = 64;
+
+int countLessScalar(const int *keys, int n, int key) {
+    return std::lower_bound(keys, keys + n, key) - keys;
+}
+
+int countNotGreaterScalar(const int *keys, int n, int key) {
+    return std::upper_bound(keys, keys + n, key) - keys;
+}
+
+#ifdef BTREE_SEARCH_X86
+//compare masks are -1 per matching lane, so subtracting them counts matches
+int sumLanes(__m128i acc) {
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+}
+
+int countLessSse2(const int *keys, int n, int key) {
+    __m128i needle = _mm_set1_epi32(key);
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+        acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(needle, block));
+    }
+    int count = sumLanes(acc);
+    for (; i < n; ++i) {
+        count += keys[i] < key;
+    }
+    return count;
+}
+
+int countNotGreaterSse2(const int *keys, int n, int key) {
+    __m128i needle = _mm_set1_epi32(key);
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+        acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(block, needle));
+    }
+    int count = i - sumLanes(acc);
+    for (; i < n; ++i) {
+        count += keys[i] <= key;
+    }
+    return count;
+}
+
+__attribute__((target("avx2")))
+int countLessAvx2(const int *keys, int n, int key) {
+    __m256i needle = _mm256_set1_epi32(key);
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+        acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(needle, block));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    return sumLanes(half) + countLessSse2(keys + i, n - i, key);
+}
+
+__attribute__((target("avx2")))
+int countNotGreaterAvx2(const int *keys, int n, int key) {
+    __m256i needle = _mm256_set1_epi32(key);
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+        acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(block, needle));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    return i - sumLanes(half) + countNotGreaterSse2(keys + i, n - i, key);
+}
+#endif
+
+BTreeSearch::Mode detectMode() {
+#ifdef BTREE_SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return BTreeSearch::AVX2;
+    return BTreeSearch::SSE2;
+#else
+    return BTreeSearch::SCALAR;
+#endif
+}
+
+const BTreeSearch::Mode default_mode = detectMode();
+BTreeSearch::Mode current_mode = default_mode;
+CountFn count_less = countLessScalar;
+CountFn count_not_greater = countNotGreaterScalar;
+
+void selectFunctions(BTreeSearch::Mode mode) {
+    current_mode = mode;
+    switch (mode) {
+#ifdef BTREE_SEARCH_X86
+    case BTreeSearch::AVX2:
+        count_less = countLessAvx2;
+        count_not_greater = countNotGreaterAvx2;
+        break;
+    case BTreeSearch::SSE2:
+        count_less = countLessSse2;
+        count_not_greater = countNotGreaterSse2;
+        break;
+#endif
+    default:
+        count_less = countLessScalar;
+        count_not_greater = countNotGreaterScalar;
+    }
+}
+
+struct Initializer {
+    Initializer() {
+        selectFunctions(default_mode);
+    }
+} initializer;
+
+}
+
+int BTreeSearch::lowerBound(const int *keys, int n, int key) {
+    int base = 0;
+    while (n > WINDOW) {
+        int half = n / 2;
+        if (keys[base + half] < key) {
+            base += half + 1;
+            n -= half + 1;
+        }
+        else {
+            n = half;
+        }
+    }
+    return base + count_less(keys + base, n, key);
+}
+
+int BTreeSearch::upperBound(const int *keys, int n, int key) {
+    int base = 0;
+    while (n > WINDOW) {
+        int half = n / 2;
+        if (keys[base + half] <= key) {
+            base += half + 1;
+            n -= half + 1;
+        }
+        else {
+            n = half;
+        }
+    }
+    return base + count_not_greater(keys + base, n, key);
+}
+
+BTreeSearch::Mode BTreeSearch::defaultMode() {
+    return default_mode;
+}
+
+BTreeSearch::Mode BTreeSearch::mode() {
+    return current_mode;
+}
+
+bool BTreeSearch::isSupported(Mode mode) {
+    return mode <= default_mode;
+}
+
+void BTreeSearch::setMode(Mode mode) {
+    if (!isSupported(mode)) {
+        throw std::logic_error(std::string("Search mode is not supported: ") + modeName(mode));
+    }
+    selectFunctions(mode);
+}
+
+const char *BTreeSearch::modeName(Mode mode) {
+    switch (mode) {
+    case SCALAR:
+        return "scalar";
+    case SSE2:
+        return "sse2";
+    case AVX2:
+        return "avx2";
+    }
+    return "unknown";
+}
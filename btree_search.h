@@ -0,0 +1,22 @@
+#pragma once
+
+//Search over a sorted key array of a node.
+//The vector variants narrow the range with binary search and then count
+//matching keys of the remaining window with SIMD compares.
+class BTreeSearch {
+public:
+    enum Mode {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+    //index of the first key not less / greater than key
+    static int lowerBound(const int *keys, int n, int key);
+    static int upperBound(const int *keys, int n, int key);
+    //best mode supported by the running CPU, selected on startup
+    static Mode defaultMode();
+    static Mode mode();
+    static bool isSupported(Mode mode);
+    static void setMode(Mode mode);
+    static const char *modeName(Mode mode);
+};
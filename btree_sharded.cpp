@@ -0,0 +1,374 @@
+#include "btree_sharded.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+namespace {
+
+const uint32_t SHARDS_MAGIC = 0x53425452;
+
+//spreads neighbouring keys over the shards
+uint32_t scramble(int key) {
+    uint32_t x = key;
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+}
+
+const size_t ShardedBTree::QUEUE_LIMIT;
+
+ShardedBTree::ShardedBTree(const std::string &filename, int order, const std::vector<int> &splits,
+                           const BTreeOptions &options):
+    _partitioning(RANGE),
+    _splits(splits) {
+    for (size_t i = 1; i < _splits.size(); ++i) {
+        if (_splits[i - 1] >= _splits[i]) {
+            throw std::logic_error("Splits are not sorted and distinct");
+        }
+    }
+    create(filename, order, options);
+}
+
+ShardedBTree::ShardedBTree(const std::string &filename, int order, int shards,
+                           const BTreeOptions &options):
+    _partitioning(HASH),
+    _splits(std::max(shards, 1) - 1, 0) {
+    if (shards < 1) {
+        throw std::logic_error("Invalid number of shards");
+    }
+    create(filename, order, options);
+}
+
+ShardedBTree::ShardedBTree(const std::string &filename, const BTreeOptions &options) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::logic_error("Could not open " + filename);
+    }
+    uint32_t header[3];
+    bool read_ok = pread(fd, header, sizeof(header), 0) == sizeof(header) && header[0] == SHARDS_MAGIC &&
+                   header[1] <= HASH && header[2] >= 1;
+    if (read_ok) {
+        _partitioning = (Partitioning)header[1];
+        _splits.resize(header[2] - 1);
+        ssize_t length = _splits.size() * sizeof(int);
+        read_ok = pread(fd, _splits.data(), length, sizeof(header)) == length;
+    }
+    close(fd);
+    if (!read_ok) {
+        throw std::logic_error("Error during shard settings read");
+    }
+    for (int i = 0; i < shards(); ++i) {
+        _shards.push_back(std::unique_ptr<Shard>(new Shard()));
+        _shards.back()->tree.reset(new BTree(shardName(filename, i), options));
+    }
+    start();
+}
+
+void ShardedBTree::create(const std::string &filename, int order, const BTreeOptions &options) {
+    std::vector<uint8_t> settings(3 * sizeof(uint32_t) + _splits.size() * sizeof(int));
+    uint32_t header[3] = { SHARDS_MAGIC, (uint32_t)_partitioning, (uint32_t)_splits.size() + 1 };
+    memcpy(settings.data(), header, sizeof(header));
+    memcpy(settings.data() + sizeof(header), _splits.data(), _splits.size() * sizeof(int));
+    int fd = open(filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd == -1) {
+        throw std::logic_error("Could not open " + filename);
+    }
+    bool written = pwrite(fd, settings.data(), settings.size(), 0) == (ssize_t)settings.size();
+    close(fd);
+    if (!written) {
+        throw std::logic_error("Error during shard settings write");
+    }
+    for (int i = 0; i < shards(); ++i) {
+        _shards.push_back(std::unique_ptr<Shard>(new Shard()));
+        _shards.back()->tree.reset(new BTree(shardName(filename, i), order, options));
+    }
+    start();
+}
+
+void ShardedBTree::start() {
+    for (std::unique_ptr<Shard> &shard: _shards) {
+        shard->writer = std::thread(&ShardedBTree::writerLoop, this, std::ref(*shard));
+    }
+}
+
+std::string ShardedBTree::shardName(const std::string &filename, int i) {
+    return filename + "." + std::to_string(i);
+}
+
+std::vector<int> ShardedBTree::learnSplits(std::vector<int> sample, int shards) {
+    if (shards < 1) {
+        throw std::logic_error("Invalid number of shards");
+    }
+    std::sort(sample.begin(), sample.end());
+    std::vector<int> splits;
+    for (int i = 1; i < shards && !sample.empty(); ++i) {
+        int split = sample[sample.size() * i / shards];
+        //a sample of few distinct keys gives fewer shards
+        if (splits.empty() || split > splits.back())
+            splits.push_back(split);
+    }
+    return splits;
+}
+
+int ShardedBTree::shardOf(int key) const {
+    if (_partitioning == HASH)
+        return scramble(key) % _shards.size();
+    return std::upper_bound(_splits.begin(), _splits.end(), key) - _splits.begin();
+}
+
+void ShardedBTree::put(int key, uint64_t value) {
+    Write write = { key, value, true };
+    enqueue(write);
+}
+
+void ShardedBTree::remove(int key) {
+    Write write = { key, 0, false };
+    enqueue(write);
+}
+
+void ShardedBTree::enqueue(const Write &write) {
+    Shard &shard = *_shards[shardOf(write.key)];
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    //the writer drains the queue in batches, so it frees room in bulk
+    shard.drained.wait(lock, [&shard]() { return shard.queue.size() < QUEUE_LIMIT; });
+    shard.queue.push_back(write);
+    ++shard.pending;
+    if (shard.queue.size() == 1)
+        shard.wakeup.notify_one();
+}
+
+void ShardedBTree::writerLoop(Shard &shard) {
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    while (true) {
+        shard.wakeup.wait(lock, [&shard]() { return shard.stop || !shard.queue.empty(); });
+        if (shard.queue.empty())
+            return;
+        std::vector<Write> writes(shard.queue.begin(), shard.queue.end());
+        shard.queue.clear();
+        shard.drained.notify_all();
+        lock.unlock();
+        std::string error;
+        apply(*shard.tree, writes, error);
+        lock.lock();
+        if (shard.error.empty())
+            shard.error = error;
+        shard.pending -= writes.size();
+        shard.drained.notify_all();
+    }
+}
+
+void ShardedBTree::apply(BTree &tree, const std::vector<Write> &writes, std::string &error) {
+    size_t i = 0;
+    while (i < writes.size()) {
+        if (!writes[i].put) {
+            try {
+                tree.remove(writes[i].key);
+            }
+            catch (const std::logic_error &e) {
+                if (error.empty())
+                    error = e.what();
+            }
+            ++i;
+            continue;
+        }
+        std::vector<int> keys;
+        std::vector<uint64_t> values;
+        for (; i < writes.size() && writes[i].put; ++i) {
+            keys.push_back(writes[i].key);
+            values.push_back(writes[i].value);
+        }
+        //a single put takes the leaf path, a run walks the tree once
+        try {
+            if (keys.size() == 1) {
+                tree.put(keys[0], values[0]);
+                continue;
+            }
+            std::vector<bool> inserted = tree.putMany(keys, values);
+            if (error.empty() && std::find(inserted.begin(), inserted.end(), false) != inserted.end())
+                error = "Key already exists";
+        }
+        catch (const std::logic_error &e) {
+            if (error.empty())
+                error = e.what();
+        }
+    }
+}
+
+void ShardedBTree::flush() {
+    std::string error;
+    for (std::unique_ptr<Shard> &shard: _shards) {
+        std::unique_lock<std::mutex> lock(shard->mutex);
+        shard->drained.wait(lock, [&shard]() { return shard->pending == 0; });
+        if (error.empty())
+            error = shard->error;
+        shard->error.clear();
+    }
+    if (!error.empty()) {
+        throw std::logic_error(error);
+    }
+}
+
+bool ShardedBTree::contains(int key) const {
+    return _shards[shardOf(key)]->tree->contains(key);
+}
+
+bool ShardedBTree::get(int key, uint64_t &value) const {
+    return _shards[shardOf(key)]->tree->get(key, value);
+}
+
+uint64_t ShardedBTree::size() const {
+    uint64_t total = 0;
+    for (const std::unique_ptr<Shard> &shard: _shards) {
+        total += shard->tree->size();
+    }
+    return total;
+}
+
+int ShardedBTree::shards() const {
+    return _splits.size() + 1;
+}
+
+ShardedBTree::Partitioning ShardedBTree::partitioning() const {
+    return _partitioning;
+}
+
+BTree &ShardedBTree::shard(int i) {
+    return *_shards.at(i)->tree;
+}
+
+ShardedBTree::iterator ShardedBTree::begin() const {
+    std::vector<BTree::iterator> its;
+    for (const std::unique_ptr<Shard> &shard: _shards) {
+        its.push_back(shard->tree->begin());
+    }
+    return iterator(this, std::move(its));
+}
+
+ShardedBTree::iterator ShardedBTree::end() const {
+    return iterator();
+}
+
+ShardedBTree::iterator ShardedBTree::lower_bound(int key) const {
+    std::vector<BTree::iterator> its;
+    for (size_t i = 0; i < _shards.size(); ++i) {
+        //range shards below the key have nothing to give
+        if (_partitioning == RANGE && (int)i < shardOf(key))
+            its.push_back(_shards[i]->tree->end());
+        else
+            its.push_back(_shards[i]->tree->lower_bound(key));
+    }
+    return iterator(this, std::move(its));
+}
+
+bool ShardedBTree::checkValid() const {
+    for (size_t i = 0; i < _shards.size(); ++i) {
+        const BTree &tree = *_shards[i]->tree;
+        if (!tree.checkValid())
+            return false;
+        if (_partitioning == HASH || tree.size() == 0)
+            continue;
+        if (i > 0 && *tree.begin() < _splits[i - 1])
+            return false;
+        if (i < _splits.size() && *tree.rbegin() >= _splits[i])
+            return false;
+    }
+    return true;
+}
+
+ShardedBTree::~ShardedBTree() {
+    try {
+        flush();
+    }
+    catch (const std::exception &e) {
+        std::cout << e.what() << std::endl;
+    }
+    for (std::unique_ptr<Shard> &shard: _shards) {
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->stop = true;
+        }
+        shard->wakeup.notify_one();
+        shard->writer.join();
+    }
+}
+
+ShardedBTree::iterator::iterator():
+    _tree(nullptr),
+    _its(),
+    _current(-1) { }
+
+ShardedBTree::iterator::iterator(const ShardedBTree *tree, std::vector<BTree::iterator> &&its):
+    _tree(tree),
+    _its(std::move(its)),
+    _current(-1) {
+    pick();
+}
+
+void ShardedBTree::iterator::pick() {
+    _current = -1;
+    for (size_t i = 0; i < _its.size(); ++i) {
+        if (_its[i] == _tree->_shards[i]->tree->end())
+            continue;
+        if (_current == -1 || *_its[i] < *_its[_current]) {
+            _current = i;
+            //range shards hold only greater keys after this one
+            if (_tree->_partitioning == RANGE)
+                return;
+        }
+    }
+}
+
+ShardedBTree::iterator &ShardedBTree::iterator::operator++() {
+    if (_current == -1) {
+        throw std::logic_error("Invalid iterator operation: increment end() iterator");
+    }
+    ++_its[_current];
+    pick();
+    return *this;
+}
+
+ShardedBTree::iterator ShardedBTree::iterator::operator++(int) {
+    iterator old = *this;
+    ++*this;
+    return old;
+}
+
+bool operator==(const ShardedBTree::iterator &left, const ShardedBTree::iterator &right) {
+    if (left._current == -1 || right._current == -1)
+        return left._current == right._current;
+    //keys are unique across the shards
+    return left._tree == right._tree && *left == *right;
+}
+
+bool operator!=(const ShardedBTree::iterator &left, const ShardedBTree::iterator &right) {
+    return !(left == right);
+}
+
+int ShardedBTree::iterator::operator*() const {
+    if (_current == -1) {
+        throw std::logic_error("Invalid iterator operation: dereferencing end() iterator");
+    }
+    return *_its[_current];
+}
+
+uint64_t ShardedBTree::iterator::value() const {
+    if (_current == -1) {
+        throw std::logic_error("Invalid iterator operation: dereferencing end() iterator");
+    }
+    return _its[_current].value();
+}
+
+int ShardedBTree::iterator::shard() const {
+    return _current;
+}
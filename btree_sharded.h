@@ -0,0 +1,118 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "btree.h"
+
+//Keys spread over independent trees, each in its own file with its own
+//writer thread, so ingest is not bound by one root. Shards cover key
+//ranges or hash buckets. The partitioning is kept in filename, shard i
+//in filename.i.
+//Writes are queued to the writer of their shard and return at once;
+//flush() waits until every queued write is applied and reports the ones
+//that failed. Reads go to the shard directly and see applied writes.
+class ShardedBTree {
+public:
+    enum Partitioning {
+        RANGE,          //shard i holds keys in [splits[i - 1], splits[i])
+        HASH            //spreads point workloads, iteration merges all shards
+    };
+    //splits.size() + 1 range shards, splits are sorted and distinct
+    ShardedBTree(const std::string &filename, int order, const std::vector<int> &splits,
+                 const BTreeOptions &options = BTreeOptions());
+    //shards hash partitioned shards
+    ShardedBTree(const std::string &filename, int order, int shards,
+                 const BTreeOptions &options = BTreeOptions());
+    explicit ShardedBTree(const std::string &filename, const BTreeOptions &options = BTreeOptions());
+    //splits of range shards holding about as many keys of the sample each
+    static std::vector<int> learnSplits(std::vector<int> sample, int shards);
+    //a put of a present key or a remove of a missing one fails at flush()
+    void put(int key, uint64_t value = 0);
+    void remove(int key);
+    //waits for all writes queued so far, throws if any of them failed
+    void flush();
+    bool contains(int key) const;
+    bool get(int key, uint64_t &value) const;
+    uint64_t size() const;
+    int shards() const;
+    Partitioning partitioning() const;
+    //shard the key belongs to
+    int shardOf(int key) const;
+    BTree &shard(int i);
+    class iterator;
+    iterator begin() const;
+    iterator end() const;
+    //first key not less than key
+    iterator lower_bound(int key) const;
+    //every shard is valid and holds only its own keys
+    bool checkValid() const;
+    //applies the queued writes before closing
+    ~ShardedBTree();
+    //writes a shard queues before put() waits for its writer
+    static const size_t QUEUE_LIMIT = 1 << 16;
+private:
+    struct Write {
+        int key;
+        uint64_t value;
+        bool put;
+    };
+    struct Shard {
+        Shard(): pending(0), stop(false) { }
+        std::unique_ptr<BTree> tree;
+        std::deque<Write> queue;
+        size_t pending;             //queued or being applied
+        std::string error;          //first failed write since the last flush
+        bool stop;
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::condition_variable drained;
+        std::thread writer;
+    };
+    void create(const std::string &filename, int order, const BTreeOptions &options);
+    void start();
+    void enqueue(const Write &write);
+    void writerLoop(Shard &shard);
+    //applies writes in order, runs of puts as one batch
+    static void apply(BTree &tree, const std::vector<Write> &writes, std::string &error);
+    static std::string shardName(const std::string &filename, int i);
+    Partitioning _partitioning;
+    std::vector<int> _splits;
+    std::vector<std::unique_ptr<Shard> > _shards;
+};
+
+//Merges the shards in key order: range shards one after the other,
+//hash shards by always taking the smallest key. Same rules as
+//BTree::iterator within each shard.
+class ShardedBTree::iterator {
+    friend class ShardedBTree;
+private:
+    iterator(const ShardedBTree *tree, std::vector<BTree::iterator> &&its);
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef int value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const int *pointer;
+    typedef int reference;
+    iterator();
+    iterator& operator++();
+    iterator operator++(int);
+    friend bool operator==(const iterator &, const iterator &);
+    friend bool operator!=(const iterator &, const iterator &);
+    int operator*() const;
+    uint64_t value() const;
+    //shard of the current key
+    int shard() const;
+private:
+    void pick();
+    const ShardedBTree *_tree;
+    std::vector<BTree::iterator> _its;
+    int _current;               //-1 at the end
+};
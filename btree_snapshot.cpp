@@ -0,0 +1,204 @@
+#include "btree_snapshot.h"
+
+#include <stdexcept>
+
+template <typename Key>
+BasicBTreeSnapshot<Key>::BasicBTreeSnapshot(const Storage *vfs, const std::shared_ptr<typename Storage::SnapshotPages> &pages,
+                                            uint64_t root_ref, int height, uint64_t size):
+    _vfs(vfs),
+    _pages(pages),
+    _root_ref(root_ref),
+    _height(height),
+    _size(size) { }
+
+template <typename Key>
+bool BasicBTreeSnapshot<Key>::contains(Key key) const {
+    return findLeaf(key).contains(key);
+}
+
+template <typename Key>
+bool BasicBTreeSnapshot<Key>::get(Key key, uint64_t &value) const {
+    NodeView leaf = findLeaf(key);
+    int slot = leaf.lowerBound(key);
+    if (slot == leaf.keysNum() || leaf.key(slot) != key)
+        return false;
+    value = leaf.child(slot);
+    return true;
+}
+
+template <typename Key>
+uint64_t BasicBTreeSnapshot<Key>::size() const {
+    return _size;
+}
+
+template <typename Key>
+int BasicBTreeSnapshot<Key>::height() const {
+    return _height;
+}
+
+template <typename Key>
+typename BasicBTreeSnapshot<Key>::iterator BasicBTreeSnapshot<Key>::begin() const {
+    if (_size == 0) return iterator(this);
+    NodeView node = viewNode(_root_ref);
+    while (!node.isLeaf()) {
+        node = viewNode(node.sentinel() != 0 ? node.sentinel() : node.child(0));
+    }
+    iterator it(this, std::move(node), 0);
+    it.skipForward();
+    return it;
+}
+
+template <typename Key>
+typename BasicBTreeSnapshot<Key>::iterator BasicBTreeSnapshot<Key>::end() const {
+    return iterator(this);
+}
+
+template <typename Key>
+typename BasicBTreeSnapshot<Key>::iterator BasicBTreeSnapshot<Key>::lower_bound(Key key) const {
+    NodeView leaf = findLeaf(key);
+    int slot = leaf.lowerBound(key);
+    iterator it(this, std::move(leaf), slot);
+    it.skipForward();
+    return it;
+}
+
+template <typename Key>
+void BasicBTreeSnapshot<Key>::scan(Key lo, Key hi, const ScanCallback &callback) const {
+    if (lo > hi) return;
+    NodeView leaf = findLeaf(lo);
+    int from = leaf.lowerBound(lo);
+    while (true) {
+        int to = leaf.upperBound(hi);
+        if (from < to && !callback(leaf.keys() + from, to - from))
+            return;
+        if (to < leaf.keysNum() || leaf.rightSibling() == 0)
+            return;
+        leaf = viewNode(leaf.rightSibling());
+        from = 0;
+    }
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTreeSnapshot<Key>::viewNode(uint64_t ref) const {
+    return _vfs->viewNode(*_pages, ref);
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTreeSnapshot<Key>::findLeaf(Key key) const {
+    NodeView node = viewNode(_root_ref);
+    while (!node.isLeaf()) {
+        node = viewNode(node.next(key));
+    }
+    return node;
+}
+
+template <typename Key>
+BasicBTreeNodeView<Key> BasicBTreeSnapshot<Key>::lastLeaf() const {
+    NodeView node = viewNode(_root_ref);
+    while (!node.isLeaf()) {
+        node = viewNode(node.keysNum() > 0 ? node.child(node.keysNum() - 1) : node.sentinel());
+    }
+    return node;
+}
+
+template <typename Key>
+BasicBTreeSnapshot<Key>::iterator::iterator(const BasicBTreeSnapshot *snapshot):
+    _snapshot(snapshot),
+    _leaf(),
+    _slot(0) { }
+
+template <typename Key>
+BasicBTreeSnapshot<Key>::iterator::iterator(const BasicBTreeSnapshot *snapshot, NodeView &&leaf, int slot):
+    _snapshot(snapshot),
+    _leaf(std::make_shared<NodeView>(std::move(leaf))),
+    _slot(slot) { }
+
+template <typename Key>
+void BasicBTreeSnapshot<Key>::iterator::skipForward() {
+    while (_slot == _leaf->keysNum()) {
+        if (_leaf->rightSibling() == 0) {
+            _leaf.reset();
+            return;
+        }
+        _leaf = std::make_shared<NodeView>(_snapshot->viewNode(_leaf->rightSibling()));
+        _slot = 0;
+    }
+}
+
+template <typename Key>
+void BasicBTreeSnapshot<Key>::iterator::skipBackward() {
+    while (_slot < 0) {
+        if (_leaf->leftSibling() == 0) {
+            throw std::logic_error("Invalid iterator operation: decrement begin() iterator");
+        }
+        _leaf = std::make_shared<NodeView>(_snapshot->viewNode(_leaf->leftSibling()));
+        _slot = _leaf->keysNum() - 1;
+    }
+}
+
+template <typename Key>
+typename BasicBTreeSnapshot<Key>::iterator & BasicBTreeSnapshot<Key>::iterator::operator++() {
+    if (!_leaf) {
+        throw std::logic_error("Invalid iterator operation: increment end() iterator");
+    }
+    ++_slot;
+    skipForward();
+    return *this;
+}
+
+template <typename Key>
+typename BasicBTreeSnapshot<Key>::iterator BasicBTreeSnapshot<Key>::iterator::operator++(int) {
+    iterator it = *this;
+    ++*this;
+    return it;
+}
+
+template <typename Key>
+typename BasicBTreeSnapshot<Key>::iterator & BasicBTreeSnapshot<Key>::iterator::operator--() {
+    if (!_leaf) {
+        if (_snapshot->_size == 0) {
+            throw std::logic_error("Invalid iterator operation: decrement begin() iterator");
+        }
+        _leaf = std::make_shared<NodeView>(_snapshot->lastLeaf());
+        _slot = _leaf->keysNum();
+    }
+    --_slot;
+    skipBackward();
+    return *this;
+}
+
+template <typename Key>
+typename BasicBTreeSnapshot<Key>::iterator BasicBTreeSnapshot<Key>::iterator::operator--(int) {
+    iterator it = *this;
+    --*this;
+    return it;
+}
+
+template <typename Key>
+bool BasicBTreeSnapshot<Key>::iterator::operator==(const iterator &that) const {
+    if (!_leaf || !that._leaf) return !_leaf && !that._leaf;
+    return _leaf->ref() == that._leaf->ref() && _slot == that._slot;
+}
+
+template <typename Key>
+bool BasicBTreeSnapshot<Key>::iterator::operator!=(const iterator &that) const {
+    return !(*this == that);
+}
+
+template <typename Key>
+Key BasicBTreeSnapshot<Key>::iterator::operator*() const {
+    if (!_leaf) {
+        throw std::logic_error("Invalid iterator operation: dereferencing end() iterator");
+    }
+    return _leaf->key(_slot);
+}
+
+template <typename Key>
+uint64_t BasicBTreeSnapshot<Key>::iterator::value() const {
+    if (!_leaf) {
+        throw std::logic_error("Invalid iterator operation: dereferencing end() iterator");
+    }
+    return _leaf->child(_slot);
+}
+
+BTREE_INSTANTIATE(BasicBTreeSnapshot);
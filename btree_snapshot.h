@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include "btree_key.h"
+#include "btree_storage.h"
+
+template <typename Key>
+class BasicBTree;
+
+//Read-only view of a tree as it was when BTree::snapshot() was called.
+//Reads take no tree lock and never wait for writers: a page changed
+//after the snapshot is read from the image the tree kept for it.
+//Images are dropped together with the last copy of the snapshot.
+//A snapshot must not outlive its tree.
+template <typename Key>
+class BasicBTreeSnapshot {
+public:
+    typedef BasicBTreeNodeView<Key> NodeView;
+    typedef BasicBTreeStorage<Key> Storage;
+    bool contains(Key key) const;
+    bool get(Key key, uint64_t &value) const;
+    uint64_t size() const;
+    int height() const;
+    class iterator;
+    iterator begin() const;
+    iterator end() const;
+    //first key not less than key
+    iterator lower_bound(Key key) const;
+    //keys in [lo, hi] are passed leaf by leaf, return false to stop the scan
+    typedef std::function<bool (const Key *keys, int n)> ScanCallback;
+    void scan(Key lo, Key hi, const ScanCallback &callback) const;
+private:
+    friend class BasicBTree<Key>;
+    BasicBTreeSnapshot(const Storage *vfs, const std::shared_ptr<typename Storage::SnapshotPages> &pages,
+                       uint64_t root_ref, int height, uint64_t size);
+    NodeView viewNode(uint64_t ref) const;
+    NodeView findLeaf(Key key) const;
+    NodeView lastLeaf() const;
+    const Storage *_vfs;
+    std::shared_ptr<typename Storage::SnapshotPages> _pages;
+    uint64_t _root_ref;
+    int _height;
+    uint64_t _size;
+};
+
+//Cursor over the leaf level of a snapshot, same rules as BTree::iterator
+//minus the restarts: nothing it reads ever changes.
+template <typename Key>
+class BasicBTreeSnapshot<Key>::iterator {
+    friend class BasicBTreeSnapshot;
+private:
+    explicit iterator(const BasicBTreeSnapshot *snapshot);
+    iterator(const BasicBTreeSnapshot *snapshot, NodeView &&leaf, int slot);
+public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef Key value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Key *pointer;
+    typedef Key reference;
+    iterator& operator++();
+    iterator operator++(int);
+    iterator& operator--();
+    iterator operator--(int);
+    bool operator==(const iterator &that) const;
+    bool operator!=(const iterator &that) const;
+    Key operator*() const;
+    uint64_t value() const;
+private:
+    void skipForward();
+    void skipBackward();
+    const BasicBTreeSnapshot *_snapshot;
+    std::shared_ptr<const NodeView> _leaf;
+    int _slot;
+};
+
+typedef BasicBTreeSnapshot<int> BTreeSnapshot;
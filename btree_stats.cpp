@@ -0,0 +1,258 @@
+#include "btree_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+//threads take stripes round robin, so up to STRIPES threads never share one
+unsigned threadStripe() {
+    static std::atomic<unsigned> next_thread(0);
+    thread_local unsigned stripe = next_thread++ % BTreeStats::STRIPES;
+    return stripe;
+}
+
+const char *const COUNTER_NAMES[] = {
+    "read_calls", "read_bytes", "pages_read",
+    "write_calls", "write_bytes", "pages_written",
+    "cache_hits", "cache_misses",
+    "splits", "merges", "rebalances", "height_grows", "height_shrinks",
+    "pages_appended", "pages_reused", "pages_freed",
+    "extent_calls", "extent_bytes", "pages_prefetched",
+    "bloom_skips", "bloom_false_positives"
+};
+static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == BTreeStats::COUNTERS, "counter names");
+
+const char *const OPERATION_NAMES[] = { "put", "remove", "get", "batch", "scan" };
+static_assert(sizeof(OPERATION_NAMES) / sizeof(OPERATION_NAMES[0]) == BTreeStats::OPERATIONS, "operation names");
+
+}
+
+const int BTreeStats::Histogram::SUB_BITS;
+const int BTreeStats::Histogram::MAX_BITS;
+const int BTreeStats::Histogram::BUCKETS;
+const int BTreeStats::STRIPES;
+
+struct BTreeStats::Stripe {
+    Stripe() {
+        for (auto &counter: counters) {
+            counter = 0;
+        }
+        for (int op = 0; op < OPERATIONS; ++op) {
+            sums[op] = 0;
+            for (auto &bucket: buckets[op]) {
+                bucket = 0;
+            }
+        }
+    }
+    std::atomic<uint64_t> counters[COUNTERS];
+    std::atomic<uint64_t> sums[OPERATIONS];
+    std::atomic<uint64_t> buckets[OPERATIONS][Histogram::BUCKETS];
+};
+
+BTreeStats::Histogram::Histogram():
+    _buckets(BUCKETS, 0),
+    _count(0),
+    _sum(0) { }
+
+int BTreeStats::Histogram::bucket(uint64_t value) {
+    const uint64_t sub_buckets = 1 << SUB_BITS;
+    if (value < sub_buckets)
+        return value;
+    int bits = 63 - __builtin_clzll(value);
+    if (bits >= MAX_BITS)
+        return BUCKETS - 1;
+    //the top SUB_BITS bits below the leading one pick the sub-bucket
+    uint64_t sub = (value >> (bits - SUB_BITS)) & (sub_buckets - 1);
+    return ((bits - SUB_BITS + 1) << SUB_BITS) + sub;
+}
+
+uint64_t BTreeStats::Histogram::bucketMin(int bucket) {
+    const int sub_buckets = 1 << SUB_BITS;
+    if (bucket < sub_buckets)
+        return bucket;
+    int bits = (bucket >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t sub = bucket & (sub_buckets - 1);
+    return (sub_buckets + sub) << (bits - SUB_BITS);
+}
+
+uint64_t BTreeStats::Histogram::bucketMax(int bucket) {
+    if (bucket == BUCKETS - 1)
+        return UINT64_MAX;
+    return bucketMin(bucket + 1) - 1;
+}
+
+uint64_t BTreeStats::Histogram::count() const {
+    return _count;
+}
+
+uint64_t BTreeStats::Histogram::sum() const {
+    return _sum;
+}
+
+double BTreeStats::Histogram::mean() const {
+    return _count == 0 ? 0 : (double)_sum / _count;
+}
+
+uint64_t BTreeStats::Histogram::percentile(double q) const {
+    if (_count == 0)
+        return 0;
+    if (q < 0 || q > 1) {
+        throw std::logic_error("Invalid quantile");
+    }
+    uint64_t rank = std::max((uint64_t)std::ceil(q * _count), (uint64_t)1);
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += _buckets[bucket];
+        if (seen >= rank)
+            return bucketMax(bucket);
+    }
+    return bucketMax(BUCKETS - 1);
+}
+
+uint64_t BTreeStats::Histogram::max() const {
+    return percentile(1);
+}
+
+const std::vector<uint64_t> &BTreeStats::Histogram::buckets() const {
+    return _buckets;
+}
+
+double BTreeStats::Snapshot::cacheHitRatio() const {
+    uint64_t lookups = counters[CACHE_HITS] + counters[CACHE_MISSES];
+    return lookups == 0 ? 1 : (double)counters[CACHE_HITS] / lookups;
+}
+
+BTreeStats::Snapshot BTreeStats::Snapshot::since(const Snapshot &earlier) const {
+    //a reset in between makes counts smaller, those are taken as they are
+    Snapshot delta = *this;
+    for (int c = 0; c < COUNTERS; ++c) {
+        if (counters[c] >= earlier.counters[c])
+            delta.counters[c] -= earlier.counters[c];
+    }
+    for (int op = 0; op < OPERATIONS; ++op) {
+        Histogram &histogram = delta.latency[op];
+        const Histogram &before = earlier.latency[op];
+        if (histogram._count < before._count)
+            continue;
+        for (int bucket = 0; bucket < Histogram::BUCKETS; ++bucket) {
+            histogram._buckets[bucket] -= std::min(histogram._buckets[bucket], before._buckets[bucket]);
+        }
+        histogram._count -= before._count;
+        histogram._sum -= std::min(histogram._sum, before._sum);
+    }
+    return delta;
+}
+
+BTreeStats::Timer::Timer(BTreeStats &stats, Operation op):
+    _stats(stats.timing() ? &stats : nullptr),
+    _op(op) {
+    if (_stats != nullptr)
+        _start = std::chrono::steady_clock::now();
+}
+
+BTreeStats::Timer::~Timer() {
+    if (_stats == nullptr)
+        return;
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - _start;
+    _stats->record(_op, elapsed.count());
+}
+
+BTreeStats::BTreeStats(bool timing):
+    _timing(timing) {
+    for (auto &stripe: _stripes) {
+        stripe = nullptr;
+    }
+}
+
+BTreeStats::Stripe &BTreeStats::stripe() {
+    std::atomic<Stripe *> &slot = _stripes[threadStripe()];
+    Stripe *stripe = slot.load(std::memory_order_acquire);
+    if (stripe != nullptr)
+        return *stripe;
+    Stripe *created = new Stripe();
+    if (slot.compare_exchange_strong(stripe, created, std::memory_order_acq_rel))
+        return *created;
+    //another thread of the stripe was first
+    delete created;
+    return *stripe;
+}
+
+void BTreeStats::add(Counter c, uint64_t n) {
+    stripe().counters[c].fetch_add(n, std::memory_order_relaxed);
+}
+
+void BTreeStats::record(Operation op, uint64_t nanoseconds) {
+    Stripe &s = stripe();
+    s.buckets[op][Histogram::bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    s.sums[op].fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+uint64_t BTreeStats::counter(Counter c) const {
+    uint64_t total = 0;
+    for (const auto &slot: _stripes) {
+        const Stripe *stripe = slot.load(std::memory_order_acquire);
+        if (stripe != nullptr)
+            total += stripe->counters[c].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+bool BTreeStats::timing() const {
+    return _timing;
+}
+
+BTreeStats::Snapshot BTreeStats::snapshot() const {
+    Snapshot snapshot;
+    std::fill(snapshot.counters, snapshot.counters + COUNTERS, 0);
+    for (const auto &slot: _stripes) {
+        const Stripe *stripe = slot.load(std::memory_order_acquire);
+        if (stripe == nullptr)
+            continue;
+        for (int c = 0; c < COUNTERS; ++c) {
+            snapshot.counters[c] += stripe->counters[c].load(std::memory_order_relaxed);
+        }
+        for (int op = 0; op < OPERATIONS; ++op) {
+            Histogram &histogram = snapshot.latency[op];
+            for (int bucket = 0; bucket < Histogram::BUCKETS; ++bucket) {
+                uint64_t count = stripe->buckets[op][bucket].load(std::memory_order_relaxed);
+                histogram._buckets[bucket] += count;
+                histogram._count += count;
+            }
+            histogram._sum += stripe->sums[op].load(std::memory_order_relaxed);
+        }
+    }
+    return snapshot;
+}
+
+void BTreeStats::reset() {
+    for (const auto &slot: _stripes) {
+        Stripe *stripe = slot.load(std::memory_order_acquire);
+        if (stripe == nullptr)
+            continue;
+        for (auto &counter: stripe->counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        for (int op = 0; op < OPERATIONS; ++op) {
+            stripe->sums[op].store(0, std::memory_order_relaxed);
+            for (auto &bucket: stripe->buckets[op]) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+const char *BTreeStats::name(Counter c) {
+    return COUNTER_NAMES[c];
+}
+
+const char *BTreeStats::name(Operation op) {
+    return OPERATION_NAMES[op];
+}
+
+BTreeStats::~BTreeStats() {
+    for (auto &slot: _stripes) {
+        delete slot.load();
+    }
+}
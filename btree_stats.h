@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <stdint.h>
+
+//Counters and latency histograms of a tree. Each thread adds to its own
+//stripe of relaxed counters, so counting shares no cache line between
+//threads; snapshots sum the stripes. Counts of operations running during
+//a reset may land on either side of it.
+class BTreeStats {
+public:
+    enum Counter {
+        READ_CALLS,         //preads of the tree file
+        READ_BYTES,
+        PAGES_READ,         //pages read from the tree file, cache and dirty table hits are not counted
+        WRITE_CALLS,        //pwrites of the tree file, a run of adjacent pages takes one
+        WRITE_BYTES,
+        PAGES_WRITTEN,
+        CACHE_HITS,
+        CACHE_MISSES,
+        SPLITS,             //nodes created by splits
+        MERGES,
+        REBALANCES,         //underflowing nodes fixed with a sibling
+        HEIGHT_GROWS,
+        HEIGHT_SHRINKS,
+        PAGES_APPENDED,     //pages added at the end of the file
+        PAGES_REUSED,       //pages taken from the free list
+        PAGES_FREED,
+        EXTENT_CALLS,       //fallocate calls reserving file space
+        EXTENT_BYTES,
+        PAGES_PREFETCHED,   //pages read ahead of a sequential scan
+        BLOOM_SKIPS,        //lookups a leaf filter answered without the leaf
+        BLOOM_FALSE_POSITIVES,  //leaves read for a key their filter passed but they lack
+        COUNTERS
+    };
+    enum Operation {
+        PUT,
+        REMOVE,
+        GET,                //contains and get
+        BATCH,              //putMany and containsMany, per call
+        SCAN,
+        OPERATIONS
+    };
+
+    //Log-linear buckets as in HDR histograms: values below 16 have a bucket
+    //each, larger ones 16 buckets per power of two, so a bucket is at most
+    //1/16 of its values wide. Values from 2^40 on share the last bucket.
+    class Histogram {
+    public:
+        Histogram();
+        static int bucket(uint64_t value);
+        //smallest and largest value of the bucket
+        static uint64_t bucketMin(int bucket);
+        static uint64_t bucketMax(int bucket);
+        uint64_t count() const;
+        uint64_t sum() const;
+        double mean() const;
+        //largest value of the bucket holding the q quantile, q in [0, 1], 0 if empty
+        uint64_t percentile(double q) const;
+        uint64_t max() const;
+        const std::vector<uint64_t> &buckets() const;
+        static const int SUB_BITS = 4;
+        static const int MAX_BITS = 40;
+        static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+    private:
+        friend class BTreeStats;
+        std::vector<uint64_t> _buckets;
+        uint64_t _count;
+        uint64_t _sum;
+    };
+
+    struct Snapshot {
+        uint64_t counters[COUNTERS];
+        Histogram latency[OPERATIONS];  //nanoseconds
+        uint64_t counter(Counter c) const { return counters[c]; }
+        //hits of all page lookups, 1 without lookups
+        double cacheHitRatio() const;
+        //what happened since the earlier snapshot
+        Snapshot since(const Snapshot &earlier) const;
+    };
+
+    //records the time from construction to destruction
+    class Timer {
+    public:
+        Timer(BTreeStats &stats, Operation op);
+        ~Timer();
+    private:
+        BTreeStats *_stats;
+        Operation _op;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    //timing off keeps the histograms empty and operations off the clock
+    explicit BTreeStats(bool timing = true);
+    BTreeStats(const BTreeStats &) = delete;
+    BTreeStats &operator=(const BTreeStats &) = delete;
+    void add(Counter c, uint64_t n = 1);
+    void record(Operation op, uint64_t nanoseconds);
+    uint64_t counter(Counter c) const;
+    bool timing() const;
+    Snapshot snapshot() const;
+    void reset();
+    //stable names for exporting
+    static const char *name(Counter c);
+    static const char *name(Operation op);
+    ~BTreeStats();
+    static const int STRIPES = 16;
+private:
+    struct Stripe;
+    //stripe of the calling thread, allocated on first use
+    Stripe &stripe();
+    bool _timing;
+    std::atomic<Stripe *> _stripes[STRIPES];
+};
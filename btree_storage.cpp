@@ -0,0 +1,107 @@
+#include "btree_storage.h"
+
+#include <stdexcept>
+
+template <typename Key>
+BasicBTreeStorage<Key>::BasicBTreeStorage(bool timing):
+    _stats(timing) { }
+
+template <typename Key>
+std::vector<typename BasicBTreeStorage<Key>::NodeView> BasicBTreeStorage<Key>::viewNodes(
+    const std::vector<uint64_t> &refs, std::vector<bool> &read) const {
+    std::vector<NodeView> views(refs.size());
+    read.assign(refs.size(), false);
+    for (size_t i = 0; i < refs.size(); ++i) {
+        try {
+            views[i] = viewNode(refs[i]);
+            read[i] = true;
+        }
+        catch (const std::logic_error &) {
+        }
+    }
+    return views;
+}
+
+template <typename Key>
+void BasicBTreeStorage<Key>::prefetch(std::vector<uint64_t>) const { }
+
+template <typename Key>
+unsigned BasicBTreeStorage<Key>::readAhead() const {
+    return 0;
+}
+
+template <typename Key>
+unsigned BasicBTreeStorage<Key>::bloomBitsPerKey() const {
+    return 0;
+}
+
+template <typename Key>
+uint64_t BasicBTreeStorage<Key>::vacuum() {
+    return 0;
+}
+
+template <typename Key>
+uint64_t BasicBTreeStorage<Key>::prepare() {
+    return 0;
+}
+
+template <typename Key>
+void BasicBTreeStorage<Key>::commit(uint64_t) { }
+
+template <typename Key>
+void BasicBTreeStorage<Key>::commit() {
+    commit(prepare());
+}
+
+template <typename Key>
+void BasicBTreeStorage<Key>::checkpoint() { }
+
+template <typename Key>
+BTreeStats &BasicBTreeStorage<Key>::stats() const {
+    return _stats;
+}
+
+template <typename Key>
+uint64_t BasicBTreeStorage<Key>::cacheHits() const {
+    return _stats.counter(BTreeStats::CACHE_HITS);
+}
+
+template <typename Key>
+uint64_t BasicBTreeStorage<Key>::cacheMisses() const {
+    return _stats.counter(BTreeStats::CACHE_MISSES);
+}
+
+template <typename Key>
+uint64_t BasicBTreeStorage<Key>::pagesRead() const {
+    return _stats.counter(BTreeStats::PAGES_READ);
+}
+
+template <typename Key>
+uint64_t BasicBTreeStorage<Key>::pagesWritten() const {
+    return _stats.counter(BTreeStats::PAGES_WRITTEN);
+}
+
+template <typename Key>
+uint64_t BasicBTreeStorage<Key>::logSyncs() const {
+    return 0;
+}
+
+template <typename Key>
+std::shared_ptr<typename BasicBTreeStorage<Key>::SnapshotPages> BasicBTreeStorage<Key>::takeSnapshot() const {
+    throw std::logic_error("Snapshots are not supported by this storage");
+}
+
+template <typename Key>
+typename BasicBTreeStorage<Key>::NodeView BasicBTreeStorage<Key>::viewNode(const SnapshotPages &, uint64_t ref) const {
+    return viewNode(ref);
+}
+
+template <typename Key>
+size_t BasicBTreeStorage<Key>::snapshotPages() const {
+    return 0;
+}
+
+template <typename Key>
+BasicBTreeStorage<Key>::~BasicBTreeStorage() { }
+
+BTREE_INSTANTIATE(BasicBTreeStorage);
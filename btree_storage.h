@@ -0,0 +1,87 @@
+#pragma once
+#include "btree_node.h"
+#include "btree_node_view.h"
+#include "btree_stats.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+//Where a tree keeps its nodes. Refs are nonzero and refs of different
+//pages are at least pageSize() apart, the latches index pages by
+//ref / pageSize(). Backends without a log, snapshots or read-ahead keep
+//the defaults of those calls. BTreeStorage keeps int keys.
+template <typename Key>
+class BasicBTreeStorage {
+public:
+    typedef BasicBTreeNode<Key> Node;
+    typedef BasicBTreeNodeView<Key> NodeView;
+    explicit BasicBTreeStorage(bool timing = true);
+    BasicBTreeStorage(const BasicBTreeStorage &) = delete;
+    BasicBTreeStorage &operator=(const BasicBTreeStorage &) = delete;
+    virtual Node openNode(uint64_t ref) const = 0;
+    //read-only access, may point into memory of the backend
+    virtual NodeView viewNode(uint64_t ref) const = 0;
+    //view owning its page, for views kept after the tree lock is released
+    virtual NodeView copyNode(uint64_t ref) const = 0;
+    //views of many pages, read[i] is false if refs[i] could not be read
+    virtual std::vector<NodeView> viewNodes(const std::vector<uint64_t> &refs,
+                                            std::vector<bool> &read) const;
+    //hint that the pages will be read soon
+    virtual void prefetch(std::vector<uint64_t> refs) const;
+    //most leaves a scan prefetches at once, 0 without read-ahead
+    virtual unsigned readAhead() const;
+    //bits per key of the leaf Bloom filters a tree keeps, 0 without filters
+    virtual unsigned bloomBitsPerKey() const;
+    virtual void saveNode(const Node &node) = 0;
+    virtual Node allocNode(bool is_leaf) = 0;
+    virtual void freeNode(uint64_t ref) = 0;
+    //gives trailing free pages back, returns their number
+    virtual uint64_t vacuum();
+    //prepare() returns the lsn commit(lsn) waits for, 0 without a log
+    virtual uint64_t prepare();
+    virtual void commit(uint64_t lsn);
+    void commit();
+    virtual void checkpoint();
+    virtual int order() const = 0;
+    virtual uint64_t rootRef() const = 0;
+    virtual void setRootRef(uint64_t root) = 0;
+    virtual uint64_t treeSize() const = 0;
+    virtual void setTreeSize(uint64_t tree_size) = 0;
+    virtual void addTreeSize(int64_t delta) = 0;
+    virtual int treeHeight() const = 0;
+    virtual void setTreeHeight(int tree_height) = 0;
+    virtual uint32_t pageSize() const = 0;
+    //writers change the pages views point to, so readers have to shut
+    //writers out and copy the pages they keep
+    virtual bool writesInPlace() const = 0;
+    //counters of the backend and of the tree using it, shortcuts below read them
+    BTreeStats &stats() const;
+    uint64_t cacheHits() const;
+    uint64_t cacheMisses() const;
+    uint64_t pagesRead() const;
+    uint64_t pagesWritten() const;
+    virtual uint64_t logSyncs() const;
+    typedef std::shared_ptr<const std::vector<uint8_t> > PagePtr;
+    //images of pages as they were when a snapshot was taken,
+    //kept by the first change of each page after that
+    struct SnapshotPages {
+        explicit SnapshotPages(uint64_t end): end(end) { }
+        uint64_t end;               //pages from here on did not exist yet
+        mutable std::mutex mutex;
+        std::map<uint64_t, PagePtr> pages;
+    };
+    //old images are kept until the returned object is released,
+    //throws if the backend has no snapshots
+    virtual std::shared_ptr<SnapshotPages> takeSnapshot() const;
+    //view of the page as the snapshot sees it, valid while the snapshot lives
+    virtual NodeView viewNode(const SnapshotPages &snapshot, uint64_t ref) const;
+    //number of old page images held by live snapshots
+    virtual size_t snapshotPages() const;
+    virtual ~BasicBTreeStorage();
+protected:
+    mutable BTreeStats _stats;
+};
+
+typedef BasicBTreeStorage<int> BTreeStorage;
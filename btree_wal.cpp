@@ -0,0 +1,297 @@
+#include "btree_wal.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+const uint32_t RECORD_MAGIC = 0x4c574254;
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t header_len;
+    uint32_t page_size;
+    uint32_t page_count;
+    uint64_t lsn;
+};
+
+struct CrcTable {
+    uint32_t entries[256];
+    CrcTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+uint32_t crc32(const uint8_t *data, size_t length) {
+    static const CrcTable table;
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffff;
+}
+
+bool readFully(int fd, uint8_t *data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t bytes_read = pread(fd, data, length, offset);
+        if (bytes_read <= 0)
+            return false;
+        data += bytes_read;
+        length -= bytes_read;
+        offset += bytes_read;
+    }
+    return true;
+}
+
+bool writeFully(int fd, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        ssize_t bytes_written = write(fd, data, length);
+        if (bytes_written <= 0)
+            return false;
+        data += bytes_written;
+        length -= bytes_written;
+    }
+    return true;
+}
+
+}
+
+BTreeWal::BTreeWal(const std::string &filename, uint32_t page_size, const BTreeOptions &options):
+    _filename(logName(filename)),
+    _page_size(page_size),
+    _durability(options.durability),
+    _sync_interval_ms(options.wal_sync_interval_ms),
+    _group_window_us(options.wal_group_window_us),
+    _next_lsn(0),
+    _buffered_lsn(0),
+    _durable_lsn(0),
+    _size(0),
+    _syncs(0),
+    _last_batch(0),
+    _flushing(false),
+    _failed(false),
+    _stop(false) {
+    if (_durability == BTreeOptions::NONE) {
+        throw std::logic_error("Log requires a durability level");
+    }
+    //appends land at the end even after truncation
+    _fd = open(_filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_APPEND, 0644);
+    if (_fd == -1) {
+        throw std::logic_error("Could not open " + _filename);
+    }
+    if (_durability == BTreeOptions::ASYNC) {
+        _flusher = std::thread(&BTreeWal::flusherLoop, this);
+    }
+}
+
+uint64_t BTreeWal::append(const uint8_t *header, uint32_t header_len, const std::vector<Page> &pages) {
+    RecordHeader record;
+    record.magic = RECORD_MAGIC;
+    record.header_len = header_len;
+    record.page_size = _page_size;
+    record.page_count = pages.size();
+    std::unique_lock<std::mutex> lock(_mutex);
+    record.lsn = ++_next_lsn;
+    size_t start = _buffer.size();
+    size_t length = sizeof(record) + header_len + pages.size() * (sizeof(uint64_t) + _page_size);
+    _buffer.resize(start + length + sizeof(uint32_t));
+    uint8_t *out = _buffer.data() + start;
+    memcpy(out, &record, sizeof(record));
+    out += sizeof(record);
+    memcpy(out, header, header_len);
+    out += header_len;
+    for (const Page &page: pages) {
+        memcpy(out, &page.first, sizeof(page.first));
+        out += sizeof(page.first);
+        memcpy(out, page.second, _page_size);
+        out += _page_size;
+    }
+    uint32_t crc = crc32(_buffer.data() + start, length);
+    memcpy(out, &crc, sizeof(crc));
+    _buffered_lsn = record.lsn;
+    _size += length + sizeof(crc);
+    return record.lsn;
+}
+
+void BTreeWal::commit(uint64_t lsn) {
+    if (_durability == BTreeOptions::ASYNC)
+        return;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_durable_lsn < lsn) {
+        if (_failed) {
+            throw std::logic_error("Could not write " + _filename);
+        }
+        if (_flushing) {
+            //the running flush may already cover lsn
+            _flushed.wait(lock);
+            continue;
+        }
+        if (_durability == BTreeOptions::GROUP && _group_window_us != 0 && _last_batch > 1) {
+            //the leader lingers so that concurrent commits share its fsync,
+            //a lone writer does not pay for the window
+            _flushing = true;
+            _wakeup.wait_for(lock, std::chrono::microseconds(_group_window_us));
+            _flushing = false;
+        }
+        flush(lock);
+    }
+}
+
+void BTreeWal::sync() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    uint64_t lsn = _buffered_lsn;
+    while (_durable_lsn < lsn) {
+        if (_failed) {
+            throw std::logic_error("Could not write " + _filename);
+        }
+        if (_flushing)
+            _flushed.wait(lock);
+        else
+            flush(lock);
+    }
+}
+
+void BTreeWal::flush(std::unique_lock<std::mutex> &lock) {
+    std::vector<uint8_t> buffer;
+    buffer.swap(_buffer);
+    uint64_t lsn = _buffered_lsn;
+    _last_batch = lsn - _durable_lsn;
+    _flushing = true;
+    lock.unlock();
+    bool written = writeFully(_fd, buffer.data(), buffer.size()) && fdatasync(_fd) == 0;
+    lock.lock();
+    _flushing = false;
+    if (written) {
+        _durable_lsn = lsn;
+        ++_syncs;
+    }
+    else {
+        _failed = true;
+    }
+    _flushed.notify_all();
+    if (!written) {
+        throw std::logic_error("Could not write " + _filename);
+    }
+}
+
+void BTreeWal::flusherLoop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        _wakeup.wait_for(lock, std::chrono::milliseconds(_sync_interval_ms));
+        if (_flushing || _durable_lsn == _buffered_lsn || _failed)
+            continue;
+        try {
+            flush(lock);
+        }
+        catch (const std::exception &e) {
+            //reported to the next caller of commit or sync
+        }
+    }
+}
+
+void BTreeWal::truncate() {
+    sync();
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (ftruncate(_fd, 0) == -1 || fdatasync(_fd) == -1) {
+        throw std::logic_error("Could not truncate " + _filename);
+    }
+    _size = 0;
+}
+
+uint64_t BTreeWal::durableLsn() const {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _durable_lsn;
+}
+
+uint64_t BTreeWal::size() const {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _size;
+}
+
+uint64_t BTreeWal::syncs() const {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _syncs;
+}
+
+BTreeWal::~BTreeWal() {
+    if (_flusher.joinable()) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wakeup.notify_all();
+        _flusher.join();
+    }
+    try {
+        sync();
+    }
+    catch (const std::exception &e) {
+        std::cout << e.what() << std::endl;
+    }
+    close(_fd);
+}
+
+uint64_t BTreeWal::replay(const std::string &filename, const ReplayCallback &callback) {
+    int fd = open(logName(filename).c_str(), O_RDONLY);
+    if (fd == -1)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw std::logic_error("Could not stat " + logName(filename));
+    }
+    uint64_t offset = 0;
+    uint64_t replayed = 0;
+    std::vector<uint8_t> data;
+    RecordHeader record;
+    while (readFully(fd, reinterpret_cast<uint8_t *>(&record), sizeof(record), offset)) {
+        if (record.magic != RECORD_MAGIC || record.page_size == 0 ||
+            record.page_size > MAX_RECORD_PAGE || record.header_len > MAX_RECORD_PAGE) {
+            break;
+        }
+        size_t length = sizeof(record) + record.header_len +
+            (uint64_t)record.page_count * (sizeof(uint64_t) + record.page_size);
+        if (offset + length + sizeof(uint32_t) > (uint64_t)st.st_size)
+            break;
+        data.resize(length + sizeof(uint32_t));
+        if (!readFully(fd, data.data(), data.size(), offset))
+            break;
+        uint32_t crc;
+        memcpy(&crc, data.data() + length, sizeof(crc));
+        if (crc != crc32(data.data(), length))
+            break;
+        const uint8_t *in = data.data() + sizeof(record);
+        const uint8_t *header = in;
+        in += record.header_len;
+        std::vector<Page> pages;
+        for (uint32_t i = 0; i < record.page_count; ++i) {
+            uint64_t ref;
+            memcpy(&ref, in, sizeof(ref));
+            pages.push_back(Page(ref, in + sizeof(ref)));
+            in += sizeof(ref) + record.page_size;
+        }
+        callback(header, record.header_len, pages);
+        offset += data.size();
+        ++replayed;
+    }
+    close(fd);
+    return replayed;
+}
+
+std::string BTreeWal::logName(const std::string &filename) {
+    return filename + ".wal";
+}
+
+const uint32_t BTreeWal::MAX_RECORD_PAGE = 1 << 20;
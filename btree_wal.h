@@ -0,0 +1,60 @@
+#pragma once
+#include "btree_options.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+//Redo log of page after-images.
+//Every transaction is one record: header image, pages and a checksum.
+//A torn or corrupted record ends the log during recovery.
+class BTreeWal {
+public:
+    typedef std::pair<uint64_t, const uint8_t *> Page;
+    typedef std::function<void (const uint8_t *header, uint32_t header_len,
+                                const std::vector<Page> &pages)> ReplayCallback;
+    BTreeWal(const std::string &filename, uint32_t page_size, const BTreeOptions &options);
+    //buffers a transaction, returns its lsn
+    uint64_t append(const uint8_t *header, uint32_t header_len, const std::vector<Page> &pages);
+    //returns once lsn is durable, async mode returns at once
+    void commit(uint64_t lsn);
+    //makes every appended transaction durable
+    void sync();
+    //drops the log, pages must be in the tree file already
+    void truncate();
+    uint64_t durableLsn() const;
+    uint64_t size() const;
+    uint64_t syncs() const;
+    ~BTreeWal();
+    //passes complete transactions in log order, returns their number
+    static uint64_t replay(const std::string &filename, const ReplayCallback &callback);
+    static std::string logName(const std::string &filename);
+private:
+    static const uint32_t MAX_RECORD_PAGE;
+    void flush(std::unique_lock<std::mutex> &lock);
+    void flusherLoop();
+    std::string _filename;
+    int _fd;
+    uint32_t _page_size;
+    BTreeOptions::Durability _durability;
+    unsigned _sync_interval_ms;
+    unsigned _group_window_us;
+    mutable std::mutex _mutex;
+    std::condition_variable _flushed;
+    std::condition_variable _wakeup;
+    std::vector<uint8_t> _buffer;
+    uint64_t _next_lsn;
+    uint64_t _buffered_lsn;
+    uint64_t _durable_lsn;
+    uint64_t _size;
+    uint64_t _syncs;
+    uint64_t _last_batch;
+    bool _flushing;
+    bool _failed;
+    bool _stop;
+    std::thread _flusher;
+};
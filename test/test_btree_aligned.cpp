@@ -0,0 +1,148 @@
+#include "../btree.h"
+#include "../btree_builder.h"
+#include "../btree_mapped.h"
+
+#include <stdexcept>
+#include <vector>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+off_t file_size(const char *filename) {
+    struct stat st;
+    assert(stat(filename, &st) == 0);
+    return st.st_size;
+}
+
+void test_order() {
+    const uint32_t sizes[] = {512, 4096, 8192, 16384, 32768};
+    for (uint32_t size: sizes) {
+        int order = BTreeNode::maxOrder(size);
+        assert(BTreeNode::maxNodeSerializationSize(order) <= (int)size);
+        assert(BTreeNode::maxNodeSerializationSize(order + 1) > (int)size);
+    }
+}
+
+void test_invalid(int order, uint32_t page_size, bool direct_io) {
+    BTreeOptions options;
+    options.page_size = page_size;
+    options.direct_io = direct_io;
+    try {
+        BTree tree("test_btree_aligned_invalid.dat", order, options);
+        assert(false);
+    }
+    catch (const std::logic_error &) { }
+}
+
+void test_tree(const BTreeOptions &options) {
+    const int keys_num = 20000;
+    {
+        BTree tree("test_btree_aligned.dat", 0, options);
+        assert(tree.order() == BTreeNode::maxOrder(options.page_size));
+        for (int i = 0; i < keys_num; ++i) {
+            tree.put(i * 7 % keys_num, i);
+        }
+        for (int i = 0; i < keys_num; i += 2) {
+            tree.remove(i);
+        }
+        assert(tree.checkValid());
+        tree.vacuum();
+    }
+    //header and pages fill whole pages
+    assert(file_size("test_btree_aligned.dat") % options.page_size == 0);
+    BTree tree("test_btree_aligned.dat", options);
+    assert(tree.order() == BTreeNode::maxOrder(options.page_size));
+    assert(tree.size() == keys_num / 2);
+    assert(tree.checkValid());
+    for (int i = 0; i < keys_num; ++i) {
+        uint64_t value;
+        assert(tree.get(i, value) == (i % 2 == 1));
+    }
+}
+
+void test_builder() {
+    BTreeOptions options;
+    options.page_size = 4096;
+    options.direct_io = true;
+    {
+        BTreeBuilder builder("test_btree_aligned_bulk.dat", 0, 0.8, options);
+        for (int i = 0; i < 50000; ++i) {
+            builder.add(i);
+        }
+    }
+    assert(file_size("test_btree_aligned_bulk.dat") % 4096 == 0);
+    BTree tree("test_btree_aligned_bulk.dat", options);
+    assert(tree.size() == 50000);
+    assert(tree.checkValid());
+}
+
+//a header from before fixed page sizes has no valid first page offset
+void test_old_format() {
+    const char *filename = "test_btree_aligned_old.dat";
+    {
+        BTree tree(filename, 10);
+        tree.put(1);
+    }
+    BTreeFS::Header header;
+    std::vector<uint8_t> raw(BTreeFS::headerLength());
+    int fd = open(filename, O_RDWR);
+    assert(pread(fd, raw.data(), raw.size(), 0) == (ssize_t)raw.size());
+    header = BTreeFS::parseHeader(raw.data());
+    assert(BTreeFS::headerIsValid(header));
+    header.first_page = 8;
+    assert(!BTreeFS::headerIsValid(header));
+    BTreeFS::formatHeader(header, raw.data());
+    assert(pwrite(fd, raw.data(), raw.size(), 0) == (ssize_t)raw.size());
+    close(fd);
+    try {
+        BTree tree(filename);
+        assert(false);
+    }
+    catch (const std::logic_error &) { }
+    try {
+        BTreeMapped mapped(filename);
+        assert(false);
+    }
+    catch (const std::logic_error &) { }
+}
+
+int main() {
+    test_order();
+    test_invalid(0, 1000, false);
+    test_invalid(0, 256, false);
+    test_invalid(500, 4096, false);
+    test_invalid(100, 0, true);
+    test_invalid(0, 0, false);
+
+    BTreeOptions options;
+    options.page_size = 4096;
+    test_tree(options);
+    options.page_size = 512;
+    options.leaf_order = 128;
+    test_tree(options);
+    options.leaf_order = 0;
+    options.page_size = 8192;
+    options.direct_io = true;
+    test_tree(options);
+    options.cache_size = 0;
+    test_tree(options);
+    options.durability = BTreeOptions::GROUP;
+    options.cache_size = BTreeOptions::DEFAULT_CACHE_SIZE;
+    test_tree(options);
+    {
+        //a plain tree has no aligned pages to read directly
+        BTree tree("test_btree_aligned_plain.dat", 10);
+        tree.put(1);
+    }
+    options = BTreeOptions();
+    options.direct_io = true;
+    try {
+        BTree tree("test_btree_aligned_plain.dat", options);
+        assert(false);
+    }
+    catch (const std::logic_error &) { }
+    test_builder();
+    test_old_format();
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "../btree.h"
+#include "../btree_reader.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <set>
+#include <thread>
+#include <vector>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+void test_reader(bool use_uring) {
+    const char *filename = "test_btree_async_reader.dat";
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert(fd != -1);
+    std::vector<uint8_t> data(1 << 20);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = i * 7 % 251;
+    }
+    assert(pwrite(fd, data.data(), data.size(), 0) == (ssize_t)data.size());
+    //a shallow ring takes the reads in several rounds
+    BTreeReader reader(fd, 4, use_uring);
+    const size_t page = 4096;
+    std::vector<uint8_t> pages(100 * page);
+    std::vector<BTreeReader::Request> requests(101);
+    for (size_t i = 0; i < 100; ++i) {
+        requests[i].data = pages.data() + i * page;
+        requests[i].length = page;
+        requests[i].offset = (i * 37 % 256) * page;
+    }
+    //past the end of the file
+    std::vector<uint8_t> tail(page);
+    requests[100].data = tail.data();
+    requests[100].length = page;
+    requests[100].offset = data.size();
+    reader.read(requests.data(), requests.size());
+    for (size_t i = 0; i < 100; ++i) {
+        assert(requests[i].done);
+        assert(std::equal(pages.begin() + i * page, pages.begin() + (i + 1) * page,
+                          data.begin() + requests[i].offset));
+    }
+    assert(!requests[100].done);
+    if (!use_uring)
+        assert(!reader.usesUring());
+    close(fd);
+}
+
+void check_lookups(BTree &tree, const std::set<int> &present) {
+    std::vector<int> keys;
+    for (int i = 0; i < 5000; ++i) {
+        keys.push_back(rand() % 200000);
+    }
+    //repeated keys are looked up for each position
+    keys.push_back(keys.front());
+    std::vector<uint64_t> values;
+    std::vector<bool> found = tree.getMany(keys, values);
+    std::vector<bool> contained = tree.containsMany(keys);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        bool expected = present.count(keys[i]) == 1;
+        assert(found[i] == expected && contained[i] == expected);
+        assert(values[i] == (expected ? (uint64_t)keys[i] * 3 : 0));
+    }
+}
+
+void test_tree(const BTreeOptions &options) {
+    const char *filename = "test_btree_async.dat";
+    std::set<int> present;
+    {
+        BTree tree(filename, 16, options);
+        std::vector<int> keys;
+        std::vector<uint64_t> values;
+        for (int i = 0; i < 100000; ++i) {
+            int key = rand() % 200000;
+            if (present.insert(key).second) {
+                keys.push_back(key);
+                values.push_back((uint64_t)key * 3);
+            }
+        }
+        tree.putMany(keys, values);
+        //pages are still dirty or cached
+        check_lookups(tree, present);
+    }
+    BTree tree(filename, options);
+    //cold pages come from the file in batches
+    uint64_t reads = tree.pagesRead();
+    check_lookups(tree, present);
+    if (!options.use_mmap)
+        assert(tree.pagesRead() > reads);
+    check_lookups(tree, present);
+}
+
+void test_cold_batch() {
+    const char *filename = "test_btree_async_cold.dat";
+    {
+        BTree tree(filename, 32);
+        std::vector<int> keys;
+        for (int i = 0; i < 200000; ++i) {
+            keys.push_back(i);
+        }
+        tree.putMany(keys);
+    }
+    BTreeOptions options;
+    options.cache_size = 0;
+    BTree tree(filename, options);
+    std::vector<int> probes;
+    for (int i = 0; i < 256; ++i) {
+        probes.push_back(i * 781);
+    }
+    std::vector<uint64_t> values;
+    std::vector<bool> found = tree.getMany(probes, values);
+    for (bool f: found) {
+        assert(f);
+    }
+    //each page is read once, the levels share nothing but the top
+    uint64_t reads = tree.pagesRead();
+    assert(reads <= probes.size() * tree.height());
+    assert(tree.stats().counter(BTreeStats::READ_CALLS) == reads);
+}
+
+void test_concurrent() {
+    BTree tree("test_btree_async_concurrent.dat", 8);
+    std::vector<int> stable;
+    for (int i = 0; i < 20000; ++i) {
+        tree.put(i * 2, i);
+        stable.push_back(i * 2);
+    }
+    std::atomic<bool> stop(false);
+    //odd keys come and go, splits and merges run under the lookups
+    std::thread writer([&tree, &stop]() {
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < 20000; ++i) {
+                tree.put(i * 2 + 1);
+            }
+            for (int i = 0; i < 20000; ++i) {
+                tree.remove(i * 2 + 1);
+            }
+        }
+        stop = true;
+    });
+    do {
+        std::vector<uint64_t> values;
+        std::vector<bool> found = tree.getMany(stable, values);
+        for (size_t i = 0; i < stable.size(); ++i) {
+            assert(found[i] && values[i] == i);
+        }
+    } while (!stop);
+    writer.join();
+    assert(tree.checkValid());
+}
+
+int main() {
+    test_reader(true);
+    test_reader(false);
+    srand(5);
+    BTreeOptions options;
+    test_tree(options);
+    options.use_io_uring = false;
+    test_tree(options);
+    options.cache_size = 0;
+    test_tree(options);
+    options = BTreeOptions();
+    options.page_size = 4096;
+    options.direct_io = true;
+    test_tree(options);
+    options = BTreeOptions();
+    options.use_mmap = true;
+    test_tree(options);
+    options = BTreeOptions();
+    options.leaf_order = 64;
+    options.durability = BTreeOptions::GROUP;
+    test_tree(options);
+    test_cold_batch();
+    test_concurrent();
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "../btree.h"
+
+#include <set>
+#include <vector>
+#include <cstdlib>
+#include <assert.h>
+
+void check_batches(int order) {
+    BTree tree("test_btree_batch.dat", order);
+    std::set<int> present;
+    for (int round = 0; round < 30; ++round) {
+        std::vector<int> batch;
+        int batch_size = rand() % 2000;
+        for (int i = 0; i < batch_size; ++i) {
+            batch.push_back(rand() % 50000);
+        }
+        //mix in single puts
+        for (int i = 0; i < 10; ++i) {
+            int key = rand() % 50000;
+            if (present.insert(key).second)
+                tree.put(key);
+        }
+        std::vector<bool> inserted = tree.putMany(batch);
+        assert(inserted.size() == batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            assert(inserted[i] == present.insert(batch[i]).second);
+        }
+        assert(tree.size() == present.size());
+        assert(tree.checkValid());
+    }
+    std::vector<int> check(tree.begin(), tree.end());
+    assert(check == std::vector<int>(present.begin(), present.end()));
+
+    std::vector<int> probes;
+    for (int i = 0; i < 5000; ++i) {
+        probes.push_back(rand() % 60000);
+    }
+    std::vector<bool> found = tree.containsMany(probes);
+    for (size_t i = 0; i < probes.size(); ++i) {
+        assert(found[i] == (present.count(probes[i]) == 1));
+    }
+}
+
+void test_shared_paths() {
+    BTree tree("test_btree_batch_paths.dat", 50);
+    std::vector<int> keys;
+    for (int i = 0; i < 100000; ++i) {
+        keys.push_back(i);
+    }
+    std::vector<bool> inserted = tree.putMany(keys);
+    assert(tree.size() == 100000);
+    assert(tree.checkValid());
+    std::vector<int> probes;
+    for (int i = 0; i < 1000; ++i) {
+        probes.push_back(20000 + i);
+    }
+    uint64_t reads = tree.cacheHits() + tree.cacheMisses();
+    std::vector<bool> found = tree.containsMany(probes);
+    for (bool f: found) {
+        assert(f);
+    }
+    //one path down and then only the leaves holding the keys
+    uint64_t touched = tree.cacheHits() + tree.cacheMisses() - reads;
+    assert(touched <= (uint64_t)tree.height() + 2 + 1000 / 25);
+    //everything is present now
+    inserted = tree.putMany(probes);
+    for (bool i: inserted) {
+        assert(!i);
+    }
+}
+
+int main() {
+    check_batches(3);
+    check_batches(8);
+    check_batches(64);
+    test_shared_paths();
+}
@@ -0,0 +1,137 @@
+#include "../btree.h"
+#include "../btree_search.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <set>
+#include <thread>
+#include <vector>
+#include <assert.h>
+
+const int KEYS_NUM = 50000;
+
+//even keys are present, odd ones miss
+void test_misses(const BTreeOptions &options) {
+    const char *filename = "test_btree_bloom.dat";
+    {
+        BTree tree(filename, 64, options);
+        std::vector<int> keys;
+        for (int i = 0; i < KEYS_NUM; ++i) {
+            keys.push_back(i * 2);
+        }
+        tree.putMany(keys, std::vector<uint64_t>(keys.size(), 1));
+    }
+    BTree tree(filename, options);
+    //the first round builds the filters
+    for (int round = 0; round < 2; ++round) {
+        BTreeStats::Snapshot before = tree.stats().snapshot();
+        for (int i = 0; i < KEYS_NUM; ++i) {
+            assert(!tree.contains(i * 2 + 1));
+            uint64_t value;
+            assert(tree.get(i * 2, value) && value == 1);
+        }
+        BTreeStats::Snapshot round_stats = tree.stats().snapshot().since(before);
+        uint64_t skips = round_stats.counter(BTreeStats::BLOOM_SKIPS);
+        uint64_t false_positives = round_stats.counter(BTreeStats::BLOOM_FALSE_POSITIVES);
+        if (round == 1) {
+            //10 bits per key slot pass about 1% of the misses
+            assert(skips + false_positives == KEYS_NUM);
+            assert(false_positives < KEYS_NUM / 50);
+        }
+    }
+    //batches ask the same filters
+    std::vector<int> misses;
+    for (int i = 0; i < KEYS_NUM; i += 5) {
+        misses.push_back(i * 2 + 1);
+        misses.push_back(i * 2);
+    }
+    BTreeStats::Snapshot before = tree.stats().snapshot();
+    std::vector<bool> found = tree.containsMany(misses);
+    for (size_t i = 0; i < misses.size(); ++i) {
+        assert(found[i] == (misses[i] % 2 == 0));
+    }
+    uint64_t skips = tree.stats().snapshot().since(before).counter(BTreeStats::BLOOM_SKIPS);
+    assert(skips > misses.size() / 2 * 95 / 100);
+}
+
+//filters follow leaf writes, splits and merges
+void test_updates(const BTreeOptions &options) {
+    BTree tree("test_btree_bloom_updates.dat", 16, options);
+    std::set<int> present;
+    for (int i = 0; i < 100000; ++i) {
+        int key = rand() % 20000;
+        int op = rand() % 4;
+        if (op == 0 && present.insert(key).second) {
+            tree.put(key, key);
+        }
+        else if (op == 1 && present.erase(key) == 1) {
+            tree.remove(key);
+        }
+        else {
+            assert(tree.contains(key) == (present.count(key) == 1));
+        }
+    }
+    assert(tree.size() == present.size() && tree.checkValid());
+    std::vector<int> keys;
+    for (int i = 0; i < 20000; ++i) {
+        keys.push_back(i);
+    }
+    std::vector<uint64_t> values;
+    std::vector<bool> found = tree.getMany(keys, values);
+    for (int i = 0; i < 20000; ++i) {
+        assert(found[i] == (present.count(i) == 1));
+    }
+}
+
+//a key a writer has put is never ruled out by a reader
+void test_concurrent(const BTreeOptions &options) {
+    BTree tree("test_btree_bloom_concurrent.dat", 16, options);
+    const int keys_num = 20000;
+    std::atomic<int> written(0);
+    std::thread writer([&tree, &written]() {
+        for (int i = 0; i < keys_num; ++i) {
+            tree.put(i * 2);
+            written.store(i + 1, std::memory_order_release);
+        }
+    });
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 2; ++t) {
+        readers.push_back(std::thread([&tree, &written]() {
+            while (written.load(std::memory_order_acquire) < keys_num) {
+                int seen = written.load(std::memory_order_acquire);
+                for (int i = seen - 1; i >= 0 && i >= seen - 50; --i) {
+                    assert(tree.contains(i * 2));
+                    assert(!tree.contains(i * 2 + 1));
+                }
+            }
+        }));
+    }
+    writer.join();
+    for (std::thread &reader: readers) {
+        reader.join();
+    }
+    for (int i = 0; i < keys_num; ++i) {
+        assert(tree.contains(i * 2) && !tree.contains(i * 2 + 1));
+    }
+}
+
+int main() {
+    srand(5);
+    BTreeOptions options;
+    options.bloom_bits_per_key = 10;
+    for (BTreeSearch::Mode mode: { BTreeSearch::SCALAR, BTreeSearch::AVX2 }) {
+        if (!BTreeSearch::isSupported(mode))
+            continue;
+        BTreeSearch::setMode(mode);
+        test_misses(options);
+    }
+    BTreeSearch::setMode(BTreeSearch::defaultMode());
+    options.cache_size = 64 << 10;
+    test_misses(options);
+    test_updates(options);
+    test_concurrent(options);
+    options.use_mmap = true;
+    test_updates(options);
+    test_concurrent(options);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "../btree.h"
+#include "../btree_builder.h"
+
+#include <stdexcept>
+#include <cstdlib>
+#include <assert.h>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+void check_tree(const std::string &filename, const std::vector<int> &keys) {
+    BTree tree(filename);
+    assert(tree.size() == keys.size());
+    assert(tree.checkValid());
+    std::vector<int> check(tree.begin(), tree.end());
+    assert(check == keys);
+    std::vector<int> reversed(tree.rbegin(), tree.rend());
+    assert(reversed.size() == keys.size());
+    for (size_t i = 0; i < keys.size(); i += 97) {
+        assert(tree.contains(keys[i]));
+        assert(!tree.contains(keys[i] + 1));
+    }
+}
+
+void test_sizes() {
+    const int orders[] = {3, 4, 10, 50};
+    const double fills[] = {0.5, 0.7, 1.0};
+    const int sizes[] = {0, 1, 2, 5, 11, 100, 1000, 12345};
+    for (int order: orders) {
+        for (double fill: fills) {
+            for (int size: sizes) {
+                std::vector<int> keys;
+                {
+                    BTreeBuilder builder("test_btree_bulk.dat", order, fill);
+                    for (int i = 0; i < size; ++i) {
+                        builder.add(2 * i - size);
+                        keys.push_back(2 * i - size);
+                    }
+                }
+                check_tree("test_btree_bulk.dat", keys);
+            }
+        }
+    }
+}
+
+void test_invalid_order() {
+    BTreeBuilder builder("test_btree_bulk.dat", 10);
+    builder.add(5);
+    try {
+        builder.add(5);
+        assert(false);
+    }
+    catch (const std::logic_error &e) { }
+}
+
+void test_file_and_updates() {
+    std::vector<int> keys;
+    for (int i = 0; i < 100000; ++i) {
+        keys.push_back(3 * i);
+    }
+    int fd = open("test_btree_bulk_keys.bin", O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    assert(fd != -1);
+    ssize_t bytes = keys.size() * sizeof(int);
+    assert(write(fd, keys.data(), bytes) == bytes);
+    close(fd);
+    {
+        BTreeBuilder builder("test_btree_bulk_file.dat", 100, 0.8);
+        builder.addFile("test_btree_bulk_keys.bin");
+        builder.finish();
+        assert(builder.size() == keys.size());
+    }
+    BTree tree("test_btree_bulk_file.dat");
+    assert(tree.height() == 2);
+    //the loaded tree accepts regular updates
+    for (int i = 0; i < 5000; ++i) {
+        tree.put(3 * i + 1);
+        tree.remove(3 * i);
+    }
+    assert(tree.size() == keys.size());
+    assert(tree.checkValid());
+}
+
+int main() {
+    test_sizes();
+    test_invalid_order();
+    test_file_and_updates();
+}
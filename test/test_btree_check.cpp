@@ -0,0 +1,134 @@
+#include "../btree.h"
+#include "../btree_check.h"
+#include "../btree_mapped.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <vector>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+BTreeFS::Header read_header(const char *filename) {
+    std::vector<uint8_t> raw(BTreeFS::headerLength());
+    int fd = open(filename, O_RDONLY);
+    assert(pread(fd, raw.data(), raw.size(), 0) == (ssize_t)raw.size());
+    close(fd);
+    return BTreeFS::parseHeader(raw.data());
+}
+
+void write_header(const char *filename, const BTreeFS::Header &header) {
+    std::vector<uint8_t> raw(BTreeFS::headerLength());
+    BTreeFS::formatHeader(header, raw.data());
+    int fd = open(filename, O_WRONLY);
+    assert(pwrite(fd, raw.data(), raw.size(), 0) == (ssize_t)raw.size());
+    close(fd);
+}
+
+//a tree with free pages left by removes
+uint64_t build(const char *filename, const BTreeOptions &options) {
+    std::vector<int> keys;
+    for (int i = 0; i < 20000; ++i) {
+        keys.push_back(i * 2);
+    }
+    for (size_t i = keys.size() - 1; i > 0; --i) {
+        std::swap(keys[i], keys[rand() % (i + 1)]);
+    }
+    BTree tree(filename, 8, options);
+    for (int key: keys) {
+        tree.put(key);
+    }
+    for (int i = 0; i < 20000; i += 3) {
+        tree.remove(i * 2);
+    }
+    return tree.size();
+}
+
+void test_sound(const BTreeOptions &options) {
+    const char *filename = "test_btree_check.dat";
+    uint64_t size = build(filename, options);
+    BTreeFS::Header header = read_header(filename);
+    for (unsigned threads: { 1u, 3u, 16u }) {
+        BTreeCheck::Report report = BTreeCheck::run(filename, threads);
+        assert(report.ok() && report.errors.empty());
+        assert(report.keys == size && report.height == header.tree_height);
+        assert(report.free_pages == header.free_pages && report.free_pages > 0);
+        assert(report.leaked_pages == 0);
+        assert(report.nodes + report.free_pages == report.pages);
+    }
+}
+
+void test_header_repair() {
+    const char *filename = "test_btree_check_header.dat";
+    uint64_t size = build(filename, BTreeOptions());
+    BTreeFS::Header header = read_header(filename);
+    BTreeFS::Header broken = header;
+    broken.tree_size += 5;
+    broken.tree_height += 1;
+    //a free page is no root
+    broken.root_ref = broken.free_head;
+    write_header(filename, broken);
+    BTreeCheck::Report report = BTreeCheck::run(filename);
+    assert(!report.ok() && report.header_errors == 3 && !report.repaired);
+    assert(report.root_ref == header.root_ref && report.keys == size);
+    report = BTreeCheck::run(filename, 0, true);
+    assert(report.repaired);
+    assert(BTreeCheck::run(filename).ok());
+    BTree tree(filename);
+    assert(tree.size() == size && tree.checkValid());
+}
+
+void test_broken_page() {
+    const char *filename = "test_btree_check_page.dat";
+    build(filename, BTreeOptions());
+    uint64_t leaf;
+    {
+        BTreeMapped mapped(filename);
+        BTreeNodeView node = mapped.viewNode(mapped.rootRef());
+        while (!node.isLeaf()) {
+            node = mapped.viewNode(node.sentinel() != 0 ? node.sentinel() : node.child(0));
+        }
+        leaf = node.ref();
+    }
+    //the first key of the leaf now sorts last
+    int fd = open(filename, O_WRONLY);
+    int key = INT_MAX;
+    assert(pwrite(fd, &key, sizeof(key), leaf + BTreeNode::HEADER_SIZE) == sizeof(key));
+    close(fd);
+    BTreeFS::Header header = read_header(filename);
+    header.tree_size += 1;
+    write_header(filename, header);
+    //the header is not repaired over a broken page
+    BTreeCheck::Report report = BTreeCheck::run(filename, 0, true);
+    assert(!report.ok() && report.header_errors == 1 && !report.repaired);
+    assert(read_header(filename).tree_size == header.tree_size);
+}
+
+void test_leaked() {
+    const char *filename = "test_btree_check_leaked.dat";
+    build(filename, BTreeOptions());
+    BTreeFS::Header header = read_header(filename);
+    uint64_t free_pages = header.free_pages;
+    header.free_head = 0;
+    header.free_pages = 0;
+    write_header(filename, header);
+    BTreeCheck::Report report = BTreeCheck::run(filename);
+    assert(!report.ok() && report.header_errors == 0);
+    assert(report.leaked_pages == free_pages && report.free_pages == 0);
+}
+
+int main() {
+    srand(3);
+    BTreeOptions options;
+    test_sound(options);
+    options.page_size = 4096;
+    test_sound(options);
+    options = BTreeOptions();
+    options.leaf_order = 64;
+    test_sound(options);
+    test_header_repair();
+    test_broken_page();
+    test_leaked();
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include "../btree.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <assert.h>
+
+const int THREADS_NUM = 4;
+const int STABLE_NUM = 5000;
+
+//keys of thread t are t + 1 modulo THREADS_NUM + 1, stable keys are 0 modulo
+int thread_key(int t, int i) {
+    return i * (THREADS_NUM + 1) + t + 1;
+}
+
+void test_mixed(const BTreeOptions &options, int ops) {
+    const char *filename = "test_btree_concurrent.dat";
+    {
+        BTree tree(filename, 8, options);
+        std::vector<int> stable_keys;
+        std::vector<uint64_t> stable_values;
+        for (int i = 0; i < STABLE_NUM; ++i) {
+            stable_keys.push_back(i * (THREADS_NUM + 1));
+            stable_values.push_back(i);
+        }
+        tree.putMany(stable_keys, stable_values);
+        std::atomic<bool> done(false);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < THREADS_NUM; ++t) {
+            writers.push_back(std::thread([&tree, t, ops]() {
+                for (int i = 0; i < ops; ++i) {
+                    tree.put(thread_key(t, i), i);
+                }
+                //remove every other key, leaves shrink and merge under readers
+                for (int i = 0; i < ops; i += 2) {
+                    tree.remove(thread_key(t, i));
+                }
+                for (int i = 1; i < ops; i += 2) {
+                    uint64_t value;
+                    assert(tree.get(thread_key(t, i), value) && value == (uint64_t)i);
+                    assert(!tree.contains(thread_key(t, i - 1)));
+                }
+            }));
+        }
+        std::vector<std::thread> readers;
+        readers.push_back(std::thread([&tree, &done]() {
+            while (!done) {
+                for (int i = 0; i < STABLE_NUM; i += 7) {
+                    uint64_t value;
+                    assert(tree.get(i * (THREADS_NUM + 1), value) && value == (uint64_t)i);
+                }
+            }
+        }));
+        readers.push_back(std::thread([&tree, &done]() {
+            while (!done) {
+                //keys stay ordered and no stable key is skipped
+                int stable = 0;
+                int prev = -1;
+                for (int key: tree) {
+                    assert(key > prev);
+                    prev = key;
+                    if (key % (THREADS_NUM + 1) == 0) {
+                        assert(key == stable * (THREADS_NUM + 1));
+                        ++stable;
+                    }
+                }
+                assert(stable == STABLE_NUM);
+            }
+        }));
+        readers.push_back(std::thread([&tree, &done, &stable_keys]() {
+            while (!done) {
+                std::vector<bool> found = tree.containsMany(stable_keys);
+                for (bool f: found) {
+                    assert(f);
+                }
+            }
+        }));
+        for (std::thread &thread: writers) {
+            thread.join();
+        }
+        done = true;
+        for (std::thread &thread: readers) {
+            thread.join();
+        }
+        assert(tree.checkValid());
+        assert(tree.size() == (uint64_t)(STABLE_NUM + THREADS_NUM * (ops / 2)));
+    }
+    BTree tree(filename);
+    assert(tree.checkValid());
+    assert(tree.size() == (uint64_t)(STABLE_NUM + THREADS_NUM * (ops / 2)));
+}
+
+void test_group_commit() {
+    const char *filename = "test_btree_concurrent_group.dat";
+    const int ops = 200;
+    BTreeOptions options;
+    options.durability = BTreeOptions::GROUP;
+    options.wal_group_window_us = 1000;
+    BTree tree(filename, 32, options);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < THREADS_NUM; ++t) {
+        writers.push_back(std::thread([&tree, t]() {
+            for (int i = 0; i < ops; ++i) {
+                tree.put(thread_key(t, i), i);
+            }
+        }));
+    }
+    for (std::thread &thread: writers) {
+        thread.join();
+    }
+    assert(tree.size() == (uint64_t)THREADS_NUM * ops);
+    assert(tree.checkValid());
+    //concurrent writers share log fsyncs
+    assert(tree.logSyncs() < (uint64_t)THREADS_NUM * ops);
+}
+
+//versions stay put while the directory of chunks grows under readers
+void test_latches() {
+    const uint32_t page_size = 100;
+    BTreeLatches latches(page_size);
+    std::vector<uint64_t> refs;
+    for (uint64_t page = 0; page < 1000000; page += 997) {
+        refs.push_back(page * page_size);
+    }
+    refs.push_back(((uint64_t)1 << 32) * page_size - page_size);
+    std::atomic<bool> done(false);
+    std::thread reader([&latches, &done]() {
+        while (!done) {
+            assert(latches.readLock(0) % 2 == 0);
+        }
+    });
+    for (uint64_t ref: refs) {
+        uint64_t version = latches.readLock(ref);
+        assert(latches.tryLock(ref, version));
+        latches.unlock(ref);
+        assert(latches.validate(ref, version + 2));
+    }
+    done = true;
+    reader.join();
+    for (uint64_t ref: refs) {
+        assert(latches.readLock(ref) == 2);
+    }
+    bool thrown = false;
+    try {
+        latches.readLock(((uint64_t)1 << 32) * page_size);
+    }
+    catch (const std::logic_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+int main() {
+    test_latches();
+    BTreeOptions options;
+    test_mixed(options, 5000);
+    //every page access goes through the file and the dirty table
+    options.cache_size = 0;
+    options.dirty_limit = 64 << 10;
+    test_mixed(options, 2000);
+    options.cache_size = BTreeOptions::DEFAULT_CACHE_SIZE;
+    options.use_mmap = true;
+    test_mixed(options, 2000);
+    options.use_mmap = false;
+    options.durability = BTreeOptions::GROUP;
+    test_mixed(options, 200);
+    //staged pages of logged writers are evicted while readers miss on them
+    options.durability = BTreeOptions::ASYNC;
+    options.cache_size = 4 * BTreeNode::maxNodeSerializationSize(8);
+    test_mixed(options, 1000);
+    test_group_commit();
+    return 0;
+}
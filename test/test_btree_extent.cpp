@@ -0,0 +1,89 @@
+#include "../btree.h"
+#include "../btree_fs.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct stat file_stat(const char *filename) {
+    struct stat st;
+    assert(stat(filename, &st) == 0);
+    return st;
+}
+
+//the tree falls back to plain writes where the filesystem has no fallocate
+bool fallocate_supported() {
+    const char *filename = "test_btree_extent_probe.dat";
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert(fd != -1);
+    bool supported = fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, 4096) == 0;
+    close(fd);
+    unlink(filename);
+    return supported;
+}
+
+//writes pages_num nodes and returns the fallocate calls it took
+uint64_t fill(const BTreeOptions &options, int pages_num) {
+    const char *filename = "test_btree_extent.dat";
+    uint64_t calls;
+    {
+        BTreeFS fs(filename, 100, options);
+        for (int i = 0; i < pages_num; ++i) {
+            BTreeNode node = fs.allocNode(true);
+            node.put(i, i);
+            fs.saveNode(node);
+            fs.commit();
+        }
+        calls = fs.extentCalls();
+        if (calls != 0 && !options.use_mmap) {
+            //the reserved blocks are there before the pages are written
+            struct stat st = file_stat(filename);
+            assert((uint64_t)st.st_blocks * 512 >= pages_num * fs.pageSize());
+        }
+    }
+    struct stat st = file_stat(filename);
+    //reserving space does not change what the file holds
+    BTreeFS fs(filename);
+    assert(fs.pagesAllocated() == (uint64_t)pages_num);
+    if (!options.use_mmap) {
+        //unused reserved blocks are released on close
+        assert(st.st_blocks * 512 < st.st_size + (64 << 10));
+    }
+    return calls;
+}
+
+int main() {
+    bool supported = fallocate_supported();
+    BTreeOptions options;
+    options.dirty_limit = 0;
+    //extents double with the file, so 40000 pages of 1.2K take a handful
+    uint64_t calls = fill(options, 40000);
+    assert(supported ? calls > 0 && calls < 10 : calls == 0);
+    options.extent_size = 0;
+    assert(fill(options, 1000) == 0);
+    options.extent_size = 64 << 10;
+    options.max_extent_size = 64 << 10;
+    //fixed extents once the limit is reached
+    calls = fill(options, 4000);
+    assert(supported ? calls > 40 && calls < 100 : calls == 0);
+    options = BTreeOptions();
+    options.use_mmap = true;
+    calls = fill(options, 5000);
+    assert(supported ? calls > 0 : calls == 0);
+
+    //reopened trees go on reserving from their end
+    {
+        BTree tree("test_btree_extent_tree.dat", 16);
+        for (int i = 0; i < 50000; ++i) {
+            tree.put(i);
+        }
+    }
+    BTree tree("test_btree_extent_tree.dat");
+    for (int i = 50000; i < 100000; ++i) {
+        tree.put(i);
+    }
+    assert(tree.size() == 100000);
+    assert(tree.checkValid());
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "../btree.h"
+
+#include <set>
+#include <vector>
+#include <cstdlib>
+#include <assert.h>
+#include <sys/stat.h>
+
+off_t file_size(const char *filename) {
+    struct stat st;
+    assert(stat(filename, &st) == 0);
+    return st.st_size;
+}
+
+void test_churn(const BTreeOptions &options) {
+    const char *filename = "test_btree_free.dat";
+    BTree tree(filename, 8, options);
+    std::set<int> keys;
+    while (keys.size() < 5000) {
+        int key = rand();
+        if (keys.insert(key).second)
+            tree.put(key);
+    }
+    off_t full_size = file_size(filename);
+    //steady removes and inserts keep the file at its live size
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < 4000; ++i) {
+            auto it = keys.lower_bound(rand());
+            if (it == keys.end()) it = keys.begin();
+            tree.remove(*it);
+            keys.erase(it);
+        }
+        assert(tree.checkValid());
+        while (keys.size() < 5000) {
+            int key = rand();
+            if (keys.insert(key).second)
+                tree.put(key);
+        }
+        assert(tree.checkValid());
+    }
+    assert(file_size(filename) <= full_size * 3 / 2);
+    std::vector<int> check(tree.begin(), tree.end());
+    assert(check == std::vector<int>(keys.begin(), keys.end()));
+}
+
+void test_vacuum(const BTreeOptions &options) {
+    const char *filename = "test_btree_vacuum.dat";
+    {
+        BTree tree(filename, 8, options);
+        for (int i = 0; i < 20000; ++i) {
+            tree.put(i);
+        }
+        //sequential inserts allocate the rightmost leaves last
+        for (int i = 19999; i >= 1000; --i) {
+            tree.remove(i);
+        }
+        assert(tree.checkValid());
+        assert(tree.vacuum() > 0);
+        assert(tree.vacuum() == 0);
+        for (int i = 1000; i < 3000; ++i) {
+            tree.put(i);
+        }
+        assert(tree.checkValid());
+    }
+    off_t vacuumed_size = file_size(filename);
+    BTree reopened(filename, options);
+    assert(reopened.size() == 3000);
+    assert(reopened.checkValid());
+    for (int i = 3000; i < 4000; ++i) {
+        reopened.put(i);
+    }
+    for (int i = 0; i < 4000; i += 2) {
+        reopened.remove(i);
+    }
+    assert(reopened.checkValid());
+    assert(vacuumed_size < 20000 * 8);
+}
+
+int main() {
+    BTreeOptions options;
+    test_churn(options);
+    test_vacuum(options);
+    options.use_mmap = true;
+    test_churn(options);
+    test_vacuum(options);
+}
@@ -1,9 +1,11 @@
 #include "../btree.h"
 #include <vector>
+#include <algorithm>
+#include <cstdlib>
 #include <assert.h>
 #include <iostream>
 
-int main() {
+void test_forward() {
     BTree tree("test_btree_it.dat", 3);
     tree.put(1);
     tree.put(-1);
@@ -26,4 +28,66 @@ int main() {
     assert(check[6] == 18);
     assert(check[7] == 23);
     assert(check.size() == 8);
+
+    std::vector<int> reversed;
+    for (BTree::reverse_iterator it = tree.rbegin(); it != tree.rend(); ++it) {
+        reversed.push_back(*it);
+    }
+    std::reverse(reversed.begin(), reversed.end());
+    assert(reversed == check);
+
+    BTree::iterator it = tree.end();
+    --it;
+    assert(*it == 23);
+    it--;
+    assert(*it-- == 18);
+    assert(*it == 6);
+}
+
+void test_scan_after_removes() {
+    BTree tree("test_btree_it_remove.dat", 8);
+    std::vector<int> values;
+    for (int i = 0; i < 5000; ++i) {
+        int val = rand();
+        try {
+            tree.put(val);
+            values.push_back(val);
+        }
+        catch (const std::logic_error &e) {
+            //key exists
+        }
+    }
+    for (int i = 0; i < 3000; ++i) {
+        int idx = rand() % values.size();
+        tree.remove(values[idx]);
+        values.erase(values.begin() + idx);
+    }
+    std::sort(values.begin(), values.end());
+    std::vector<int> check(tree.begin(), tree.end());
+    assert(check == values);
+    std::vector<int> reversed(tree.rbegin(), tree.rend());
+    std::reverse(reversed.begin(), reversed.end());
+    assert(reversed == values);
+}
+
+void test_scan_reads_leaf_once() {
+    const int order = 10;
+    BTree tree("test_btree_it_scan.dat", order);
+    for (int i = 0; i < 10000; ++i) {
+        tree.put(i);
+    }
+    uint64_t reads = tree.cacheHits() + tree.cacheMisses();
+    int count = 0;
+    for (BTree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        assert(*it == count++);
+    }
+    assert(count == 10000);
+    uint64_t max_leaves = 10000 / (order / 2);
+    assert(tree.cacheHits() + tree.cacheMisses() - reads <= max_leaves + tree.height());
+}
+
+int main() {
+    test_forward();
+    test_scan_after_removes();
+    test_scan_reads_leaf_once();
 }
@@ -0,0 +1,168 @@
+#include "../btree.h"
+#include "../btree_builder.h"
+#include "../btree_check.h"
+#include "../btree_memory.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include <assert.h>
+
+const int KEYS_NUM = 20000;
+
+//i-th key of a type, increasing in i and spread over the whole range
+template <typename Key>
+Key key_at(int i);
+
+template <>
+int64_t key_at<int64_t>(int i) {
+    return (int64_t)(i - KEYS_NUM) << 40;
+}
+
+//the upper half is above INT64_MAX
+template <>
+uint64_t key_at<uint64_t>(int i) {
+    return (uint64_t)i << 48;
+}
+
+template <>
+BTreeId key_at<BTreeId>(int i) {
+    return BTreeId{(uint64_t)i / 3, (uint64_t)(i % 3) << 62};
+}
+
+//even keys are present
+template <typename Key>
+void check_tree(const BasicBTree<Key> &tree) {
+    assert(tree.checkValid());
+    assert(tree.size() == (uint64_t)KEYS_NUM);
+    int i = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it, i += 2) {
+        assert(*it == key_at<Key>(i));
+        assert(it.value() == (uint64_t)i);
+    }
+    assert(i == KEYS_NUM * 2);
+    for (int i = 0; i < KEYS_NUM * 2; i += 7) {
+        uint64_t value;
+        assert(tree.get(key_at<Key>(i), value) == (i % 2 == 0));
+        assert(i % 2 != 0 || value == (uint64_t)i);
+        auto it = tree.lower_bound(key_at<Key>(i));
+        assert(it != tree.end() && *it == key_at<Key>(i + i % 2));
+    }
+    std::vector<Key> keys(100);
+    assert(tree.scan(key_at<Key>(101), key_at<Key>(300), keys.data(), keys.size()) == 100);
+    for (int i = 0; i < 100; ++i) {
+        assert(keys[i] == key_at<Key>(102 + i * 2));
+    }
+    assert(*tree.rbegin() == key_at<Key>(KEYS_NUM * 2 - 2));
+}
+
+template <typename Key>
+void test_tree(const char *filename, const BTreeOptions &options) {
+    std::vector<int> order;
+    for (int i = 0; i < KEYS_NUM * 2; ++i) {
+        order.push_back(i);
+    }
+    std::random_shuffle(order.begin(), order.end());
+    {
+        BasicBTree<Key> tree(filename, 16, options);
+        for (int i: order) {
+            tree.put(key_at<Key>(i), i);
+        }
+        for (int i: order) {
+            if (i % 2 != 0)
+                tree.remove(key_at<Key>(i));
+        }
+        check_tree(tree);
+        BasicBTreeSnapshot<Key> snapshot = tree.snapshot();
+        tree.remove(key_at<Key>(0));
+        assert(snapshot.contains(key_at<Key>(0)) && !tree.contains(key_at<Key>(0)));
+        tree.put(key_at<Key>(0), 0);
+    }
+    BasicBTree<Key> tree(filename, options);
+    check_tree(tree);
+}
+
+template <typename Key>
+void test_builder(const char *filename) {
+    {
+        BasicBTreeBuilder<Key> builder(filename, 16);
+        for (int i = 0; i < KEYS_NUM * 2; i += 2) {
+            builder.add(key_at<Key>(i), i);
+        }
+        try {
+            builder.add(key_at<Key>(0));
+            assert(false);
+        }
+        catch (const std::logic_error &) { }
+    }
+    check_tree(BasicBTree<Key>(filename));
+}
+
+//ids in memory
+void test_memory() {
+    std::unique_ptr<BasicBTreeStorage<BTreeId>> storage(new BasicBTreeMemory<BTreeId>(8));
+    BasicBTree<BTreeId> tree(std::move(storage));
+    for (int i = KEYS_NUM * 2 - 1; i >= 0; --i) {
+        tree.put(key_at<BTreeId>(i), i);
+    }
+    for (int i = 1; i < KEYS_NUM * 2; i += 2) {
+        tree.remove(key_at<BTreeId>(i));
+    }
+    check_tree(tree);
+}
+
+template <typename Tree>
+void expect_throw(const char *filename, const BTreeOptions &options = BTreeOptions()) {
+    try {
+        Tree tree(filename, options);
+        assert(false);
+    }
+    catch (const std::logic_error &) { }
+}
+
+//a file opens with the key type it was written with only
+void test_key_type() {
+    const char *filename = "test_btree_keys_type.dat";
+    {
+        BasicBTree<int64_t> tree(filename, 16);
+        tree.put(-1);
+    }
+    BTreeOptions mapped;
+    mapped.use_mmap = true;
+    expect_throw<BTree>(filename);
+    expect_throw<BasicBTree<uint64_t>>(filename);
+    expect_throw<BasicBTree<BTreeId>>(filename, mapped);
+    assert(BTreeCheck::run(filename).errors_num == 1);
+    BasicBTree<int64_t> tree(filename, mapped);
+    assert(tree.contains(-1) && tree.size() == 1);
+    //id leaves are not packed
+    BTreeOptions packed;
+    packed.leaf_order = 64;
+    try {
+        BasicBTree<BTreeId> tree("test_btree_keys_packed_id.dat", 16, packed);
+        assert(false);
+    }
+    catch (const std::logic_error &) { }
+}
+
+int main() {
+    srand(9);
+    BTreeOptions options;
+    test_tree<int64_t>("test_btree_keys_int64.dat", options);
+    test_tree<uint64_t>("test_btree_keys_uint64.dat", options);
+    test_tree<BTreeId>("test_btree_keys_id.dat", options);
+    BTreeOptions packed = options;
+    packed.leaf_order = 64;
+    test_tree<int64_t>("test_btree_keys_int64_packed.dat", packed);
+    test_tree<uint64_t>("test_btree_keys_uint64_packed.dat", packed);
+    BTreeOptions cached = options;
+    cached.cache_size = 64 << 10;
+    cached.bloom_bits_per_key = 10;
+    test_tree<BTreeId>("test_btree_keys_id_cached.dat", cached);
+    test_builder<int64_t>("test_btree_keys_int64_built.dat");
+    test_builder<BTreeId>("test_btree_keys_id_built.dat");
+    test_memory();
+    test_key_type();
+    return 0;
+}
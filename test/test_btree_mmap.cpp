@@ -0,0 +1,74 @@
+#include "../btree.h"
+
+#include <stdexcept>
+#include <cstdlib>
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+
+void test_view() {
+    BTreeNode node(4, 4096, false);
+    node.setSentinel(8192);
+    node.addChild(-7, 12288);
+    node.addChild(3, 16384);
+    node.addChild(15, 20480);
+    node.setKeysNum(3);
+    std::vector<uint8_t> page(BTreeNode::maxNodeSerializationSize(4));
+    node.serialize(page.data());
+    BTreeNodeView view(page.data(), page.size());
+    assert(view.keysNum() == 3);
+    assert(view.ref() == 4096);
+    assert(!view.isLeaf());
+    assert(view.minKey() == -7);
+    assert(view.maxKey() == 15);
+    assert(view.contains(3));
+    assert(!view.contains(4));
+    assert(view.next(-100) == 8192);
+    assert(view.next(3) == 16384);
+    assert(view.next(100) == 20480);
+    BTreeNodeView copy(std::move(page));
+    assert(copy.child(1) == 16384);
+}
+
+int main() {
+    test_view();
+
+    BTreeOptions options;
+    options.use_mmap = true;
+    std::vector<int> values;
+    {
+        BTree tree("test_btree_mmap.dat", 16, options);
+        for (int i = 0; i < 20000; ++i) {
+            int val = rand();
+            try {
+                tree.put(val);
+                values.push_back(val);
+            }
+            catch (const std::logic_error &e) {
+                //key exists
+            }
+        }
+        assert(tree.checkValid());
+        for (int i = 0; i < 100; ++i) {
+            assert(tree.contains(values[rand() % values.size()]));
+        }
+        for (int i = 0; i < 1000; ++i) {
+            int idx = rand() % values.size();
+            tree.remove(values[idx]);
+            values.erase(values.begin() + idx);
+        }
+        assert(tree.checkValid());
+    }
+    //reopen mapped and compare with the keys put and with the pread path
+    BTree mapped("test_btree_mmap.dat", options);
+    BTree pread("test_btree_mmap.dat", BTreeOptions());
+    assert(mapped.size() == values.size() && pread.size() == values.size());
+    std::sort(values.begin(), values.end());
+    size_t idx = 0;
+    BTree::iterator other = pread.begin();
+    for (BTree::iterator it = mapped.begin(); it != mapped.end(); ++it, ++other, ++idx) {
+        assert(*it == values[idx] && *other == *it);
+    }
+    assert(idx == values.size() && other == pread.end());
+    assert(mapped.checkValid() && pread.checkValid());
+}
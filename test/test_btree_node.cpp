@@ -61,4 +61,17 @@ int main() {
     node.put(new_node);
     assert(node.contains(-5));
     assert(node.keysNum() == 5);
+    //test bounds
+    assert(node.lowerBound(-674) == 0);
+    assert(node.lowerBound(-5) == 1);
+    assert(node.upperBound(-5) == 2);
+    assert(node.upperBound(100) == 5);
+    //test moveTail
+    BTreeNode tail = BTreeNode(4, rand(), true);
+    node.moveTail(tail, 2);
+    assert(node.keysNum() == 3);
+    assert(node.maxKey() == -3);
+    assert(tail.keysNum() == 2);
+    assert(tail.minKey() == 10);
+    assert(tail.child(1) == 43512);
 }
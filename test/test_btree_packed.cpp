@@ -0,0 +1,199 @@
+#include "../btree.h"
+#include "../btree_builder.h"
+#include "../btree_pack.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <set>
+#include <stdexcept>
+#include <vector>
+#include <assert.h>
+#include <sys/stat.h>
+
+off_t file_size(const char *filename) {
+    struct stat st;
+    assert(stat(filename, &st) == 0);
+    return st.st_size;
+}
+
+void round_trip(const std::vector<int> &keys, const std::vector<uint64_t> &values) {
+    std::vector<uint8_t> page(BTreePack::packedSize(keys.data(), values.data(), keys.size()));
+    size_t size = BTreePack::pack(keys.data(), values.data(), keys.size(), page.data());
+    assert(size == page.size());
+    std::vector<int> unpacked_keys(keys.size());
+    std::vector<uint64_t> unpacked_values(values.size());
+    BTreePack::unpack(page.data(), page.size(), keys.size(), unpacked_keys.data(), unpacked_values.data());
+    assert(unpacked_keys == keys);
+    assert(unpacked_values == values);
+    if (size > 0) {
+        //a cut page is rejected
+        try {
+            BTreePack::unpack(page.data(), size - 1, keys.size(), unpacked_keys.data(), unpacked_values.data());
+            assert(false);
+        }
+        catch (const std::logic_error &) { }
+    }
+}
+
+void test_pack() {
+    round_trip({}, {});
+    round_trip({INT_MIN, -1, 0, INT_MAX}, {0, UINT64_MAX, 1, UINT64_MAX - 1});
+    std::vector<int> keys;
+    std::vector<uint64_t> values;
+    for (int i = 0; i < 100; ++i) {
+        keys.push_back(1000 + i);
+        values.push_back(0);
+    }
+    //dense keys and equal values take a few bits each
+    size_t size = BTreePack::packedSize(keys.data(), values.data(), keys.size());
+    assert(size < keys.size() * (sizeof(int) + sizeof(uint64_t)) / 4);
+    round_trip(keys, values);
+    srand(7);
+    keys.clear();
+    values.clear();
+    for (int i = 0; i < 77; ++i) {
+        keys.push_back(rand() - RAND_MAX / 2);
+        values.push_back((uint64_t)rand() << (i % 40));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    values.resize(keys.size());
+    round_trip(keys, values);
+}
+
+void test_node() {
+    BTreeNode node(100, 8, true);
+    node.setPacked(BTreeNode::maxNodeSerializationSize(4));
+    for (int i = 0; i < 8; ++i) {
+        node.put(i, 0);
+    }
+    assert(!node.isFull());
+    std::vector<uint8_t> page(node.packedPageSize());
+    assert(node.serialize(page.data()) == (int)page.size());
+    assert(BTreeNode::deserialize(page.data(), page.size()) == node);
+    BTreeNodeView view(page.data(), page.size());
+    assert(view.isPacked() && view.keysNum() == 8 && view.contains(7) && !view.contains(8));
+    //far apart keys with wide values outgrow the page before the order
+    for (int i = 1; i < 8; ++i) {
+        node.put(i << 24, UINT64_MAX - i);
+    }
+    assert(node.keysNum() < node.order());
+    assert(node.isFull());
+}
+
+void check_tree(BTree &tree, const std::vector<int> &keys) {
+    assert(tree.checkValid());
+    assert(tree.size() == keys.size());
+    assert(std::vector<int>(tree.begin(), tree.end()) == keys);
+}
+
+void test_tree(const BTreeOptions &options) {
+    const int keys_num = 50000;
+    std::vector<int> keys;
+    {
+        BTree plain("test_btree_packed_plain.dat", 16);
+        BTreeOptions packed_options = options;
+        packed_options.leaf_order = 256;
+        BTree tree("test_btree_packed.dat", 16, packed_options);
+        for (int i = 0; i < keys_num; ++i) {
+            plain.put(i, i / 64);
+            tree.put(i, i / 64);
+            keys.push_back(i);
+        }
+        check_tree(tree, keys);
+        uint64_t value;
+        assert(tree.get(12345, value) && value == 12345 / 64);
+        assert(tree.height() < plain.height());
+    }
+    assert(file_size("test_btree_packed.dat") * 3 < file_size("test_btree_packed_plain.dat"));
+    {
+        BTree tree("test_btree_packed.dat");
+        check_tree(tree, keys);
+        for (int i = 0; i < keys_num; i += 3) {
+            tree.remove(i);
+        }
+        keys.erase(std::remove_if(keys.begin(), keys.end(), [](int key) { return key % 3 == 0; }), keys.end());
+        check_tree(tree, keys);
+    }
+    BTree tree("test_btree_packed.dat");
+    check_tree(tree, keys);
+    tree.put(0, 42);
+    uint64_t value;
+    assert(tree.get(0, value) && value == 42);
+}
+
+void test_random() {
+    BTreeOptions options;
+    options.leaf_order = 64;
+    BTree tree("test_btree_packed_random.dat", 8, options);
+    std::set<int> unique;
+    srand(11);
+    for (int i = 0; i < 10000; ++i) {
+        //a few outliers make blocks wide and force size based splits
+        int key = i % 50 == 0 ? rand() - RAND_MAX / 2 : rand() % 100000;
+        if (!unique.insert(key).second)
+            continue;
+        tree.put(key, (uint64_t)rand() << (i % 32));
+    }
+    std::vector<int> keys(unique.begin(), unique.end());
+    check_tree(tree, keys);
+    std::random_shuffle(keys.begin(), keys.end());
+    std::vector<int> removed(keys.begin(), keys.begin() + keys.size() * 9 / 10);
+    keys.erase(keys.begin(), keys.begin() + removed.size());
+    for (int key: removed) {
+        tree.remove(key);
+        assert(!tree.contains(key));
+    }
+    std::sort(keys.begin(), keys.end());
+    check_tree(tree, keys);
+}
+
+void test_builder_and_batch() {
+    BTreeOptions options;
+    options.leaf_order = 128;
+    std::vector<int> keys;
+    {
+        BTreeBuilder builder("test_btree_packed_bulk.dat", 16, 0.9, options);
+        for (int i = 0; i < 30000; ++i) {
+            //clusters far apart
+            int key = i + i / 1000 * 1000000;
+            builder.add(key, i);
+            keys.push_back(key);
+        }
+    }
+    BTree tree("test_btree_packed_bulk.dat");
+    check_tree(tree, keys);
+    std::vector<int> batch;
+    for (int i = 0; i < 30000; ++i) {
+        batch.push_back(-7 * i);
+    }
+    std::vector<bool> inserted = tree.putMany(batch);
+    assert(std::count(inserted.begin(), inserted.end(), true) == 29999);
+    keys.insert(keys.end(), batch.begin() + 1, batch.end());
+    std::sort(keys.begin(), keys.end());
+    check_tree(tree, keys);
+}
+
+void test_invalid() {
+    BTreeOptions options;
+    options.leaf_order = 3;
+    try {
+        BTree tree("test_btree_packed_invalid.dat", 16, options);
+        assert(false);
+    }
+    catch (const std::logic_error &) { }
+}
+
+int main() {
+    test_pack();
+    test_node();
+    BTreeOptions options;
+    test_tree(options);
+    options.cache_size = 0;
+    test_tree(options);
+    test_random();
+    test_builder_and_batch();
+    test_invalid();
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "../btree.h"
+#include "../btree_pool.h"
+
+#include <stdexcept>
+#include <cstdlib>
+#include <assert.h>
+#include <string.h>
+
+void test_clock_eviction() {
+    BTreePool pool(16, 3 * 16);
+    assert(pool.frames() == 3);
+    for (uint64_t ref = 1; ref <= 3; ++ref) {
+        uint8_t *page = pool.pinForWrite(ref);
+        memset(page, (int)ref, 16);
+        pool.unpin(ref);
+    }
+    //touch 1 and 3, every frame is referenced now
+    assert(pool.pin(1)[0] == 1);
+    pool.unpin(1);
+    assert(pool.pin(3)[0] == 3);
+    pool.unpin(3);
+    assert(pool.hits() == 2);
+    //the hand clears all three bits in one sweep and comes back to ref 1
+    pool.pinForWrite(4);
+    pool.unpin(4);
+    assert(pool.evictions() == 1);
+    assert(pool.pagesCached() == 3);
+    assert(pool.pin(1) == nullptr);
+    assert(pool.misses() == 1);
+    //ref 2 is next under the hand, touching it gives it a second chance
+    assert(pool.pin(2)[0] == 2);
+    pool.unpin(2);
+    pool.pinForWrite(5);
+    pool.unpin(5);
+    assert(pool.evictions() == 2);
+    assert(pool.pin(3) == nullptr);
+    for (uint64_t ref: { 2, 4, 5 }) {
+        assert(pool.pin(ref) != nullptr);
+        pool.unpin(ref);
+    }
+    assert(pool.misses() == 2);
+}
+
+void test_pinned_pages_survive() {
+    BTreePool pool(16, 2 * 16);
+    pool.pinForWrite(1);
+    pool.pinForWrite(2);
+    try {
+        pool.pinForWrite(3);
+        assert(false);
+    }
+    catch (const std::logic_error &e) { }
+    pool.unpin(2);
+    pool.pinForWrite(3);
+    assert(pool.pin(1) != nullptr);
+    assert(pool.pin(2) == nullptr);
+}
+
+void test_point_lookups() {
+    BTreeOptions options;
+    options.cache_size = 1 << 20;
+    BTree tree("test_btree_pool.dat", 100, options);
+    for (int i = 0; i < 100000; ++i) {
+        tree.put(i);
+    }
+    assert(tree.height() == 2);
+    //warm up the interior levels
+    for (int i = 0; i < 1000; ++i) {
+        assert(tree.contains(rand() % 100000));
+    }
+    uint64_t hits = tree.cacheHits();
+    uint64_t misses = tree.cacheMisses();
+    const int lookups = 1000;
+    for (int i = 0; i < lookups; ++i) {
+        assert(tree.contains(rand() % 100000));
+    }
+    //root and interior nodes stay resident, so at most the leaf is read
+    assert(tree.cacheMisses() - misses <= lookups);
+    assert(tree.cacheHits() - hits >= 2 * lookups);
+}
+
+int main() {
+    test_clock_eviction();
+    test_pinned_pages_survive();
+    test_point_lookups();
+}
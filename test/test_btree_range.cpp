@@ -0,0 +1,68 @@
+#include "../btree.h"
+
+#include <vector>
+#include <assert.h>
+
+void test_bounds(const BTree &tree) {
+    assert(*tree.lower_bound(100) == 100);
+    assert(*tree.lower_bound(101) == 102);
+    assert(*tree.upper_bound(100) == 102);
+    assert(*tree.lower_bound(-5) == 0);
+    assert(tree.lower_bound(-5) == tree.begin());
+    assert(*tree.upper_bound(19996) == 19998);
+    assert(tree.upper_bound(19998) == tree.end());
+    assert(tree.lower_bound(20000) == tree.end());
+    BTree::iterator it = tree.lower_bound(5001);
+    assert(*it++ == 5002);
+    assert(*it == 5004);
+    --it;
+    --it;
+    assert(*it == 5000);
+}
+
+void test_scan(const BTree &tree) {
+    std::vector<int> out(1000);
+    size_t n = tree.scan(1001, 1999, out.data(), out.size());
+    assert(n == 499);
+    for (size_t i = 0; i < n; ++i) {
+        assert(out[i] == 1002 + 2 * (int)i);
+    }
+    //output limit stops the scan
+    n = tree.scan(0, 19998, out.data(), 10);
+    assert(n == 10);
+    assert(out[9] == 18);
+    assert(tree.scan(7, 7, out.data(), out.size()) == 0);
+    assert(tree.scan(8, 8, out.data(), out.size()) == 1);
+    assert(tree.scan(30000, 40000, out.data(), out.size()) == 0);
+    assert(tree.scan(10, 5, out.data(), out.size()) == 0);
+
+    int batches = 0;
+    int total = 0;
+    tree.scan(-100, 100000, [&](const int *keys, int n) {
+        ++batches;
+        total += n;
+        return true;
+    });
+    assert(total == 10000);
+    assert(batches > 1 && batches < total);
+}
+
+void test_pages_touched(const BTree &tree) {
+    std::vector<int> out(1000);
+    uint64_t reads = tree.cacheHits() + tree.cacheMisses();
+    size_t n = tree.scan(8000, 8199, out.data(), out.size());
+    assert(n == 100);
+    //path to the first leaf plus the leaves holding the range
+    uint64_t touched = tree.cacheHits() + tree.cacheMisses() - reads;
+    assert(touched <= (uint64_t)tree.height() + 1 + 100 / 8 + 1);
+}
+
+int main() {
+    BTree tree("test_btree_range.dat", 16);
+    for (int i = 0; i < 20000; i += 2) {
+        tree.put(i);
+    }
+    test_bounds(tree);
+    test_scan(tree);
+    test_pages_touched(tree);
+}
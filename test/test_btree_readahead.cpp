@@ -0,0 +1,128 @@
+#include "../btree.h"
+#include "../btree_builder.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <assert.h>
+
+const int KEYS_NUM = 100000;
+
+void build(const char *filename, const BTreeOptions &options) {
+    BTreeBuilder builder(filename, 32, 0.7, options);
+    for (int i = 0; i < KEYS_NUM; ++i) {
+        builder.add(i * 2, i);
+    }
+}
+
+void check_scans(BTree &tree) {
+    int expected = 0;
+    for (BTree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        assert(*it == expected && it.value() == (uint64_t)expected / 2);
+        expected += 2;
+    }
+    assert(expected == 2 * KEYS_NUM);
+    std::vector<int> keys(KEYS_NUM);
+    assert(tree.scan(1000, 2 * KEYS_NUM, keys.data(), keys.size()) == (size_t)KEYS_NUM - 500);
+    for (int i = 0; i < KEYS_NUM - 500; ++i) {
+        assert(keys[i] == 1000 + 2 * i);
+    }
+}
+
+void test_sequential(const BTreeOptions &options) {
+    const char *filename = "test_btree_readahead.dat";
+    build(filename, options);
+    {
+        BTree tree(filename, options);
+        check_scans(tree);
+        //leaves of about 22 keys, the second scan finds them cached unless the tree is mapped
+        uint64_t prefetched = tree.stats().counter(BTreeStats::PAGES_PREFETCHED);
+        assert(prefetched > KEYS_NUM / 32 && prefetched <= 2 * KEYS_NUM / 16);
+    }
+    //a range ends the read-ahead with it
+    BTree cold(filename, options);
+    assert(cold.scan(0, 2000, std::vector<int>(2000).data(), 2000) == 1001);
+    assert(cold.stats().counter(BTreeStats::PAGES_PREFETCHED) <= 2000 / 22 + 1);
+}
+
+void test_direct() {
+    //the page cache is bypassed, prefetched leaves wait in the pool
+    const char *filename = "test_btree_readahead_direct.dat";
+    BTreeOptions options;
+    options.page_size = 512;
+    options.direct_io = true;
+    build(filename, options);
+    BTree tree(filename, options);
+    BTreeStats::Snapshot before = tree.stats().snapshot();
+    check_scans(tree);
+    BTreeStats::Snapshot scans = tree.stats().snapshot().since(before);
+    uint64_t leaves = scans.counter(BTreeStats::PAGES_PREFETCHED);
+    assert(leaves > 0);
+    //a handful of leaves before read-ahead starts and the inner nodes are read one by one
+    assert(scans.counter(BTreeStats::CACHE_MISSES) < leaves / 4);
+}
+
+void test_random() {
+    const char *filename = "test_btree_readahead_random.dat";
+    BTreeOptions options;
+    build(filename, options);
+    BTree tree(filename, options);
+    //short scans from random places never look sequential
+    for (int i = 0; i < 1000; ++i) {
+        BTree::iterator it = tree.lower_bound(rand() % (2 * KEYS_NUM));
+        for (int n = 0; n < 10 && it != tree.end(); ++n) {
+            ++it;
+        }
+    }
+    assert(tree.stats().counter(BTreeStats::PAGES_PREFETCHED) < 1000);
+    BTreeOptions disabled;
+    disabled.read_ahead = 0;
+    BTree plain(filename, disabled);
+    check_scans(plain);
+    assert(plain.stats().counter(BTreeStats::PAGES_PREFETCHED) == 0);
+}
+
+void test_concurrent() {
+    BTree tree("test_btree_readahead_concurrent.dat", 8);
+    for (int i = 0; i < 20000; ++i) {
+        tree.put(i * 2);
+    }
+    std::atomic<bool> stop(false);
+    std::thread writer([&tree, &stop]() {
+        for (int i = 0; i < 20000; ++i) {
+            tree.put(i * 2 + 1);
+        }
+        for (int i = 0; i < 20000; ++i) {
+            tree.remove(i * 2 + 1);
+        }
+        stop = true;
+    });
+    do {
+        //even keys are always there and keys keep increasing
+        int last = -1;
+        int even = 0;
+        for (BTree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            assert(*it > last);
+            last = *it;
+            even += *it % 2 == 0;
+        }
+        assert(even == 20000);
+    } while (!stop);
+    writer.join();
+    assert(tree.checkValid());
+}
+
+int main() {
+    BTreeOptions options;
+    test_sequential(options);
+    options.cache_size = 0;
+    test_sequential(options);
+    options = BTreeOptions();
+    options.use_mmap = true;
+    test_sequential(options);
+    test_direct();
+    test_random();
+    test_concurrent();
+    return 0;
+}
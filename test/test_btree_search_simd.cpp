@@ -0,0 +1,41 @@
+#include "../btree_search.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <assert.h>
+#include <vector>
+
+void check_mode(BTreeSearch::Mode mode) {
+    BTreeSearch::setMode(mode);
+    for (int n = 0; n < 300; n += 7) {
+        std::vector<int> keys;
+        for (int i = 0; i < n; ++i) {
+            keys.push_back(rand() % 1000 - 500);
+        }
+        keys.push_back(INT_MIN);
+        keys.push_back(INT_MAX);
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        int size = keys.size();
+        for (int key = -510; key <= 510; ++key) {
+            int lower = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            int upper = std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+            assert(BTreeSearch::lowerBound(keys.data(), size, key) == lower);
+            assert(BTreeSearch::upperBound(keys.data(), size, key) == upper);
+        }
+        assert(BTreeSearch::lowerBound(keys.data(), size, INT_MIN) == 0);
+        assert(BTreeSearch::upperBound(keys.data(), size, INT_MAX) == size);
+        assert(BTreeSearch::lowerBound(keys.data(), size, INT_MAX) == size - 1);
+    }
+}
+
+int main() {
+    BTreeSearch::Mode best = BTreeSearch::defaultMode();
+    for (int mode = BTreeSearch::SCALAR; mode <= BTreeSearch::AVX2; ++mode) {
+        if (BTreeSearch::isSupported((BTreeSearch::Mode)mode))
+            check_mode((BTreeSearch::Mode)mode);
+    }
+    BTreeSearch::setMode(best);
+    assert(BTreeSearch::mode() == best);
+}
@@ -0,0 +1,142 @@
+#include "../btree_sharded.h"
+
+#include <cstdlib>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <assert.h>
+
+void check_same(const ShardedBTree &tree, const std::set<int> &present) {
+    assert(tree.size() == present.size());
+    assert(tree.checkValid());
+    std::set<int>::const_iterator expected = present.begin();
+    for (ShardedBTree::iterator it = tree.begin(); it != tree.end(); ++it, ++expected) {
+        assert(*it == *expected && it.value() == (uint64_t)*expected * 3);
+        assert(it.shard() == tree.shardOf(*it));
+    }
+    assert(expected == present.end());
+    for (int i = 0; i < 1000; ++i) {
+        int key = rand() % 100000;
+        uint64_t value;
+        bool contained = present.count(key) == 1;
+        assert(tree.contains(key) == contained && tree.get(key, value) == contained);
+        ShardedBTree::iterator it = tree.lower_bound(key);
+        std::set<int>::const_iterator bound = present.lower_bound(key);
+        assert(bound == present.end() ? it == tree.end() : *it == *bound);
+    }
+}
+
+void fill(ShardedBTree &tree, std::set<int> &present) {
+    //writers on several threads, each owning a residue of the keys
+    const int threads_num = 4;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threads_num; ++t) {
+        threads.push_back(std::thread([&tree, t]() {
+            for (int i = t; i < 100000; i += threads_num) {
+                if (i % 3 != 0)
+                    tree.put(i, (uint64_t)i * 3);
+            }
+        }));
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    tree.flush();
+    for (int i = 0; i < 100000; ++i) {
+        if (i % 3 != 0)
+            present.insert(i);
+    }
+    for (int i = 0; i < 100000; i += 7) {
+        if (present.erase(i) == 1)
+            tree.remove(i);
+    }
+    tree.flush();
+}
+
+void test_range() {
+    const char *filename = "test_btree_sharded_range.dat";
+    std::set<int> present;
+    {
+        ShardedBTree tree(filename, 16, std::vector<int>{ 25000, 50000, 75000 });
+        assert(tree.shards() == 4 && tree.partitioning() == ShardedBTree::RANGE);
+        assert(tree.shardOf(-1) == 0 && tree.shardOf(25000) == 1 && tree.shardOf(99999) == 3);
+        fill(tree, present);
+        check_same(tree, present);
+        //every shard got its quarter
+        for (int i = 0; i < 4; ++i) {
+            assert(tree.shard(i).size() > present.size() / 5);
+        }
+    }
+    ShardedBTree tree(filename);
+    assert(tree.shards() == 4 && tree.partitioning() == ShardedBTree::RANGE);
+    check_same(tree, present);
+}
+
+void test_hash() {
+    const char *filename = "test_btree_sharded_hash.dat";
+    std::set<int> present;
+    {
+        ShardedBTree tree(filename, 16, 3);
+        fill(tree, present);
+        check_same(tree, present);
+        for (int i = 0; i < 3; ++i) {
+            assert(tree.shard(i).size() > present.size() / 4);
+        }
+    }
+    ShardedBTree tree(filename);
+    assert(tree.shards() == 3 && tree.partitioning() == ShardedBTree::HASH);
+    check_same(tree, present);
+}
+
+void test_learned() {
+    std::vector<int> sample;
+    for (int i = 0; i < 1000; ++i) {
+        sample.push_back(rand() % 100000);
+    }
+    std::vector<int> splits = ShardedBTree::learnSplits(sample, 4);
+    assert(splits.size() == 3 && splits[0] < splits[1] && splits[1] < splits[2]);
+    assert(splits[1] > 40000 && splits[1] < 60000);
+    //too few distinct keys for the shards asked for
+    assert(ShardedBTree::learnSplits(std::vector<int>(100, 5), 4).size() == 1);
+    std::set<int> present;
+    ShardedBTree tree("test_btree_sharded_learned.dat", 16, splits);
+    fill(tree, present);
+    check_same(tree, present);
+}
+
+void test_errors() {
+    ShardedBTree tree("test_btree_sharded_errors.dat", 8, std::vector<int>{ 100 });
+    tree.put(1);
+    tree.put(200);
+    tree.put(1);
+    tree.remove(300);
+    bool thrown = false;
+    try {
+        tree.flush();
+    }
+    catch (const std::logic_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+    //the failed writes are reported once, the others were applied
+    tree.flush();
+    assert(tree.size() == 2 && tree.contains(1) && tree.contains(200));
+    thrown = false;
+    try {
+        ShardedBTree unsorted("test_btree_sharded_unsorted.dat", 8, std::vector<int>{ 5, 5 });
+    }
+    catch (const std::logic_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+int main() {
+    srand(11);
+    test_range();
+    test_hash();
+    test_learned();
+    test_errors();
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include "../btree.h"
+#include "../btree_fs.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <assert.h>
+
+void test_pages() {
+    BTreeFS fs("test_btree_snapshot_fs.dat", 8);
+    BTreeNode node = fs.allocNode(true);
+    node.put(1, 10);
+    fs.saveNode(node);
+    {
+        std::shared_ptr<BTreeFS::SnapshotPages> snapshot = fs.takeSnapshot();
+        //pages allocated after the snapshot are not kept
+        BTreeNode other = fs.allocNode(true);
+        other.put(5, 50);
+        fs.saveNode(other);
+        assert(fs.snapshotPages() == 0);
+        node.put(2, 20);
+        fs.saveNode(node);
+        node.put(3, 30);
+        fs.saveNode(node);
+        //only the first change keeps an image
+        assert(fs.snapshotPages() == 1);
+        assert(fs.viewNode(*snapshot, node.ref()).keysNum() == 1);
+        assert(fs.viewNode(node.ref()).keysNum() == 3);
+        fs.freeNode(node.ref());
+        assert(fs.viewNode(*snapshot, node.ref()).contains(1));
+    }
+    //released with the last reference
+    assert(fs.snapshotPages() == 0);
+}
+
+void test_snapshot(const BTreeOptions &options, int keys_num) {
+    BTree tree("test_btree_snapshot.dat", 8, options);
+    for (int i = 0; i < keys_num; ++i) {
+        tree.put(2 * i, i);
+    }
+    BTreeSnapshot snapshot = tree.snapshot();
+    std::atomic<bool> done(false);
+    std::thread reader([&snapshot, &done, keys_num]() {
+        //scans see the tree as it was however far the writer got
+        do {
+            int expected = 0;
+            for (BTreeSnapshot::iterator it = snapshot.begin(); it != snapshot.end(); ++it) {
+                assert(*it == 2 * expected);
+                assert(it.value() == (uint64_t)expected);
+                ++expected;
+            }
+            assert(expected == keys_num);
+        } while (!done);
+    });
+    for (int i = 0; i < keys_num; ++i) {
+        tree.put(2 * i + 1, i);
+        if (i % 2 == 0)
+            tree.remove(2 * i);
+    }
+    for (int i = 0; i < keys_num / 2; ++i) {
+        tree.remove(2 * i + 1);
+    }
+    done = true;
+    reader.join();
+    assert(tree.checkValid());
+    assert(tree.size() == (uint64_t)keys_num);
+
+    assert(snapshot.size() == (uint64_t)keys_num);
+    assert(snapshot.contains(0));
+    assert(!snapshot.contains(1));
+    uint64_t value;
+    assert(snapshot.get(100, value) && value == 50);
+    assert(!tree.contains(100));
+    assert(*snapshot.lower_bound(101) == 102);
+    assert(*--snapshot.end() == 2 * (keys_num - 1));
+    std::vector<int> range;
+    snapshot.scan(10, 20, [&range](const int *keys, int n) {
+        range.insert(range.end(), keys, keys + n);
+        return true;
+    });
+    assert(range == std::vector<int>({10, 12, 14, 16, 18, 20}));
+
+    //a later snapshot sees the later tree
+    BTreeSnapshot later = tree.snapshot();
+    std::vector<int> live(tree.begin(), tree.end());
+    std::vector<int> frozen(later.begin(), later.end());
+    assert(live == frozen);
+    tree.vacuum();
+    assert(std::vector<int>(later.begin(), later.end()) == frozen);
+}
+
+void test_mmap() {
+    BTreeOptions options;
+    options.use_mmap = true;
+    BTree tree("test_btree_snapshot_mmap.dat", 8, options);
+    tree.put(1);
+    bool thrown = false;
+    try {
+        tree.snapshot();
+    }
+    catch (const std::logic_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+int main() {
+    test_pages();
+    BTreeOptions options;
+    test_snapshot(options, 20000);
+    options.cache_size = 0;
+    test_snapshot(options, 20000);
+    //images are taken from the operation's own unlogged pages
+    options.durability = BTreeOptions::SYNC;
+    options.cache_size = BTreeOptions::DEFAULT_CACHE_SIZE;
+    test_snapshot(options, 1000);
+    test_mmap();
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include "../btree.h"
+#include "../btree_stats.h"
+
+#include <thread>
+#include <vector>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//the tree falls back to plain writes where the filesystem has no fallocate
+bool fallocate_supported() {
+    const char *filename = "test_btree_stats_probe.dat";
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert(fd != -1);
+    bool supported = fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, 4096) == 0;
+    close(fd);
+    unlink(filename);
+    return supported;
+}
+
+void test_histogram() {
+    //buckets cover the values in order, each one at most 1/16 wide
+    for (int bucket = 0; bucket < BTreeStats::Histogram::BUCKETS - 1; ++bucket) {
+        uint64_t min = BTreeStats::Histogram::bucketMin(bucket);
+        uint64_t max = BTreeStats::Histogram::bucketMax(bucket);
+        assert(BTreeStats::Histogram::bucket(min) == bucket);
+        assert(BTreeStats::Histogram::bucket(max) == bucket);
+        assert(BTreeStats::Histogram::bucketMin(bucket + 1) == max + 1);
+        assert((max - min) * 16 <= min);
+    }
+    assert(BTreeStats::Histogram::bucket(UINT64_MAX) == BTreeStats::Histogram::BUCKETS - 1);
+
+    BTreeStats stats;
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        stats.record(BTreeStats::GET, value * 1000);
+    }
+    BTreeStats::Histogram latency = stats.snapshot().latency[BTreeStats::GET];
+    assert(latency.count() == 1000);
+    assert(latency.mean() == 500500);
+    uint64_t median = latency.percentile(0.5);
+    assert(median >= 500000 && median <= 500000 * 17 / 16);
+    uint64_t p99 = latency.percentile(0.99);
+    assert(p99 >= 990000 && p99 <= 990000 * 17 / 16);
+    assert(latency.max() >= 1000000 && latency.percentile(0) <= 1000 * 17 / 16);
+    assert(stats.snapshot().latency[BTreeStats::PUT].percentile(0.5) == 0);
+}
+
+void test_tree() {
+    const int keys_num = 20000;
+    BTree tree("test_btree_stats.dat", 8);
+    BTreeStats &stats = tree.stats();
+    int height = tree.height();
+    for (int i = 0; i < keys_num; ++i) {
+        tree.put(i, i);
+    }
+    BTreeStats::Snapshot snapshot = stats.snapshot();
+    assert(snapshot.latency[BTreeStats::PUT].count() == keys_num);
+    assert(snapshot.counter(BTreeStats::SPLITS) > 0);
+    assert(snapshot.counter(BTreeStats::HEIGHT_GROWS) == (uint64_t)(tree.height() - height));
+    assert(snapshot.counter(BTreeStats::PAGES_APPENDED) > snapshot.counter(BTreeStats::SPLITS));
+    uint64_t extent_calls = snapshot.counter(BTreeStats::EXTENT_CALLS);
+    assert(fallocate_supported() ? extent_calls > 0 : extent_calls == 0);
+    assert(snapshot.counter(BTreeStats::WRITE_BYTES) >=
+           snapshot.counter(BTreeStats::PAGES_WRITTEN) * BTreeNode::maxNodeSerializationSize(8));
+    assert(snapshot.counter(BTreeStats::PAGES_WRITTEN) == tree.pagesWritten());
+
+    for (int i = 0; i < keys_num; ++i) {
+        assert(tree.contains(i));
+    }
+    assert(tree.scan(0, 100, std::vector<int>(101).data(), 101) == 101);
+    BTreeStats::Snapshot delta = stats.snapshot().since(snapshot);
+    assert(delta.latency[BTreeStats::GET].count() == keys_num);
+    assert(delta.latency[BTreeStats::SCAN].count() == 1);
+    assert(delta.latency[BTreeStats::PUT].count() == 0);
+    assert(delta.counter(BTreeStats::SPLITS) == 0);
+    //the tree fits the default cache
+    assert(delta.cacheHitRatio() > 0.9);
+
+    for (int i = 0; i < keys_num; ++i) {
+        tree.remove(i);
+    }
+    snapshot = stats.snapshot();
+    assert(snapshot.latency[BTreeStats::REMOVE].count() == keys_num);
+    assert(snapshot.counter(BTreeStats::MERGES) > 0);
+    assert(snapshot.counter(BTreeStats::REBALANCES) >= snapshot.counter(BTreeStats::MERGES) / 2);
+    assert(snapshot.counter(BTreeStats::HEIGHT_SHRINKS) > 0);
+    assert(snapshot.counter(BTreeStats::PAGES_FREED) > 0);
+    tree.put(1);
+    assert(stats.counter(BTreeStats::PAGES_REUSED) > 0);
+
+    stats.reset();
+    snapshot = stats.snapshot();
+    for (int c = 0; c < BTreeStats::COUNTERS; ++c) {
+        assert(snapshot.counters[c] == 0);
+    }
+    for (int op = 0; op < BTreeStats::OPERATIONS; ++op) {
+        assert(snapshot.latency[op].count() == 0);
+    }
+    assert(tree.cacheHits() == 0 && tree.pagesWritten() == 0);
+}
+
+void test_cold_reads() {
+    const int keys_num = 20000;
+    {
+        BTree tree("test_btree_stats_cold.dat", 8);
+        for (int i = 0; i < keys_num; ++i) {
+            tree.put(i);
+        }
+    }
+    BTreeOptions options;
+    options.cache_size = 64 << 10;
+    BTree tree("test_btree_stats_cold.dat", options);
+    for (int i = 0; i < keys_num; i += 7) {
+        tree.contains(i);
+    }
+    //a tree larger than the cache is read from the file
+    BTreeStats::Snapshot snapshot = tree.stats().snapshot();
+    assert(snapshot.counter(BTreeStats::CACHE_MISSES) > 0);
+    assert(snapshot.counter(BTreeStats::PAGES_READ) == snapshot.counter(BTreeStats::CACHE_MISSES));
+    assert(snapshot.counter(BTreeStats::READ_BYTES) >=
+           snapshot.counter(BTreeStats::PAGES_READ) * BTreeNode::maxNodeSerializationSize(8));
+    assert(snapshot.counter(BTreeStats::READ_CALLS) >= snapshot.counter(BTreeStats::PAGES_READ));
+    assert(snapshot.cacheHitRatio() < 0.9);
+}
+
+void test_threads() {
+    const int threads_num = 4;
+    const int keys_num = 5000;
+    BTree tree("test_btree_stats_threads.dat", 16);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threads_num; ++t) {
+        threads.push_back(std::thread([&tree, t]() {
+            for (int i = 0; i < keys_num; ++i) {
+                tree.put(i * threads_num + t);
+            }
+        }));
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    //no count is lost between the stripes
+    assert(tree.stats().snapshot().latency[BTreeStats::PUT].count() == threads_num * keys_num);
+    assert(tree.checkValid());
+}
+
+void test_no_timing() {
+    BTreeOptions options;
+    options.latency_stats = false;
+    BTree tree("test_btree_stats_untimed.dat", 8, options);
+    for (int i = 0; i < 1000; ++i) {
+        tree.put(i);
+    }
+    BTreeStats::Snapshot snapshot = tree.stats().snapshot();
+    assert(snapshot.latency[BTreeStats::PUT].count() == 0);
+    assert(snapshot.counter(BTreeStats::SPLITS) > 0);
+}
+
+int main() {
+    test_histogram();
+    test_tree();
+    test_cold_reads();
+    test_threads();
+    test_no_timing();
+    return 0;
+}
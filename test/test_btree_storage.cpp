@@ -0,0 +1,211 @@
+#include "../btree.h"
+#include "../btree_mapped.h"
+#include "../btree_memory.h"
+#include "../btree_wal.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <assert.h>
+#include <unistd.h>
+
+void check_same(const BTree &tree, const std::set<int> &present) {
+    assert(tree.size() == present.size());
+    assert(tree.checkValid());
+    std::set<int>::const_iterator expected = present.begin();
+    for (BTree::iterator it = tree.begin(); it != tree.end(); ++it, ++expected) {
+        assert(*it == *expected && it.value() == (uint64_t)*expected * 3);
+    }
+    assert(expected == present.end());
+    std::vector<int> keys;
+    for (int i = 0; i < 2000; ++i) {
+        keys.push_back(rand() % 20000);
+    }
+    std::vector<uint64_t> values;
+    std::vector<bool> found = tree.getMany(keys, values);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        bool contained = present.count(keys[i]) == 1;
+        assert(tree.contains(keys[i]) == contained && found[i] == contained);
+        assert(values[i] == (contained ? (uint64_t)keys[i] * 3 : 0));
+    }
+}
+
+void test_memory() {
+    BTree tree(std::unique_ptr<BTreeStorage>(new BTreeMemory(8)));
+    assert(tree.size() == 0 && tree.height() == 0 && tree.checkValid());
+    std::set<int> present;
+    for (int i = 0; i < 20000; ++i) {
+        int key = rand() % 20000;
+        if (present.insert(key).second)
+            tree.put(key, (uint64_t)key * 3);
+    }
+    check_same(tree, present);
+    //removes merge nodes and free their slots
+    for (int i = 0; i < 15000; ++i) {
+        int key = rand() % 20000;
+        if (present.erase(key) == 1)
+            tree.remove(key);
+    }
+    check_same(tree, present);
+    std::vector<int> out(present.size());
+    assert(tree.scan(0, 20000, out.data(), out.size()) == present.size());
+    assert(tree.pagesRead() == 0 && tree.pagesWritten() == 0);
+    assert(tree.stats().counter(BTreeStats::PAGES_FREED) > 0);
+    bool thrown = false;
+    try {
+        tree.snapshot();
+    }
+    catch (const std::logic_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_memory_slots() {
+    BTreeMemory *memory = new BTreeMemory(4);
+    BTree tree((std::unique_ptr<BTreeStorage>(memory)));
+    for (int i = 0; i < 1000; ++i) {
+        tree.put(i);
+    }
+    uint64_t nodes = memory->nodes();
+    for (int i = 999; i >= 10; --i) {
+        tree.remove(i);
+    }
+    //the right leaves were appended last, so the tail of the arena goes back
+    assert(memory->nodes() < nodes);
+    assert(tree.vacuum() > 0);
+    for (int i = 10; i < 1000; ++i) {
+        tree.put(i);
+    }
+    assert(tree.size() == 1000 && tree.checkValid());
+}
+
+void test_memory_concurrent() {
+    BTree tree(std::unique_ptr<BTreeStorage>(new BTreeMemory(8)));
+    for (int i = 0; i < 20000; ++i) {
+        tree.put(i * 2, i);
+    }
+    std::atomic<bool> stop(false);
+    std::thread writer([&tree, &stop]() {
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < 20000; ++i) {
+                tree.put(i * 2 + 1);
+            }
+            for (int i = 0; i < 20000; ++i) {
+                tree.remove(i * 2 + 1);
+            }
+        }
+        stop = true;
+    });
+    do {
+        //even keys are always there and iterators keep their leaf
+        int last = -1;
+        int even = 0;
+        for (BTree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            assert(*it > last);
+            last = *it;
+            even += *it % 2 == 0;
+        }
+        assert(even == 20000);
+        for (int i = 0; i < 1000; ++i) {
+            uint64_t value;
+            int key = rand() % 20000;
+            assert(tree.get(key * 2, value) && value == (uint64_t)key);
+        }
+    } while (!stop);
+    writer.join();
+    assert(tree.size() == 20000 && tree.checkValid());
+}
+
+void test_mapped(const BTreeOptions &options) {
+    const char *filename = "test_btree_storage_mapped.dat";
+    std::set<int> present;
+    {
+        BTree tree(filename, 16, options);
+        for (int i = 0; i < 20000; ++i) {
+            int key = rand() % 20000;
+            if (present.insert(key).second)
+                tree.put(key, (uint64_t)key * 3);
+        }
+    }
+    BTree tree(std::unique_ptr<BTreeStorage>(new BTreeMapped(filename)));
+    check_same(tree, present);
+    //nothing changes under a snapshot of a read-only tree
+    BTreeSnapshot snapshot = tree.snapshot();
+    assert(snapshot.size() == present.size() && snapshot.contains(*present.begin()));
+    bool thrown = false;
+    try {
+        tree.put(20001);
+    }
+    catch (const std::logic_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+    thrown = false;
+    try {
+        tree.remove(*present.begin());
+    }
+    catch (const std::logic_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+    check_same(tree, present);
+}
+
+void test_mapped_log() {
+    const char *filename = "test_btree_storage_log.dat";
+    {
+        BTree tree(filename, 8);
+        tree.put(1);
+    }
+    //as a crash would leave it
+    std::ofstream(BTreeWal::logName(filename).c_str()) << "record";
+    bool thrown = false;
+    try {
+        BTreeMapped mapped(filename);
+    }
+    catch (const std::logic_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+    unlink(BTreeWal::logName(filename).c_str());
+    BTreeMapped mapped(filename);
+    assert(mapped.treeSize() == 1);
+}
+
+void test_file() {
+    //the file backend passed in is the one the filename constructors make
+    const char *filename = "test_btree_storage_file.dat";
+    std::set<int> present;
+    {
+        BTree tree(std::unique_ptr<BTreeStorage>(new BTreeFS(filename, 8)));
+        for (int i = 0; i < 5000; ++i) {
+            int key = rand() % 20000;
+            if (present.insert(key).second)
+                tree.put(key, (uint64_t)key * 3);
+        }
+    }
+    BTree tree(filename);
+    check_same(tree, present);
+}
+
+int main() {
+    srand(7);
+    test_memory();
+    test_memory_slots();
+    test_memory_concurrent();
+    BTreeOptions options;
+    test_mapped(options);
+    options.page_size = 4096;
+    test_mapped(options);
+    options = BTreeOptions();
+    options.leaf_order = 64;
+    test_mapped(options);
+    test_mapped_log();
+    test_file();
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "../btree.h"
+#include "../btree_builder.h"
+
+#include <map>
+#include <vector>
+#include <cstdlib>
+#include <assert.h>
+
+void check_values(const BTree &tree, const std::map<int, uint64_t> &values) {
+    assert(tree.size() == values.size());
+    auto expected = values.begin();
+    for (BTree::iterator it = tree.begin(); it != tree.end(); ++it, ++expected) {
+        assert(*it == expected->first);
+        assert(it.value() == expected->second);
+    }
+    assert(expected == values.end());
+    for (auto &pair: values) {
+        uint64_t value = 0;
+        assert(tree.get(pair.first, value));
+        assert(value == pair.second);
+    }
+    uint64_t value = 42;
+    assert(!tree.get(-1, value));
+    assert(value == 42);
+}
+
+int main() {
+    std::map<int, uint64_t> values;
+    {
+        BTree tree("test_btree_values.dat", 8);
+        for (int i = 0; i < 3000; ++i) {
+            int key = rand() % 100000;
+            uint64_t value = ((uint64_t)rand() << 32) | rand();
+            if (values.insert(std::make_pair(key, value)).second)
+                tree.put(key, value);
+        }
+        //values move together with keys through splits and merges
+        for (int i = 0; i < 1000; ++i) {
+            auto it = values.lower_bound(rand() % 100000);
+            if (it == values.end()) continue;
+            tree.remove(it->first);
+            values.erase(it);
+        }
+        assert(tree.checkValid());
+        check_values(tree, values);
+
+        std::vector<int> keys;
+        std::vector<uint64_t> batch_values;
+        for (int i = 0; i < 2000; ++i) {
+            keys.push_back(100000 + rand() % 100000);
+            batch_values.push_back(rand());
+        }
+        std::vector<bool> inserted = tree.putMany(keys, batch_values);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (inserted[i])
+                values[keys[i]] = batch_values[i];
+        }
+        check_values(tree, values);
+    }
+    BTree reopened("test_btree_values.dat");
+    check_values(reopened, values);
+
+    std::map<int, uint64_t> loaded;
+    {
+        BTreeBuilder builder("test_btree_values_bulk.dat", 16);
+        for (int i = 0; i < 1000; ++i) {
+            builder.add(i, 7 * i);
+            loaded[i] = 7 * i;
+        }
+    }
+    check_values(BTree("test_btree_values_bulk.dat"), loaded);
+}
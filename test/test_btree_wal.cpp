@@ -0,0 +1,147 @@
+#include "../btree.h"
+#include "../btree_wal.h"
+
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+//runs body in a child process which dies without closing the tree
+template <typename Body>
+void crash_after(Body body) {
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        body();
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+void check_tree(const char *filename, int from, int to) {
+    BTree tree(filename);
+    assert(tree.checkValid());
+    assert(tree.size() == (uint64_t)(to - from));
+    int expected = from;
+    for (int key: tree) {
+        assert(key == expected++);
+    }
+    uint64_t value;
+    assert(tree.get(from, value) && value == (uint64_t)from * 3);
+    assert(access(BTreeWal::logName(filename).c_str(), F_OK) == -1);
+}
+
+void test_recovery(BTreeOptions::Durability durability, uint64_t checkpoint_size) {
+    const char *filename = "test_btree_wal.dat";
+    BTreeOptions options;
+    options.durability = durability;
+    options.wal_checkpoint_size = checkpoint_size;
+    crash_after([&]() {
+        BTree tree(filename, 8, options);
+        for (int i = 0; i < 3000; ++i) {
+            tree.put(i, (uint64_t)i * 3);
+        }
+        std::vector<int> batch;
+        for (int i = 3000; i < 4000; ++i) {
+            batch.push_back(i);
+        }
+        tree.putMany(batch, std::vector<uint64_t>(batch.size(), 0));
+        for (int i = 0; i < 1000; ++i) {
+            tree.remove(i);
+        }
+        if (durability == BTreeOptions::ASYNC)
+            tree.checkpoint();
+    });
+    //the header is never written in place before a checkpoint
+    check_tree(filename, 1000, 4000);
+}
+
+void test_torn_tail() {
+    const char *filename = "test_btree_wal_torn.dat";
+    BTreeOptions options;
+    options.durability = BTreeOptions::SYNC;
+    crash_after([&]() {
+        BTree tree(filename, 8, options);
+        for (int i = 0; i < 500; ++i) {
+            tree.put(i, (uint64_t)i * 3);
+        }
+        //a record cut short by the crash
+        std::ofstream log(BTreeWal::logName(filename), std::ios::app | std::ios::binary);
+        log << "TBWL partial record";
+    });
+    check_tree(filename, 0, 500);
+}
+
+void test_stale_log() {
+    const char *filename = "test_btree_wal_stale.dat";
+    BTreeOptions options;
+    options.durability = BTreeOptions::SYNC;
+    crash_after([&]() {
+        BTree tree(filename, 8, options);
+        for (int i = 0; i < 100; ++i) {
+            tree.put(i);
+        }
+    });
+    {
+        //a new tree must not pick up the log of the old one
+        BTree tree(filename, 8);
+        tree.put(7);
+    }
+    BTree tree(filename);
+    assert(tree.size() == 1);
+    assert(tree.contains(7));
+}
+
+void test_group_commit() {
+    const char *filename = "test_btree_wal_group.dat";
+    BTreeOptions options;
+    options.durability = BTreeOptions::GROUP;
+    options.wal_group_window_us = 1000;
+    const int threads_num = 8;
+    const int commits = 50;
+    {
+        BTreeWal wal(filename, 64, options);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threads_num; ++t) {
+            threads.push_back(std::thread([&wal, t]() {
+                uint8_t page[64] = { 0 };
+                uint8_t header[8] = { 0 };
+                for (int i = 0; i < commits; ++i) {
+                    page[0] = t;
+                    std::vector<BTreeWal::Page> pages(1, BTreeWal::Page(64 * i, page));
+                    uint64_t lsn = wal.append(header, sizeof(header), pages);
+                    wal.commit(lsn);
+                    assert(wal.durableLsn() >= lsn);
+                }
+            }));
+        }
+        for (std::thread &thread: threads) {
+            thread.join();
+        }
+        //concurrent commits share fsyncs
+        assert(wal.syncs() < (uint64_t)threads_num * commits);
+    }
+    uint64_t records = BTreeWal::replay(filename, [](const uint8_t *, uint32_t header_len,
+                                                     const std::vector<BTreeWal::Page> &pages) {
+        assert(header_len == 8);
+        assert(pages.size() == 1);
+    });
+    assert(records == (uint64_t)threads_num * commits);
+    unlink(BTreeWal::logName(filename).c_str());
+}
+
+int main() {
+    test_recovery(BTreeOptions::SYNC, 64 << 20);
+    test_recovery(BTreeOptions::GROUP, 64 << 20);
+    test_recovery(BTreeOptions::ASYNC, 64 << 20);
+    //checkpoints in the middle of the run
+    test_recovery(BTreeOptions::SYNC, 64 << 10);
+    test_torn_tail();
+    test_stale_log();
+    test_group_commit();
+    return 0;
+}
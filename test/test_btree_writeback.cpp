@@ -0,0 +1,79 @@
+#include "../btree.h"
+#include "../btree_fs.h"
+
+#include <set>
+#include <vector>
+#include <cstdlib>
+#include <assert.h>
+
+void test_coalesce() {
+    BTreeOptions options;
+    options.dirty_limit = 0;
+    BTreeFS fs("test_btree_writeback.dat", 8, options);
+    std::vector<BTreeNode> nodes;
+    for (int i = 0; i < 100; ++i) {
+        nodes.push_back(fs.allocNode(true));
+    }
+    //every page is saved twice but written once
+    for (int round = 0; round < 2; ++round) {
+        for (BTreeNode &node: nodes) {
+            node.put(round, node.ref());
+            fs.saveNode(node);
+        }
+    }
+    assert(fs.pagesWritten() == 0);
+    fs.commit();
+    assert(fs.pagesWritten() == 100);
+    //adjacent pages share one call
+    assert(fs.writeCalls() == 1);
+    for (BTreeNode &node: nodes) {
+        assert(fs.openNode(node.ref()) == node);
+    }
+}
+
+void test_dirty_reads(const BTreeOptions &options) {
+    const char *filename = "test_btree_writeback_tree.dat";
+    std::set<int> keys;
+    {
+        BTree tree(filename, 8, options);
+        while (keys.size() < 20000) {
+            int key = rand();
+            if (keys.insert(key).second)
+                tree.put(key, key / 2);
+        }
+        for (int i = 0; i < 5000; ++i) {
+            auto it = keys.lower_bound(rand());
+            if (it == keys.end()) it = keys.begin();
+            tree.remove(*it);
+            keys.erase(it);
+        }
+        //pages not written back yet are read from the dirty table
+        assert(tree.checkValid());
+        for (int key: keys) {
+            assert(tree.contains(key));
+        }
+    }
+    BTree tree(filename);
+    assert(tree.checkValid());
+    assert(tree.size() == keys.size());
+    std::vector<int> check(tree.begin(), tree.end());
+    assert(check == std::vector<int>(keys.begin(), keys.end()));
+    uint64_t value;
+    assert(tree.get(*keys.begin(), value) && value == (uint64_t)*keys.begin() / 2);
+}
+
+int main() {
+    test_coalesce();
+    BTreeOptions options;
+    options.cache_size = 0;
+    test_dirty_reads(options);
+    //small limit keeps the background flusher busy
+    options.dirty_limit = 64 << 10;
+    test_dirty_reads(options);
+    options.dirty_limit = 0;
+    test_dirty_reads(options);
+    options.durability = BTreeOptions::ASYNC;
+    options.dirty_limit = 64 << 10;
+    test_dirty_reads(options);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "../btree_check.h"
+
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+//Checks a closed tree file.
+//  btree_fsck [--threads=N] [--repair] file
+//Exits with 0 for a sound tree, 1 if problems were found, 2 on bad usage.
+//--repair rewrites root, height, size and free page count of the header
+//when those are all that is wrong.
+
+namespace {
+
+int usage() {
+    std::cerr << "usage: btree_fsck [--threads=N] [--repair] file" << std::endl;
+    return 2;
+}
+
+//digits only, stoul alone takes signs, spaces and trailing junk
+bool parseThreads(const std::string &text, unsigned &threads) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    try {
+        unsigned long value = std::stoul(text);
+        if (value > std::numeric_limits<unsigned>::max())
+            return false;
+        threads = value;
+        return true;
+    }
+    catch (const std::out_of_range &) {
+        return false;
+    }
+}
+
+}
+
+int main(int argc, char **argv) {
+    unsigned threads = 0;
+    bool repair = false;
+    std::string filename;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 10, "--threads=") == 0) {
+            if (!parseThreads(arg.substr(10), threads))
+                return usage();
+        }
+        else if (arg == "--repair")
+            repair = true;
+        else if (filename.empty() && arg.compare(0, 2, "--") != 0)
+            filename = arg;
+        else
+            return usage();
+    }
+    if (filename.empty())
+        return usage();
+    BTreeCheck::Report report;
+    try {
+        report = BTreeCheck::run(filename, threads, repair);
+    }
+    catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    for (const std::string &error: report.errors) {
+        std::cout << error << std::endl;
+    }
+    if (report.errors_num > report.errors.size())
+        std::cout << "... " << report.errors_num - report.errors.size() << " more" << std::endl;
+    std::cout << "pages " << report.pages << ", nodes " << report.nodes << ", leaves " << report.leaves
+              << ", keys " << report.keys << ", height " << report.height
+              << ", free " << report.free_pages << ", leaked " << report.leaked_pages << std::endl;
+    if (report.repaired)
+        std::cout << "header repaired" << std::endl;
+    return report.ok() ? 0 : 1;
+}